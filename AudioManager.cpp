@@ -19,11 +19,16 @@
 #define ALSA_PCM_NEW_HW_PARAMS_API
 #include <alsa/asoundlib.h>
 #include <netinet/in.h>
+#include <sys/select.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <thread>
+#include <chrono>
 
-#include "MainWindow.h"
 #include "AudioManager.h"
 #include "Configure.h"
 
@@ -31,14 +36,15 @@
 #define CFG_DIR "/tmp/"
 #endif
 
-CAudioManager::CAudioManager() : hot_mic(false), play_file(false), gate_sid_in(0U), link_sid_in(0U)
+CAudioManager::CAudioManager() : hot_mic(false), play_file(false), gate_sid_in(0U), link_sid_in(0U), keep_dispatching(false)
 {
 	link_open = true;
 }
 
-bool CAudioManager::Init(CMainWindow *pMain)
+bool CAudioManager::Init(CConfigure *config, std::function<void(bool)> receive)
 {
-	pMainWindow = pMain;
+	pConfig = config;
+	Receive = receive;
 	std::string index(CFG_DIR);
 
 	index.append("announce/index.dat");
@@ -63,10 +69,72 @@ bool CAudioManager::Init(CMainWindow *pMain)
 	}
 	AM2Gate.SetUp("am2gate");
 	AM2Link.SetUp("am2link");
-	LogInput.SetUp("log_input");
+
+	if (Gate2AM.Open("gate2am"))
+		return true;
+	if (Link2AM.Open("link2am")) {
+		Gate2AM.Close();
+		return true;
+	}
+	keep_dispatching = true;
+	dispatch = std::async(std::launch::async, &CAudioManager::DispatchThread, this);
 	return false;
 }
 
+void CAudioManager::Close()
+{
+	if (keep_dispatching) {
+		keep_dispatching = false;
+		dispatch.get();
+		Gate2AM.Close();
+		Link2AM.Close();
+	}
+}
+
+void CAudioManager::DispatchThread()
+{
+	// voice frames shouldn't wait on anything else, but it's okay if we're not allowed to do this
+	struct sched_param param;
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+	pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+	while (keep_dispatching) {
+		fd_set fdset;
+		FD_ZERO(&fdset);
+		FD_SET(Gate2AM.GetFD(), &fdset);
+		FD_SET(Link2AM.GetFD(), &fdset);
+		int max_fd = (Gate2AM.GetFD() > Link2AM.GetFD()) ? Gate2AM.GetFD() : Link2AM.GetFD();
+		struct timeval tv;
+		tv.tv_sec = 0;
+		tv.tv_usec = 100000;
+		if (select(max_fd + 1, &fdset, 0, 0, &tv) <= 0)
+			continue;
+
+		if (FD_ISSET(Gate2AM.GetFD(), &fdset))
+			Dispatch(Gate2AM, true);
+		if (FD_ISSET(Link2AM.GetFD(), &fdset))
+			Dispatch(Link2AM, false);
+	}
+}
+
+void CAudioManager::Dispatch(CFrameReader &reader, bool from_gate)
+{
+	reader.Clear();
+	ssize_t length;
+	CDSVT *dsvt;
+	while (nullptr != (dsvt = reader.Read(length))) {
+		if (0 == memcmp(dsvt->title, "DSVT", 4)) {
+			const uint64_t received = CFramePool::GetTime(dsvt);
+			if (from_gate)
+				Gateway2AudioMgr(*dsvt, received);
+			else
+				Link2AudioMgr(*dsvt, received);
+		} else if (0 == memcmp(dsvt->title, "PLAY", 4))
+			PlayFile((char *)&dsvt->config);
+		reader.Release(dsvt);
+	}
+}
+
 
 void CAudioManager::RecordMicThread(E_PTT_Type for_who, const std::string &urcall)
 {
@@ -91,46 +159,23 @@ void CAudioManager::RecordMicThread(E_PTT_Type for_who, const std::string &urcal
 	}
 }
 
-void CAudioManager::makeheader(CDSVT &c, const std::string &urcall, unsigned char *ut, unsigned char *uh)
+std::shared_ptr<const CSlowData> CAudioManager::GetSlowData(const std::string &urcall)
 {
-	// this also makes the scrambled text message and header for streaming into the slow data
-	// only the 1-byte header need to be interleaved before and between each 5 byte set
-	const unsigned char scramble[5] = { 0x4FU, 0x93U, 0x70U, 0x4FU, 0x93U };
-	auto cfgdata = pMainWindow->cfg.GetData();
-	std::string msg(cfgdata->sMessage);
-	msg.resize(20, ' ');
-	for (int i=0; i<20; i++) {
-		ut[i] = scramble[i%5] ^ msg.at(i);
-	}
-	memset(c.title, 0, sizeof(CDSVT));
-	memcpy(c.title, "DSVT", 4);
-	c.config = 0x10U;
-	c.id = 0x20U;
-	c.flagb[2] = 1U;
-	c.streamid = htons(random.NewStreamID());
-	c.ctrl = 0x80U;
-	memset(c.hdr.flag+3, ' ', 36);
-	memcpy(c.hdr.rpt1, cfgdata->sStation.c_str(), cfgdata->sStation.size());
-	memcpy(c.hdr.rpt2, c.hdr.rpt1, 8);
-	c.hdr.rpt1[7] = cfgdata->cModule;
-	c.hdr.rpt2[7] = 'G';
-	memcpy(c.hdr.urcall, urcall.c_str(), urcall.size());
-	memcpy(c.hdr.mycall, cfgdata->sCallsign.c_str(), cfgdata->sCallsign.size());
-	memcpy(c.hdr.sfx, cfgdata->sName.c_str(), cfgdata->sName.size());
-	calcPFCS(c.hdr.flag, c.hdr.pfcs);
-	for (int i=0; i<41; i++) {
-		uh[i] = scramble[i%5] ^ *(c.hdr.flag + i);
-	}
+	// rebuilt only when the configuration or the urcall changes
+	const CFGDATA *cfgdata = pConfig->GetData();
+	std::lock_guard<std::mutex> lock(slowdata_mutex);
+	if (! slowdata || ! slowdata->Matches(*cfgdata, urcall))
+		slowdata = std::make_shared<const CSlowData>(*cfgdata, urcall);
+	return slowdata;
 }
 
 void CAudioManager::QuickKey(const char *urcall)
 {
 	hot_mic = true;
 	const unsigned char silence[9] = { 0x9EU, 0x8DU, 0x32U, 0x88U, 0x26U, 0x1AU, 0x3FU, 0x61U, 0xE8U };
-	unsigned char ut[20];
-	unsigned char uh[41];
-	CDSVT h;
-	makeheader(h, urcall, ut, uh);
+	auto sd = GetSlowData(urcall);
+	CDSVT h(sd->Header());
+	h.streamid = htons(random.NewStreamID());
 	bool islink = (0 == memcmp(urcall, "CQCQCQ", 6));
 	if (islink)
 		AM2Link.Write(h.title, 56);
@@ -143,7 +188,7 @@ void CAudioManager::QuickKey(const char *urcall)
 		h.ctrl = i;
 		if (9U == i)
 			h.ctrl |= 0x40U;
-		SlowData(i, ut, uh, h);
+		sd->Fill(i, h);
 		std::this_thread::sleep_for(std::chrono::microseconds(19));
 		if (islink)
 			AM2Link.Write(h.title, 27);
@@ -157,28 +202,39 @@ void CAudioManager::ambedevice2packetqueue(PacketQueue &queue, std::mutex &mtx,
 {
 	unsigned count = 0;
 	// add a header;
-	unsigned char ut[20];
-	unsigned char uh[41];
-	CDSVT h;
-	makeheader(h, urcall, ut, uh);
+	auto sd = GetSlowData(urcall);
+	CDSVT h(sd->Header());
+	h.streamid = htons(random.NewStreamID());
 	CDSVT v(h);
 	v.config = 0x20U;
 	bool header_not_sent = true;
 	do {
 		if (! AMBEDevice.IsOpen())
 			return;
-		if (AMBEDevice.GetData(v.vasd.voice))
+		if (AMBEDevice.GetData(v.vasd.voice)) {
+			CPipelineStats::Count(ECounter::device_error);
 			break;
+		}
 		a2d_mutex.lock();
-		v.ctrl = a2d_queue.Pop();
+		SSEQUENCE s = a2d_queue.Pop();
 		a2d_mutex.unlock();
-		SlowData(count++, ut, uh, v);
+		v.ctrl = s.sequence;
+		CPipelineStats::Mark(EStage::encode, s.stamp);
+		sd->Fill(count++, v);
+		SPACKET p;
+		p.dsvt = v;
+		p.stamp = s.stamp;
+		CPipelineStats::Mark(EStage::packetize, p.stamp);
 		mtx.lock();
 		if (header_not_sent) {
-			queue.Push(h);
+			SPACKET hp;
+			hp.dsvt = h;
+			CPipelineStats::Clear(hp.stamp);
+			queue.Push(hp);
 			header_not_sent = false;
 		}
-		queue.Push(v);
+		queue.Push(p);
+		CPipelineStats::Depth((&queue == &link_queue) ? EQueue::link : EQueue::gateway, queue.Size());
 		mtx.unlock();
 	} while (0U == (v.ctrl & 0x40U));
 	//std::cout << count << " frames thru ambedevice2packetqueue\n";
@@ -194,10 +250,14 @@ void CAudioManager::packetqueue2link()
 		if (link_queue.Empty()) {
 			link_mutex.unlock();
 		} else {
-			CDSVT dsvt = link_queue.Pop();
+			SPACKET p = link_queue.Pop();
 			link_mutex.unlock();
-			AM2Link.Write(dsvt.title, (dsvt.config==0x10) ? 56 : 27);
-			ctrl = dsvt.ctrl;
+			// a frame that couldn't be queued is counted by the writer
+			if (AM2Link.Write(p.dsvt.title, (p.dsvt.config==0x10) ? 56 : 27) > 0) {
+				CPipelineStats::Mark(EStage::send, p.stamp);
+				CPipelineStats::Total(EStage::tx_total, p.stamp);
+			}
+			ctrl = p.dsvt.ctrl;
 	//		count++;
 		}
 	} while (0U == (ctrl & 0x40U));
@@ -213,90 +273,21 @@ void CAudioManager::packetqueue2gate()
 		if (gateway_queue.Empty()) {
 			gateway_mutex.unlock();
 		} else {
-			CDSVT dsvt = gateway_queue.Pop();
+			SPACKET p = gateway_queue.Pop();
 			gateway_mutex.unlock();
-			AM2Gate.Write(dsvt.title, (dsvt.config==0x10) ? 56 : 27);
-			ctrl = dsvt.ctrl;
-		}
-	} while (0U == (ctrl & 0x40U));
-}
-
-void CAudioManager::SlowData(const unsigned count, const unsigned char *ut, const unsigned char *uh, CDSVT &d)
-{
-	const unsigned char sync[3] = { 0x55U, 0x2DU, 0x16U };
-	const unsigned char empty[3] = { 0x16U, 0x29U, 0xF5U };
-	unsigned ctrl = d.ctrl & 0x1FU;
-	if (ctrl) {
-		const unsigned sf = count / 21;
-		const unsigned cd2 = ctrl / 2;
-		if (sf % 70) {
-			// header
-			switch (ctrl) {
-				case 1:
-				case 3:
-				case 5:
-				case 7:
-				case 9:
-				case 11:
-				case 13:
-				case 15:
-					d.vasd.text[0] = 0x70U ^ 0x55U;
-					d.vasd.text[1] = uh[5*cd2];
-					d.vasd.text[2] = uh[5*cd2+1];
-					break;
-				case 2:
-				case 4:
-				case 6:
-				case 8:
-				case 10:
-				case 12:
-				case 14:
-				case 16:
-					d.vasd.text[0] = uh[5*cd2-3];
-					d.vasd.text[1] = uh[5*cd2-2];
-					d.vasd.text[2] = uh[5*cd2-1];
-					break;
-				case 17:
-					d.vasd.text[0] = 0x70U ^ 0x51U;
-					d.vasd.text[1] = uh[40];
-					d.vasd.text[2] = empty[2];
-					break;
-				default:
-					memcpy(d.vasd.text, empty, 3);
-					break;
-			}
-		} else {
-			// text message
-			switch (ctrl) {
-				case 1:
-				case 3:
-				case 5:
-				case 7:
-					d.vasd.text[0] = 0x70U ^ ('@'+cd2);
-					d.vasd.text[1] = ut[5*cd2];
-					d.vasd.text[2] = ut[5*cd2+1];
-					break;
-				case 2:
-				case 4:
-				case 6:
-				case 8:
-					d.vasd.text[0] = ut[5*cd2-3];
-					d.vasd.text[1] = ut[5*cd2-2];
-					d.vasd.text[2] = ut[5*cd2-1];
-					break;
-				default:
-					memcpy(d.vasd.text, empty, 3);
-					break;
+			// a frame that couldn't be queued is counted by the writer
+			if (AM2Gate.Write(p.dsvt.title, (p.dsvt.config==0x10) ? 56 : 27) > 0) {
+				CPipelineStats::Mark(EStage::send, p.stamp);
+				CPipelineStats::Total(EStage::tx_total, p.stamp);
 			}
+			ctrl = p.dsvt.ctrl;
 		}
-	} else {
-		memcpy(d.vasd.text, sync, 3);
-	}
+	} while (0U == (ctrl & 0x40U));
 }
 
 void CAudioManager::microphone2audioqueue()
 {
-	auto data = pMainWindow->cfg.GetData();
+	auto data = pConfig->GetData();
 	// Open PCM device for recording (capture).
 	snd_pcm_t *handle;
 	int rc = snd_pcm_open(&handle, data->sAudioIn.c_str(), SND_PCM_STREAM_CAPTURE, 0);
@@ -342,12 +333,15 @@ void CAudioManager::microphone2audioqueue()
 		short int audio_buffer[frames];
 		rc = snd_pcm_readi(handle, audio_buffer, frames);
 		//std::cout << "audio:" << count << " hot_mic:" << hot_mic << std::endl;
+		const uint64_t now = CPipelineStats::Now();
 		if (rc == -EPIPE) {
 			// EPIPE means overrun
 			std::cerr << "overrun occurred" << std::endl;
+			CPipelineStats::Count(ECounter::capture_overrun);
 			snd_pcm_prepare(handle);
 		} else if (rc < 0) {
 			std::cerr << "error from readi: " << snd_strerror(rc) << std::endl;
+			CPipelineStats::Count(ECounter::device_error);
 		} else if (rc != int(frames)) {
 			std::cerr << "short readi, read " << rc << " frames" << std::endl;
 		}
@@ -357,8 +351,15 @@ void CAudioManager::microphone2audioqueue()
 			seq |= 0x40U;
 		CAudioFrame frame(audio_buffer);
 		frame.SetSequence(seq);
+		// the first sample was spoken a period, plus whatever is still in the capture buffer, ago
+		snd_pcm_sframes_t delay;
+		if (snd_pcm_delay(handle, &delay) || delay < 0)
+			delay = 0;
+		CPipelineStats::Origin(frame.stamp, now - (frames + delay) * 125000U);
+		CPipelineStats::Mark(EStage::capture, frame.stamp, now);
 		audio_mutex.lock();
 		audio_queue.Push(frame);
+		CPipelineStats::Depth(EQueue::audio, audio_queue.Size());
 		audio_mutex.unlock();
 		count++;
 	} while (keep_running);
@@ -379,11 +380,16 @@ void CAudioManager::audioqueue2ambedevice()
 		audio_mutex.unlock();
 		if (! AMBEDevice.IsOpen())
 			return;
-		if(AMBEDevice.SendAudio(frame.GetData()))
+		if (AMBEDevice.SendAudio(frame.GetData())) {
+			CPipelineStats::Count(ECounter::device_error);
 			break;
+		}
 		seq = frame.GetSequence();
+		SSEQUENCE s;
+		s.sequence = seq;
+		s.stamp = frame.stamp;
 		a2d_mutex.lock();
-		a2d_queue.Push(frame.GetSequence());
+		a2d_queue.Push(s);
 		a2d_mutex.unlock();
 	//	count++;
 	} while (0U == (seq & 0x40U));
@@ -398,11 +404,13 @@ void CAudioManager::ambedevice2ambequeue()
 		unsigned char ambe[9];
 		if (! AMBEDevice.IsOpen())
 			return;
-		if (AMBEDevice.GetData(ambe))
+		if (AMBEDevice.GetData(ambe)) {
+			CPipelineStats::Count(ECounter::device_error);
 			break;
-		CAMBEFrame frame(ambe);
+		}
+		CAMBEFrame frame(ambe);	// echo frames aren't timed, they sit in the queue until the key up
 		a2d_mutex.lock();
-		seq = a2d_queue.Pop();
+		seq = a2d_queue.Pop().sequence;
 		a2d_mutex.unlock();
 		frame.SetSequence(seq);
 		ambe_mutex.lock();
@@ -430,20 +438,32 @@ void CAudioManager::PlayAMBEDataThread()
 	p3 = std::async(std::launch::async, &CAudioManager::play_audio_queue, this);
 }
 
-void CAudioManager::Link2AudioMgr(const CDSVT &dsvt)
+void CAudioManager::Link2AudioMgr(const CDSVT &dsvt, uint64_t received)
 {
 	l2am_mutex.lock();
-	l2am(dsvt, false);
+	l2am(dsvt, false, received);
 	l2am_mutex.unlock();
 }
 
-void CAudioManager::l2am(const CDSVT &dsvt, const bool shutoff) {
+void CAudioManager::QueueAMBE(const CDSVT &dsvt, uint64_t received)
+{
+	CAMBEFrame frame(dsvt.vasd.voice);
+	frame.SetSequence(dsvt.ctrl);
+	CPipelineStats::Origin(frame.stamp, received ? received : CPipelineStats::Now());
+	CPipelineStats::Mark(EStage::receive, frame.stamp);
+	ambe_mutex.lock();
+	ambe_queue.Push(frame);
+	CPipelineStats::Depth(EQueue::ambe, ambe_queue.Size());
+	ambe_mutex.unlock();
+}
+
+void CAudioManager::l2am(const CDSVT &dsvt, const bool shutoff, uint64_t received) {
 	if (link_open && AMBEDevice.IsOpen() && 0U==gate_sid_in && ! play_file) {	// don't do anythings if the gateway is currently providing audio
 
 		if (0U==link_sid_in && 0U==(dsvt.ctrl & 0x40U)) {	// don't start if it's the last audio frame
 			// here comes a new stream
 			link_sid_in = dsvt.streamid;
-			pMainWindow->Receive(true);
+			Receive(true);
 			// launch the audio processing threads
 			p1 = std::async(std::launch::async, &CAudioManager::ambequeue2ambedevice, this);
 			p2 = std::async(std::launch::async, &CAudioManager::ambedevice2audioqueue, this);
@@ -453,11 +473,7 @@ void CAudioManager::l2am(const CDSVT &dsvt, const bool shutoff) {
 			return;
 		if (0x20U != dsvt.config)
 			return;	// we only need audio frames at this point
-		CAMBEFrame frame(dsvt.vasd.voice);
-		frame.SetSequence(dsvt.ctrl);
-		ambe_mutex.lock();
-		ambe_queue.Push(frame);
-		ambe_mutex.unlock();
+		QueueAMBE(dsvt, received);
 		if (shutoff)
 			link_open = false;	// slam the door shut. it will open again when pLink is relinked.
 		if (dsvt.ctrl & 0x40U) {
@@ -465,19 +481,19 @@ void CAudioManager::l2am(const CDSVT &dsvt, const bool shutoff) {
 			p2.get();
 			p3.get();
 			link_sid_in = 0U;
-			pMainWindow->Receive(false);
+			Receive(false);
 		}
 	}
 }
 
-void CAudioManager::Gateway2AudioMgr(const CDSVT &dsvt)
+void CAudioManager::Gateway2AudioMgr(const CDSVT &dsvt, uint64_t received)
 {
 	if (AMBEDevice.IsOpen() && 0U==link_sid_in && ! play_file) {	// don't do anythings if the link is currently providing audio
 
 		if (0U==gate_sid_in && 0U==(dsvt.ctrl & 0x40U)) {	// don't start if it's the last audio frame
 			// here comes a new stream
 			gate_sid_in = dsvt.streamid;
-			pMainWindow->Receive(true);
+			Receive(true);
 			// launch the audio processing threads
 			p1 = std::async(std::launch::async, &CAudioManager::ambequeue2ambedevice, this);
 			p2 = std::async(std::launch::async, &CAudioManager::ambedevice2audioqueue, this);
@@ -487,17 +503,13 @@ void CAudioManager::Gateway2AudioMgr(const CDSVT &dsvt)
 			return;
 		if (0x20U != dsvt.config)
 			return;	// we only need audio frames at this point
-		CAMBEFrame frame(dsvt.vasd.voice);
-		frame.SetSequence(dsvt.ctrl);
-		ambe_mutex.lock();
-		ambe_queue.Push(frame);
-		ambe_mutex.unlock();
+		QueueAMBE(dsvt, received);
 		if (dsvt.ctrl & 0x40U) {
 			p1.get();	// we're done, get the finished threads and reset the current stream id
 			p2.get();
 			p3.get();
 			gate_sid_in = 0U;
-			pMainWindow->Receive(false);
+			Receive(false);
 		}
 	}
 }
@@ -514,13 +526,18 @@ void CAudioManager::ambequeue2ambedevice()
 		CAMBEFrame frame(ambe_queue.Pop());
 		ambe_mutex.unlock();
 		seq = frame.GetSequence();
+		SSEQUENCE s;
+		s.sequence = seq;
+		s.stamp = frame.stamp;
 		d2a_mutex.lock();
-		d2a_queue.Push(seq);
+		d2a_queue.Push(s);
 		d2a_mutex.unlock();
 		if (! AMBEDevice.IsOpen())
 			return;
-		if (AMBEDevice.SendData(frame.GetData()))
+		if (AMBEDevice.SendData(frame.GetData())) {
+			CPipelineStats::Count(ECounter::device_error);
 			return;
+		}
 	//	count++;
 	} while (0U == (seq & 0x40U));
 	//std::cout << "ambequeue2ambedevice sent " << count << " packets" << std::endl;
@@ -534,15 +551,21 @@ void CAudioManager::ambedevice2audioqueue()
 		if (! AMBEDevice.IsOpen())
 			return;
 		short audio[160];
-		if (AMBEDevice.GetAudio(audio))
+		if (AMBEDevice.GetAudio(audio)) {
+			CPipelineStats::Count(ECounter::device_error);
 			return;
+		}
 		CAudioFrame frame(audio);
 		d2a_mutex.lock();
-		seq = d2a_queue.Pop();
+		SSEQUENCE s = d2a_queue.Pop();
 		d2a_mutex.unlock();
+		seq = s.sequence;
 		frame.SetSequence(seq);
+		frame.stamp = s.stamp;
+		CPipelineStats::Mark(EStage::decode, frame.stamp);
 		audio_mutex.lock();
 		audio_queue.Push(frame);
+		CPipelineStats::Depth(EQueue::audio, audio_queue.Size());
 		audio_mutex.unlock();
 	//	count++;
 	} while ( 0U == (seq & 0x40U));
@@ -551,7 +574,7 @@ void CAudioManager::ambedevice2audioqueue()
 
 void CAudioManager::play_audio_queue()
 {
-	auto data = pMainWindow->cfg.GetData();
+	auto data = pConfig->GetData();
 	//int count = 0;
 	std::this_thread::sleep_for(std::chrono::milliseconds(300));
 	// Open PCM device for playback.
@@ -610,12 +633,20 @@ void CAudioManager::play_audio_queue()
 		if (rc == -EPIPE) {
 			// EPIPE means underrun
 			// std::cerr << "underrun occurred" << std::endl;
+			CPipelineStats::Count(ECounter::playout_underrun);
 			snd_pcm_prepare(handle);
 		} else if (rc < 0) {
 			std::cerr <<  "error from writei: " << snd_strerror(rc) << std::endl;
+			CPipelineStats::Count(ECounter::device_error);
 		}  else if (rc != int(frames)) {
 			std::cerr << "short write, write " << rc << " frames" << std::endl;
 		}
+		// it will be heard after everything ahead of it in the playback buffer
+		snd_pcm_sframes_t delay;
+		if (snd_pcm_delay(handle, &delay) || delay < 0)
+			delay = 0;
+		CPipelineStats::Mark(EStage::playout, frame.stamp, CPipelineStats::Now() + delay * 125000U);
+		CPipelineStats::Total(EStage::rx_total, frame.stamp);
 	//	count++;
 	} while (0U == (seq & 0x40U));
 
@@ -640,43 +671,6 @@ bool CAudioManager::ambe_is_empty()
 	return ret;
 }
 
-void CAudioManager::calcPFCS(const unsigned char *packet, unsigned char *pfcs)
-{
-	unsigned short crc_dstar_ffff = 0xffff;
-	unsigned short tmp, short_c;
-	unsigned short crc_tabccitt[256] = {
-		0x0000,0x1189,0x2312,0x329b,0x4624,0x57ad,0x6536,0x74bf,0x8c48,0x9dc1,0xaf5a,0xbed3,0xca6c,0xdbe5,0xe97e,0xf8f7,
-		0x1081,0x0108,0x3393,0x221a,0x56a5,0x472c,0x75b7,0x643e,0x9cc9,0x8d40,0xbfdb,0xae52,0xdaed,0xcb64,0xf9ff,0xe876,
-		0x2102,0x308b,0x0210,0x1399,0x6726,0x76af,0x4434,0x55bd,0xad4a,0xbcc3,0x8e58,0x9fd1,0xeb6e,0xfae7,0xc87c,0xd9f5,
-		0x3183,0x200a,0x1291,0x0318,0x77a7,0x662e,0x54b5,0x453c,0xbdcb,0xac42,0x9ed9,0x8f50,0xfbef,0xea66,0xd8fd,0xc974,
-		0x4204,0x538d,0x6116,0x709f,0x0420,0x15a9,0x2732,0x36bb,0xce4c,0xdfc5,0xed5e,0xfcd7,0x8868,0x99e1,0xab7a,0xbaf3,
-		0x5285,0x430c,0x7197,0x601e,0x14a1,0x0528,0x37b3,0x263a,0xdecd,0xcf44,0xfddf,0xec56,0x98e9,0x8960,0xbbfb,0xaa72,
-		0x6306,0x728f,0x4014,0x519d,0x2522,0x34ab,0x0630,0x17b9,0xef4e,0xfec7,0xcc5c,0xddd5,0xa96a,0xb8e3,0x8a78,0x9bf1,
-		0x7387,0x620e,0x5095,0x411c,0x35a3,0x242a,0x16b1,0x0738,0xffcf,0xee46,0xdcdd,0xcd54,0xb9eb,0xa862,0x9af9,0x8b70,
-		0x8408,0x9581,0xa71a,0xb693,0xc22c,0xd3a5,0xe13e,0xf0b7,0x0840,0x19c9,0x2b52,0x3adb,0x4e64,0x5fed,0x6d76,0x7cff,
-		0x9489,0x8500,0xb79b,0xa612,0xd2ad,0xc324,0xf1bf,0xe036,0x18c1,0x0948,0x3bd3,0x2a5a,0x5ee5,0x4f6c,0x7df7,0x6c7e,
-		0xa50a,0xb483,0x8618,0x9791,0xe32e,0xf2a7,0xc03c,0xd1b5,0x2942,0x38cb,0x0a50,0x1bd9,0x6f66,0x7eef,0x4c74,0x5dfd,
-		0xb58b,0xa402,0x9699,0x8710,0xf3af,0xe226,0xd0bd,0xc134,0x39c3,0x284a,0x1ad1,0x0b58,0x7fe7,0x6e6e,0x5cf5,0x4d7c,
-		0xc60c,0xd785,0xe51e,0xf497,0x8028,0x91a1,0xa33a,0xb2b3,0x4a44,0x5bcd,0x6956,0x78df,0x0c60,0x1de9,0x2f72,0x3efb,
-		0xd68d,0xc704,0xf59f,0xe416,0x90a9,0x8120,0xb3bb,0xa232,0x5ac5,0x4b4c,0x79d7,0x685e,0x1ce1,0x0d68,0x3ff3,0x2e7a,
-		0xe70e,0xf687,0xc41c,0xd595,0xa12a,0xb0a3,0x8238,0x93b1,0x6b46,0x7acf,0x4854,0x59dd,0x2d62,0x3ceb,0x0e70,0x1ff9,
-		0xf78f,0xe606,0xd49d,0xc514,0xb1ab,0xa022,0x92b9,0x8330,0x7bc7,0x6a4e,0x58d5,0x495c,0x3de3,0x2c6a,0x1ef1,0x0f78
-	};
-
-	for (int i = 0; i < 39 ; i++) {
-		short_c = 0x00ff & (unsigned short)packet[i];
-		tmp = (crc_dstar_ffff & 0x00ff) ^ short_c;
-		crc_dstar_ffff = (crc_dstar_ffff >> 8) ^ crc_tabccitt[tmp];
-	}
-	crc_dstar_ffff =  ~crc_dstar_ffff;
-	tmp = crc_dstar_ffff;
-
-	pfcs[0] = (unsigned char)(crc_dstar_ffff & 0xff);
-	pfcs[1] = (unsigned char)((tmp >> 8) & 0xff);
-
-	return;
-}
-
 void CAudioManager::KeyOff()
 {
 	if (hot_mic) {
@@ -716,7 +710,7 @@ void CAudioManager::PlayFile(const char *filetoplay)
 		return;
 	}
 	play_file = true;
-	auto cfgdata = pMainWindow->cfg.GetData();
+	auto cfgdata = pConfig->GetData();
 	std::string msg(filetoplay);
 	if (cfgdata->cModule != msg.at(0)) {
 		std::cerr << "Improper module in msg " << msg << std::endl;
@@ -738,7 +732,7 @@ void CAudioManager::PlayFile(const char *filetoplay)
 	if (msg.size() > pos+4) {
 		message.assign(msg.substr(pos+5));
 		message.append("\n");
-		LogInput.Write(message.c_str(), message.size()+1);
+		CLogRing::Push(ELogLevel::info, message.c_str());
 	}
 
 	std::string cfgdir(CFG_DIR);
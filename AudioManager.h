@@ -23,30 +23,40 @@
 #include <atomic>
 #include <mutex>
 #include <vector>
+#include <functional>
+#include <memory>
 
 #include "DV3000U.h"
 #include "TemplateClasses.h"
 #include "DSVT.h"
 #include "Random.h"
-#include "UnixDgramSocket.h"
+#include "FrameRing.h"
+#include "LogRing.h"
+#include "Configure.h"
+#include "SlowData.h"
 
-using PacketQueue = CTQueue<CDSVT>;
+using SPACKET = struct packet_tag {
+	CDSVT dsvt;
+	STIMESTAMP stamp;
+};
+using PacketQueue = CTQueue<SPACKET>;
 
 enum class E_PTT_Type { echo, gateway, link };
 
-class CMainWindow;
-
 class CAudioManager
 {
 public:
 	CAudioManager();
-	~CAudioManager() {}
-	bool Init(CMainWindow *);
+	~CAudioManager() { Close(); }
+	// receive is called with true when a stream starts playing and false when it ends
+	bool Init(CConfigure *config, std::function<void(bool)> receive);
+	void Close();
 
 	void RecordMicThread(E_PTT_Type for_who, const std::string &urcall);
 	void PlayAMBEDataThread();	// for Echo
-	void Gateway2AudioMgr(const CDSVT &dsvt);
-	void Link2AudioMgr(const CDSVT &dsvt);
+	// received is when the frame came off the network, if it's known
+	void Gateway2AudioMgr(const CDSVT &dsvt, uint64_t received = 0);
+	void Link2AudioMgr(const CDSVT &dsvt, uint64_t received = 0);
 	void KeyOff();
 	void PlayFile(const char *filetoplay);
 	void QuickKey(const char *urcall);
@@ -67,14 +77,21 @@ private:
 	std::future<void> r1, r2, r3, r4, p1, p2, p3;
 	bool link_open;
 	// helpers
-	CMainWindow *pMainWindow;
+	CConfigure *pConfig;
+	std::function<void(bool)> Receive;
 	CRandom random;
-	void l2am(const CDSVT &dsvt, const bool shutoff);
+	void l2am(const CDSVT &dsvt, const bool shutoff, uint64_t received = 0);
+	void QueueAMBE(const CDSVT &dsvt, uint64_t received);
 	std::vector<unsigned long> speak;
-	// Unix sockets
-	CUnixDgramWriter AM2Gate, AM2Link, LogInput;
+	// frame channels to and from the gateway and link
+	CFrameReader Gate2AM, Link2AM;
+	CFrameWriter AM2Gate, AM2Link;
+	// incoming frames are dispatched on their own thread, not the GUI's
+	std::atomic<bool> keep_dispatching;
+	std::future<void> dispatch;
+	void DispatchThread();
+	void Dispatch(CFrameReader &reader, bool from_gate);
 	// methods
-	void calcPFCS(const unsigned char *packet, unsigned char *pfcs);
 	bool audio_is_empty();
 	bool ambe_is_empty();
 	void microphone2audioqueue();
@@ -86,6 +103,8 @@ private:
 	void packetqueue2link();
 	void packetqueue2gate();
 	void play_audio_queue();
-	void makeheader(CDSVT &c, const std::string &urcall, unsigned char *ut, unsigned char *uh);
-	void SlowData(const unsigned count, const unsigned char *ut, const unsigned char *uh, CDSVT &v);
+	// the header and slow data of the last transmission
+	std::mutex slowdata_mutex;
+	std::shared_ptr<const CSlowData> slowdata;
+	std::shared_ptr<const CSlowData> GetSlowData(const std::string &urcall);
 };
@@ -16,29 +16,35 @@
  *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#include <cstdio>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
 #include "CacheManager.h"
 
-void CCacheManager::findUserData(const std::string &user, std::string &rptr, std::string &gate, std::string &addr)
+void CCacheManager::findUserData(const std::string &user, std::string &rptr, std::string &gate, std::string &addr, int &source)
 {
 	mux.lock();
 	rptr.assign(findUserRptr(user));
 	gate.assign(findRptrGate(rptr));
-	addr.assign(findGateAddr(gate));
+	addr.assign(findGateAddr(gate, source));
 	mux.unlock();
 }
 
-void CCacheManager::findRptrData(const std::string &rptr, std::string &gate, std::string &addr)
+void CCacheManager::findRptrData(const std::string &rptr, std::string &gate, std::string &addr, int &source)
 {
 	mux.lock();
 	gate.assign(findRptrGate(rptr));
-	addr.assign(findGateAddr(gate));
+	addr.assign(findGateAddr(gate, source));
 	mux.unlock();
 }
 
 std::string CCacheManager::findUserAddr(const std::string &user)
 {
+	int source;
 	mux.lock();
-	std::string addr(findGateAddr(findRptrGate(findUserRptr(user))));
+	std::string addr(findGateAddr(findRptrGate(findUserRptr(user)), source));
 	mux.unlock();
 
 	return addr;
@@ -50,9 +56,9 @@ std::string CCacheManager::findUserTime(const std::string &user)
 	if (user.empty())
 		return utime;
 	mux.lock();
-	auto itt = UserTime.find(user);
-	if (itt != UserTime.end())
-		utime.assign(itt->second);
+	auto itt = Users.find(user);
+	if (itt != Users.end())
+		utime.assign(itt->second.time);
 	mux.unlock();
 	return utime;
 }
@@ -67,30 +73,31 @@ std::string CCacheManager::findUserRepeater(const std::string &user)
 
 std::string CCacheManager::findGateAddress(const std::string &gate)
 {
+	int source;
 	mux.lock();
-	std::string addr(findGateAddr(gate));
+	std::string addr(findGateAddr(gate, source));
 	mux.unlock();
 	return addr;
 }
 
-std::string CCacheManager::findNameNick(const std::string &name)
+std::string CCacheManager::findNameNick(int source, const std::string &name)
 {
 	std::string nick;
 	if (name.empty())
 		return nick;
 	mux.lock();
-	auto itn = NameNick.find(name);
-	if (itn != NameNick.end())
+	auto itn = NameNick[source].find(name);
+	if (itn != NameNick[source].end())
 		nick.assign(itn->second);
 	mux.unlock();
 	return nick;
 }
 
-std::string CCacheManager::findServerUser()
+std::string CCacheManager::findServerUser(int source)
 {
 	std::string suser;
 	mux.lock();
-	for (auto it=NameNick.begin(); it!=NameNick.end(); it++) {
+	for (auto it=NameNick[source].begin(); it!=NameNick[source].end(); it++) {
 		if (0 == it->first.compare(0, 2, "s-")) {
 			suser.assign(it->first);
 			break;
@@ -100,50 +107,64 @@ std::string CCacheManager::findServerUser()
 	return suser;
 }
 
-void CCacheManager::updateUser(const std::string &user, const std::string &rptr, const std::string &gate, const std::string &addr, const std::string &time)
+void CCacheManager::updateUser(const std::string &user, const std::string &rptr, const std::string &time)
 {
 	if (user.empty())
 		return;
 
 	mux.lock();
-	if (! time.empty())
-		UserTime[user] = time;
-
-	if (rptr.empty()) {
+	auto it = Users.find(user);
+	// the times are "YYYY-MM-DD HH:MM:SS", so they compare as strings
+	if (it != Users.end() && ! time.empty() && time.compare(it->second.time) < 0) {
 		mux.unlock();
-		return;
+		return;	// the other connection already has a newer answer
 	}
+	if (it == Users.end())
+		it = Users.emplace(user, SUSERDATA()).first;
+	else
+		bytes -= userBytes(it->first, it->second);
+	SUSERDATA &u = it->second;
+	if (! time.empty())
+		u.time = time;
+	if (! rptr.empty())
+		u.rptr = rptr;
+	u.used = ++uses;
+	bytes += userBytes(it->first, u);
 
-	UserRptr[user] = rptr;
-
-	if (gate.empty() || addr.empty()) {
-		mux.unlock();
-		return;
-	}
-
-	if (rptr.compare(0, 7, gate, 0, 7))
-		RptrGate[rptr] = gate;	// only do this if they differ
-
-	GateAddr[gate] = addr;
+	// the answer to a FIND, or the user was heard, the first answer from either connection is enough
+	for (int i=0; i<CACHE_SOURCES; i++)
+		Pending[i].erase(user);
+	NotFound.erase(user);
+	if (limit && bytes > limit)
+		evict();
 	mux.unlock();
 }
 
-void CCacheManager::updateRptr(const std::string &rptr, const std::string &gate, const std::string &addr)
+void CCacheManager::updateRptr(const std::string &rptr, const std::string &gate, const std::string &time)
 {
 	if (rptr.empty() || gate.empty())
 		return;
 
 	mux.lock();
-	RptrGate[rptr] = gate;
-	if (addr.empty()) {
-		mux.unlock();
-		return;
+	auto it = RptrGate.find(rptr);
+	if (it == RptrGate.end() || time.empty() || time.compare(it->second.time) >= 0) {
+		if (it == RptrGate.end())
+			it = RptrGate.emplace(rptr, SRPTRDATA()).first;
+		else
+			bytes -= rptrBytes(it->first, it->second);
+		SRPTRDATA &r = it->second;
+		r.gate = gate;
+		if (! time.empty())
+			r.time = time;
+		r.used = ++uses;
+		bytes += rptrBytes(it->first, r);
+		if (limit && bytes > limit)
+			evict();
 	}
-	GateAddr[gate] = addr;
 	mux.unlock();
 }
 
-void CCacheManager::updateGate(const std::string &G, const std::string &addr)
+void CCacheManager::updateGate(int source, const std::string &G, const std::string &addr)
 {
 	if (G.empty() || addr.empty())
 		return;
@@ -154,50 +175,256 @@ void CCacheManager::updateGate(const std::string &G, const std::string &addr)
 		p = gate.find('_');
 	}
 	mux.lock();
-	GateAddr[gate] = addr;
+	SGATEDATA &g = GateAddr[gate];
+	g.addr[source] = addr;
+	g.update[source] = ++updates;
 	mux.unlock();
 }
 
-void CCacheManager::updateName(const std::string &name, const std::string &nick)
+void CCacheManager::updateName(int source, const std::string &name, const std::string &nick)
 {
 	if (name.empty() || nick.empty())
 		return;
 	mux.lock();
-	NameNick[name] = nick;
+	NameNick[source][name] = nick;
+	mux.unlock();
+}
+
+void CCacheManager::updateNotFound(const std::string &user)
+{
+	if (user.empty())
+		return;
+	const time_t now = time(nullptr);
+	mux.lock();
+	for (int i=0; i<CACHE_SOURCES; i++)
+		Pending[i].erase(user);
+	// the other connection may have found it
+	if (findUserRptr(user).empty()) {
+		if (NotFound.size() >= 1024U) {
+			for (auto it=NotFound.begin(); it!=NotFound.end(); ) {
+				if (now - it->second >= NOT_FOUND_TTL)
+					it = NotFound.erase(it);
+				else
+					it++;
+			}
+		}
+		NotFound[user] = now;
+	}
+	mux.unlock();
+}
+
+bool CCacheManager::isNotFound(const std::string &user)
+{
+	bool rval = false;
+	mux.lock();
+	auto it = NotFound.find(user);
+	if (it != NotFound.end()) {
+		if (time(nullptr) - it->second < NOT_FOUND_TTL)
+			rval = true;
+		else
+			NotFound.erase(it);
+	}
+	mux.unlock();
+	return rval;
+}
+
+bool CCacheManager::findPending(int source, const std::string &user)
+{
+	const time_t now = time(nullptr);
+	bool rval = true;
+	mux.lock();
+	auto itn = NotFound.find(user);
+	if (itn == NotFound.end() || now - itn->second >= NOT_FOUND_TTL) {
+		auto itp = Pending[source].find(user);
+		if (itp == Pending[source].end() || now - itp->second >= FIND_TIMEOUT) {
+			Pending[source][user] = now;
+			rval = false;
+		}
+	}
+	mux.unlock();
+	return rval;
+}
+
+void CCacheManager::clearPending(int source)
+{
+	mux.lock();
+	Pending[source].clear();
+	mux.unlock();
+}
+
+void CCacheManager::eraseGate(int source, const std::string &gate)
+{
+	mux.lock();
+	auto it = GateAddr.find(gate);
+	if (it!=GateAddr.end() && dropGate(source, it->second))
+		GateAddr.erase(it);
 	mux.unlock();
 }
 
-void CCacheManager::eraseGate(const std::string &gate)
+void CCacheManager::eraseName(int source, const std::string &name)
 {
 	mux.lock();
-	GateAddr.erase(gate);
+	NameNick[source].erase(name);
 	mux.unlock();
 }
 
-void CCacheManager::eraseName(const std::string &name)
+// the source's irc user list is being reloaded
+void CCacheManager::clearGate(int source)
 {
 	mux.lock();
-	NameNick.erase(name);
+	for (auto it=GateAddr.begin(); it!=GateAddr.end(); ) {
+		if (dropGate(source, it->second))
+			it = GateAddr.erase(it);
+		else
+			it++;
+	}
+	NameNick[source].clear();
 	mux.unlock();
 }
 
-void CCacheManager::clearGate()
+void CCacheManager::setLimit(size_t b)
 {
 	mux.lock();
-	GateAddr.clear();
-	NameNick.clear();
+	limit = b;
+	if (limit && bytes > limit)
+		evict();
 	mux.unlock();
 }
 
-// these last three functions are private and not mux locked.
+void CCacheManager::getStats(SCACHESTATS &stats)
+{
+	mux.lock();
+	stats.users = Users.size();
+	stats.rptrs = RptrGate.size();
+	stats.gates = GateAddr.size();
+	stats.notfound = NotFound.size();
+	stats.names = stats.pending = 0;
+	stats.bytes = bytes;
+	stats.limit = limit;
+	stats.evicted = evicted;
+	stats.total = bytes;
+	for (const auto &g : GateAddr) {
+		stats.total += sizeof(g) + 2 * sizeof(void *) + stringBytes(g.first);
+		for (int i=0; i<CACHE_SOURCES; i++)
+			stats.total += stringBytes(g.second.addr[i]);
+	}
+	for (int i=0; i<CACHE_SOURCES; i++) {
+		stats.names += NameNick[i].size();
+		stats.pending += Pending[i].size();
+		for (const auto &n : NameNick[i])
+			stats.total += sizeof(n) + 2 * sizeof(void *) + stringBytes(n.first) + stringBytes(n.second);
+		for (const auto &p : Pending[i])
+			stats.total += sizeof(p) + 2 * sizeof(void *) + stringBytes(p.first);
+	}
+	for (const auto &n : NotFound)
+		stats.total += sizeof(n) + 2 * sizeof(void *) + stringBytes(n.first);
+	mux.unlock();
+}
+
+// these last functions are private and not mux locked.
+// the users and repeaters are trimmed to 7/8 of the limit, so this doesn't run for every update.
+// the updates arrive in ircDDB time order and an older one is ignored, so the used stamps
+// are in UserTime order, except that an entry the gateway routes to is new again.
+void CCacheManager::evict()
+{
+	const size_t target = limit - limit / 8;
+	std::vector<std::pair<uint64_t, size_t>> ages;
+	ages.reserve(Users.size() + RptrGate.size());
+	for (const auto &u : Users)
+		ages.emplace_back(u.second.used, userBytes(u.first, u.second));
+	for (const auto &r : RptrGate)
+		ages.emplace_back(r.second.used, rptrBytes(r.first, r.second));
+	std::sort(ages.begin(), ages.end());
+
+	// every stamp is different, so everything up to the cutoff goes
+	uint64_t cutoff = 0;
+	size_t freed = 0;
+	for (const auto &a : ages) {
+		if (bytes - freed <= target)
+			break;
+		freed += a.second;
+		cutoff = a.first;
+	}
+
+	unsigned long users = 0, rptrs = 0;
+	for (auto it=Users.begin(); it!=Users.end(); ) {
+		if (it->second.used <= cutoff) {
+			bytes -= userBytes(it->first, it->second);
+			it = Users.erase(it);
+			users++;
+		} else
+			it++;
+	}
+	for (auto it=RptrGate.begin(); it!=RptrGate.end(); ) {
+		if (it->second.used <= cutoff) {
+			bytes -= rptrBytes(it->first, it->second);
+			it = RptrGate.erase(it);
+			rptrs++;
+		} else
+			it++;
+	}
+	evicted += users + rptrs;
+
+	// a FIND that was never answered would otherwise stay forever
+	const time_t now = time(nullptr);
+	for (auto it=NotFound.begin(); it!=NotFound.end(); ) {
+		if (now - it->second >= NOT_FOUND_TTL)
+			it = NotFound.erase(it);
+		else
+			it++;
+	}
+	for (int i=0; i<CACHE_SOURCES; i++) {
+		for (auto it=Pending[i].begin(); it!=Pending[i].end(); ) {
+			if (now - it->second >= FIND_TIMEOUT)
+				it = Pending[i].erase(it);
+			else
+				it++;
+		}
+	}
+	printf("ircDDB cache: dropped the %lu oldest users and %lu oldest repeaters, %zu of %zu KB used\n", users, rptrs, bytes / 1024, limit / 1024);
+}
+
+// only a string too long for its small string buffer has memory of its own
+size_t CCacheManager::stringBytes(const std::string &s)
+{
+	const char *p = s.data();
+	const char *base = (const char *)&s;
+	return (p >= base && p < base + sizeof(s)) ? 0 : s.capacity() + 1;
+}
+
+// the hash node and the bucket pointer, plus the strings
+size_t CCacheManager::userBytes(const std::string &user, const SUSERDATA &u)
+{
+	return sizeof(std::pair<const std::string, SUSERDATA>) + 2 * sizeof(void *) + stringBytes(user) + stringBytes(u.rptr) + stringBytes(u.time);
+}
+
+size_t CCacheManager::rptrBytes(const std::string &rptr, const SRPTRDATA &r)
+{
+	return sizeof(std::pair<const std::string, SRPTRDATA>) + 2 * sizeof(void *) + stringBytes(rptr) + stringBytes(r.gate) + stringBytes(r.time);
+}
+
+// returns true if no source has an address for the gateway now
+bool CCacheManager::dropGate(int source, SGATEDATA &g)
+{
+	g.addr[source].clear();
+	g.update[source] = 0U;
+	for (int i=0; i<CACHE_SOURCES; i++) {
+		if (g.update[i])
+			return false;
+	}
+	return true;
+}
+
 std::string CCacheManager::findUserRptr(const std::string &user)
 {
 	std::string rptr;
 	if (user.empty())
 		return rptr;
-	auto it = UserRptr.find(user);
-	if (it != UserRptr.end())
-		rptr.assign(it->second);
+	auto it = Users.find(user);
+	if (it != Users.end()) {
+		rptr.assign(it->second.rptr);
+		it->second.used = ++uses;
+	}
 	return rptr;
 }
 
@@ -210,18 +437,27 @@ std::string CCacheManager::findRptrGate(const std::string &rptr)
 	if (it == RptrGate.end()) {
 		gate.assign(rptr);
 		gate[7] = 'G';
-	} else
-		gate.assign(it->second);
+	} else {
+		gate.assign(it->second.gate);
+		it->second.used = ++uses;
+	}
 	return gate;
 }
 
-std::string CCacheManager::findGateAddr(const std::string &gate)
+std::string CCacheManager::findGateAddr(const std::string &gate, int &source)
 {
 	std::string addr;
+	source = -1;
 	if (gate.empty())
 		return addr;
 	auto ita = GateAddr.find(gate);
-	if (ita != GateAddr.end())
-		addr.assign(ita->second);
+	if (ita != GateAddr.end()) {
+		for (int i=0; i<CACHE_SOURCES; i++) {
+			if (ita->second.update[i] && (source < 0 || ita->second.update[i] > ita->second.update[source]))
+				source = i;
+		}
+		if (source >= 0)
+			addr.assign(ita->second.addr[source]);
+	}
 	return addr;
 }
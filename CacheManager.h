@@ -18,44 +18,106 @@
 
 #pragma once
 
+#include <ctime>
+#include <cstdint>
 #include <string>
 #include <mutex>
 #include <unordered_map>
+#include <cstddef>
+
+// seconds a user the server couldn't find is remembered, an update for the user forgets it sooner
+#define NOT_FOUND_TTL 300
+// seconds to wait for the answer to a FIND before another one can be sent
+#define FIND_TIMEOUT 10
+// one cache is fed by all the irc connections, each one is a source
+#define CACHE_SOURCES 2
+
+// entry counts, and an estimate of the memory the maps use
+using SCACHESTATS = struct cache_stats_tag {
+	size_t users, rptrs, gates, names, notfound, pending;
+	size_t bytes, limit;	// what the users and repeaters use, they're the only maps that are capped
+	size_t total;			// what all the maps use
+	unsigned long evicted;	// users and repeaters dropped to stay under the limit
+};
 
 class CCacheManager {
 public:
-	CCacheManager() {}
+	CCacheManager() : updates(0), uses(0), bytes(0), limit(0), evicted(0) {}
 	~CCacheManager() {}
 
 	// the bodies of these public functions are mux locked to access the maps and the private functions.
 	// for these find functions, if a map value can't be found the returned string will be empty.
-	void findUserData(const std::string &user, std::string &rptr, std::string &gate, std::string &addr);
-	void findRptrData(const std::string &rptr, std::string &gate, std::string &addr);
+	// source is the connection that learned the address, -1 if there isn't an address.
+	void findUserData(const std::string &user, std::string &rptr, std::string &gate, std::string &addr, int &source);
+	void findRptrData(const std::string &rptr, std::string &gate, std::string &addr, int &source);
 	std::string findUserTime(const std::string &user);
 	std::string findUserAddr(const std::string &user);
-	std::string findNameNick(const std::string &name);
 	std::string findUserRepeater(const std::string &user);
 	std::string findGateAddress(const std::string &gate);
-	std::string findServerUser();
-	void eraseGate(const std::string &gate);
-	void eraseName(const std::string &name);
-	void clearGate();
+	// the nicks and the gateway addresses belong to the irc network they came from
+	std::string findNameNick(int source, const std::string &name);
+	std::string findServerUser(int source);
+	// true if the server recently answered that it doesn't know the user
+	bool isNotFound(const std::string &user);
+	// true if a FIND for the user is still waiting for an answer from this source, or the server recently
+	// answered that it doesn't know the user, otherwise the user is marked as waiting and the caller sends the FIND
+	bool findPending(int source, const std::string &user);
+	void eraseGate(int source, const std::string &gate);
+	void eraseName(int source, const std::string &name);
+	void clearGate(int source);
 
-	void updateUser(const std::string &user, const std::string &rptr, const std::string &gate, const std::string &addr, const std::string &time);
-	void updateRptr(const std::string &rptr, const std::string &gate, const std::string &addr);
-	void updateGate(const std::string &gate, const std::string &addr);
-	void updateName(const std::string &name, const std::string &nick);
+	// the user and repeater updates carry the ircDDB time, one older than what's cached is ignored,
+	// so whichever connection has the newest answer wins
+	void updateUser(const std::string &user, const std::string &rptr, const std::string &time);
+	void updateRptr(const std::string &rptr, const std::string &gate, const std::string &time);
+	void updateGate(int source, const std::string &gate, const std::string &addr);
+	void updateName(int source, const std::string &name, const std::string &nick);
+	void updateNotFound(const std::string &user);
+	// forget the FINDs that were sent, they won't be answered after a disconnect
+	void clearPending(int source);
+
+	// the users and repeaters grow with every callsign heard on the network, so they're capped
+	// at about this many bytes, the least recently updated or used go first, 0 means no cap
+	void setLimit(size_t bytes);
+	void getStats(SCACHESTATS &stats);
 
 private:
-	// these three functions aren't mux locked, that's why they're private
+	using SUSERDATA = struct user_data_tag {
+		std::string rptr;
+		std::string time;
+		uint64_t used;	// when it was last updated or routed to
+	};
+	using SRPTRDATA = struct rptr_data_tag {
+		std::string gate;
+		std::string time;
+		uint64_t used;
+	};
+	// each source has its own address for a gateway, the most recently updated one is used
+	using SGATEDATA = struct gate_data_tag {
+		std::string addr[CACHE_SOURCES];
+		uint64_t update[CACHE_SOURCES];	// 0 if the source doesn't have an address
+	};
+
+	// these functions aren't mux locked, that's why they're private
+	bool dropGate(int source, SGATEDATA &g);
 	std::string findUserRptr(const std::string &user);
 	std::string findRptrGate(const std::string &rptr);
-	std::string findGateAddr(const std::string &gate);
+	std::string findGateAddr(const std::string &gate, int &source);
+	void evict();
+	static size_t stringBytes(const std::string &s);
+	static size_t userBytes(const std::string &user, const SUSERDATA &u);
+	static size_t rptrBytes(const std::string &rptr, const SRPTRDATA &r);
 
-	std::unordered_map<std::string, std::string> UserTime;
-	std::unordered_map<std::string, std::string> UserRptr;
-	std::unordered_map<std::string, std::string> RptrGate;
-	std::unordered_map<std::string, std::string> GateAddr;
-	std::unordered_map<std::string, std::string> NameNick;
+	std::unordered_map<std::string, SUSERDATA> Users;
+	std::unordered_map<std::string, SRPTRDATA> RptrGate;
+	std::unordered_map<std::string, SGATEDATA> GateAddr;
+	std::unordered_map<std::string, std::string> NameNick[CACHE_SOURCES];
+	// when a user was not found, and when a FIND was sent
+	std::unordered_map<std::string, time_t> NotFound;
+	std::unordered_map<std::string, time_t> Pending[CACHE_SOURCES];
+	uint64_t updates;	// counts the gateway address updates, the higher one is the newer
+	uint64_t uses;		// the same for the user and repeater used stamps
+	size_t bytes, limit;
+	unsigned long evicted;
 	std::mutex mux;
 };
@@ -0,0 +1,237 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <map>
+
+#include "Capture.h"
+
+#define CAPTURE_BUFFER 65536	// stdio buffer, so a write is usually just a copy
+#define CAPTURE_FLUSH 1000000	// but it's flushed at least this often, in microseconds
+
+static std::atomic<bool> is_open(false);
+static std::mutex mtx;
+static FILE *fp = nullptr;
+static std::string filepath;
+static unsigned long maxsize = 0, filesize = 0;
+static int64_t last = 0, lastflush = 0;
+static std::map<std::string, uint8_t> peers;
+
+static int64_t Now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void Put(const SCAPTURE &rec, const void *data)
+{
+	fwrite(&rec, sizeof(SCAPTURE), 1, fp);
+	if (rec.length)
+		fwrite(data, rec.length, 1, fp);
+	filesize += sizeof(SCAPTURE) + rec.length;
+}
+
+// call with the mutex locked, returns true on error
+static bool Start()
+{
+	fp = fopen(filepath.c_str(), "we");
+	if (nullptr == fp) {
+		fprintf(stderr, "CCapture can't open %s: %s\n", filepath.c_str(), strerror(errno));
+		return true;
+	}
+	setvbuf(fp, nullptr, _IOFBF, CAPTURE_BUFFER);
+	SCAPTUREHEADER header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CAPTURE_MAGIC, 4);
+	header.version = CAPTURE_VERSION;
+	header.start = last = lastflush = Now();
+	fwrite(&header, sizeof(header), 1, fp);
+	filesize = sizeof(header);
+	peers.clear();
+	return false;
+}
+
+bool CCapture::Open(const std::string &path, unsigned long maxbytes)
+{
+	Close();
+	std::lock_guard<std::mutex> lock(mtx);
+	filepath.assign(path);
+	maxsize = maxbytes;
+	if (Start())
+		return true;
+	is_open = true;
+	return false;
+}
+
+void CCapture::Close()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	is_open = false;
+	if (fp) {
+		fclose(fp);
+		fp = nullptr;
+	}
+}
+
+bool CCapture::IsOpen()
+{
+	return is_open;
+}
+
+void CCapture::Write(ECapture type, const CSockAddress &from, const void *data, ssize_t length)
+{
+	if (! is_open || length <= 0 || length > 0xffff)
+		return;
+
+	SCAPTUREPEER p;
+	memset(&p, 0, sizeof(p));
+	p.family = from.GetFamily();
+	if (AF_INET == p.family) {
+		auto a = (const struct sockaddr_in *)from.GetCPointer();
+		p.port = a->sin_port;
+		memcpy(p.addr, &a->sin_addr, 4);
+	} else if (AF_INET6 == p.family) {
+		auto a = (const struct sockaddr_in6 *)from.GetCPointer();
+		p.port = a->sin6_port;
+		memcpy(p.addr, &a->sin6_addr, 16);
+	}
+	const int64_t now = Now();
+
+	std::lock_guard<std::mutex> lock(mtx);
+	if (nullptr == fp)
+		return;
+
+	SCAPTURE rec;
+	const int64_t delta = now - last;
+	if (delta < 0 || delta > 0xffffffffLL) {
+		// the clock stepped, or nothing was received for a long time
+		SCAPTURE t = { 0, ECapture::time, 0, sizeof(now) };
+		Put(t, &now);
+		rec.delta = 0;
+	} else
+		rec.delta = uint32_t(delta);
+	last = now;
+
+	const std::string key((const char *)&p, sizeof(p));
+	auto it = peers.find(key);
+	if (peers.end() == it) {
+		if (peers.size() >= CAPTURE_MAX_PEERS)
+			peers.clear();	// the reader just redefines the indices
+		it = peers.emplace(key, uint8_t(peers.size())).first;
+		SCAPTURE def = { rec.delta, ECapture::peer, it->second, sizeof(p) };
+		Put(def, &p);
+		rec.delta = 0;
+	}
+
+	rec.type = type;
+	rec.peer = it->second;
+	rec.length = uint16_t(length);
+	Put(rec, data);
+
+	if (maxsize && filesize > maxsize) {
+		fclose(fp);
+		const std::string old(filepath + ".1");
+		rename(filepath.c_str(), old.c_str());
+		if (Start())
+			is_open = false;
+	} else if (now - lastflush > CAPTURE_FLUSH) {
+		fflush(fp);
+		lastflush = now;
+	}
+}
+
+CCaptureReader::CCaptureReader() : fp(nullptr), time(0)
+{
+	memset(peers, 0, sizeof(peers));
+}
+
+CCaptureReader::~CCaptureReader()
+{
+	Close();
+}
+
+bool CCaptureReader::Open(const char *path)
+{
+	Close();
+	fp = fopen(path, "re");
+	if (nullptr == fp) {
+		fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+		return true;
+	}
+	SCAPTUREHEADER header;
+	if (1 != fread(&header, sizeof(header), 1, fp) || memcmp(header.magic, CAPTURE_MAGIC, 4) || CAPTURE_VERSION != header.version) {
+		fprintf(stderr, "%s is not a capture file\n", path);
+		Close();
+		return true;
+	}
+	time = header.start;
+	return false;
+}
+
+void CCaptureReader::Close()
+{
+	if (fp) {
+		fclose(fp);
+		fp = nullptr;
+	}
+}
+
+void CCaptureReader::Rewind()
+{
+	if (nullptr == fp)
+		return;
+	SCAPTUREHEADER header;
+	fseek(fp, 0, SEEK_SET);
+	if (1 == fread(&header, sizeof(header), 1, fp))
+		time = header.start;
+	memset(peers, 0, sizeof(peers));
+}
+
+bool CCaptureReader::Next(SCAPTUREDATA &rec)
+{
+	if (nullptr == fp)
+		return false;
+	SCAPTURE r;
+	while (1 == fread(&r, sizeof(r), 1, fp)) {
+		time += r.delta;
+		rec.data.resize(r.length);
+		if (r.length && 1 != fread(rec.data.data(), r.length, 1, fp))
+			break;	// truncated, the writer was probably still running
+		switch (r.type) {
+			case ECapture::time:
+				if (sizeof(time) == r.length)
+					memcpy(&time, rec.data.data(), sizeof(time));
+				break;
+			case ECapture::peer:
+				if (sizeof(SCAPTUREPEER)==r.length && r.peer<CAPTURE_MAX_PEERS)
+					memcpy(peers + r.peer, rec.data.data(), sizeof(SCAPTUREPEER));
+				break;
+			default:
+				rec.time = time;
+				rec.type = r.type;
+				rec.peer = peers[r.peer < CAPTURE_MAX_PEERS ? r.peer : 0];
+				return true;
+		}
+	}
+	return false;
+}
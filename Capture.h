@@ -0,0 +1,105 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SockAddress.h"
+
+// A capture file is a header followed by records, each one an SCAPTURE and then length
+// bytes of data. Every datagram the gateway and the link receive can be appended, so that
+// a session can be replayed later with qdvreplay. To keep it small, peer addresses are
+// written once and then referred to by index, and record times are deltas.
+
+#define CAPTURE_MAGIC "QDVC"
+#define CAPTURE_VERSION 1
+#define CAPTURE_MAX_PEERS 255
+
+enum class ECapture : uint8_t {
+	time,	// the data is an int64_t, microseconds since the epoch
+	peer,	// the data is an SCAPTUREPEER, for the peer index in the record
+	g2, xrf, ref, dcs	// the data is the datagram, as it was received on that port
+};
+
+using SCAPTUREHEADER = struct capture_header_tag {
+	char magic[4];
+	uint16_t version;
+	uint16_t reserved;
+	int64_t start;	// microseconds since the epoch
+};
+
+using SCAPTURE = struct capture_tag {
+	uint32_t delta;	// microseconds since the previous record
+	ECapture type;
+	uint8_t peer;
+	uint16_t length;
+};
+
+using SCAPTUREPEER = struct capture_peer_tag {
+	uint16_t family;
+	uint16_t port;	// in network byte order
+	uint8_t addr[16];
+};
+
+static_assert(sizeof(SCAPTUREHEADER) == 16, "the capture header layout has changed");
+static_assert(sizeof(SCAPTURE) == 8, "the capture record layout has changed");
+static_assert(sizeof(SCAPTUREPEER) == 20, "the capture peer layout has changed");
+
+// one process-wide capture file, shared by the gateway and the link
+class CCapture
+{
+public:
+	// when the file grows past maxbytes, it's renamed to path.1 and a new one is started
+	// returns true on error
+	static bool Open(const std::string &path, unsigned long maxbytes);
+	static void Close();
+	static bool IsOpen();
+	// does nothing unless the capture is open
+	static void Write(ECapture type, const CSockAddress &from, const void *data, ssize_t length);
+};
+
+using SCAPTUREDATA = struct capture_data_tag {
+	int64_t time;	// microseconds since the epoch
+	ECapture type;
+	SCAPTUREPEER peer;
+	std::vector<unsigned char> data;
+};
+
+class CCaptureReader
+{
+public:
+	CCaptureReader();
+	~CCaptureReader();
+	// returns true on error
+	bool Open(const char *path);
+	void Close();
+	// only returns datagram records, returns false at the end of the file
+	bool Next(SCAPTUREDATA &rec);
+	// back to the first record
+	void Rewind();
+
+private:
+	FILE *fp;
+	int64_t time;
+	SCAPTUREPEER peers[CAPTURE_MAX_PEERS];
+};
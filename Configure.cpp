@@ -21,6 +21,12 @@
 #include <iomanip>
 #include <fstream>
 #include <cstring>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <map>
+#include <memory>
 
 #include "Configure.h"
 
@@ -28,12 +34,97 @@
 #define CFG_DIR "/tmp/"
 #endif
 
-void CConfigure::SetDefaultValues()
+static std::atomic<const CFGDATA *> current(nullptr);
+static std::mutex publish_mtx, subscriber_mtx;
+static std::deque<std::unique_ptr<const CFGDATA>> snapshots;	// every one that was ever published
+static std::map<int, std::pair<unsigned, std::function<void(const CFGDATA &, const CFGDATA &)>>> subscribers;
+static int nextid = 0;
+
+const CFGDATA *CConfigure::Current()
+{
+	const CFGDATA *p = current.load(std::memory_order_acquire);
+	if (p)
+		return p;
+	static std::once_flag once;
+	std::call_once(once, []() { CConfigure().ReadData(); });
+	return current.load(std::memory_order_acquire);
+}
+
+void CConfigure::Publish(const CFGDATA &data)
+{
+	std::lock_guard<std::mutex> lock(publish_mtx);
+	CFGDATA *p = new CFGDATA(data);
+	const CFGDATA *old = current.load(std::memory_order_relaxed);
+	p->version = old ? old->version + 1U : 1U;
+	snapshots.emplace_back(p);
+	current.store(p, std::memory_order_release);
+	if (nullptr == old)
+		return;
+
+	const unsigned changed = Compare(*old, *p);
+	if (0U == changed)
+		return;
+	std::vector<std::function<void(const CFGDATA &, const CFGDATA &)>> callbacks;
+	{
+		std::lock_guard<std::mutex> slock(subscriber_mtx);
+		for (const auto &s : subscribers) {
+			if (s.second.first & changed)
+				callbacks.push_back(s.second.second);
+		}
+	}
+	for (const auto &cb : callbacks)
+		cb(*old, *p);
+}
+
+int CConfigure::Subscribe(unsigned groups, std::function<void(const CFGDATA &, const CFGDATA &)> callback)
+{
+	std::lock_guard<std::mutex> lock(subscriber_mtx);
+	subscribers[nextid] = std::make_pair(groups, callback);
+	return nextid++;
+}
+
+void CConfigure::Unsubscribe(int id)
+{
+	std::lock_guard<std::mutex> lock(subscriber_mtx);
+	subscribers.erase(id);
+}
+
+unsigned CConfigure::Compare(const CFGDATA &a, const CFGDATA &b)
+{
+	unsigned changed = 0U;
+	if (a.sStation.compare(b.sStation) || a.cModule != b.cModule || a.sModules.compare(b.sModules))
+		changed |= CFG_STATION;
+	if (a.eNetType != b.eNetType)
+		changed |= CFG_NETWORK;
+	if (a.sCallsign.compare(b.sCallsign) || a.sName.compare(b.sName) || a.bUseMyCall != b.bUseMyCall || a.sMessage.compare(b.sMessage))
+		changed |= CFG_USER;
+	if (a.sLocation[0].compare(b.sLocation[0]) || a.sLocation[1].compare(b.sLocation[1]) || a.dLatitude != b.dLatitude || a.dLongitude != b.dLongitude || a.sURL.compare(b.sURL))
+		changed |= CFG_LOCATION;
+	if (a.bLinkEnable != b.bLinkEnable || a.sLinkAtStart.compare(b.sLinkAtStart) || a.bDPlusEnable != b.bDPlusEnable || a.bAcceptLinks != b.bAcceptLinks)
+		changed |= CFG_LINK;
+	if (a.bRouteEnable != b.bRouteEnable || a.iCacheKB != b.iCacheKB)
+		changed |= CFG_ROUTE;
+	if (a.iBaudRate != b.iBaudRate || a.sAudioIn.compare(b.sAudioIn) || a.sAudioOut.compare(b.sAudioOut))
+		changed |= CFG_AUDIO;
+	if (a.bAPRSEnable != b.bAPRSEnable || a.sAPRSServer.compare(b.sAPRSServer) || a.usAPRSPort != b.usAPRSPort || a.iAPRSInterval != b.iAPRSInterval)
+		changed |= CFG_APRS;
+	if (a.bGPSDEnable != b.bGPSDEnable || a.sGPSDServer.compare(b.sGPSDServer) || a.usGPSDPort != b.usGPSDPort)
+		changed |= CFG_GPSD;
+	if (a.bStatusEnable != b.bStatusEnable || a.usStatusPort != b.usStatusPort)
+		changed |= CFG_STATUS;
+	if (a.bCaptureEnable != b.bCaptureEnable || a.iCaptureMB != b.iCaptureMB)
+		changed |= CFG_CAPTURE;
+	return changed;
+}
+
+void CConfigure::SetDefaultValues(CFGDATA &data)
 {
 	// mode and module
 	data.bLinkEnable = data.bRouteEnable = true;
 	data.eNetType = EQuadNetType::ipv4only;
 	data.cModule = 'A';
+	data.sModules.clear();
+	data.iCacheKB = 4096;
 	// station
 	data.bUseMyCall = false;
 	data.sCallsign.clear();
@@ -47,6 +138,7 @@ void CConfigure::SetDefaultValues()
 	// linking
 	data.bDPlusEnable  = false;
 	data.sLinkAtStart.clear();
+	data.bAcceptLinks = false;
 	// audio
 	data.iBaudRate = 460800;
 	data.sAudioIn.assign("default");
@@ -60,6 +152,12 @@ void CConfigure::SetDefaultValues()
 	data.bGPSDEnable = false;
 	data.sGPSDServer.assign("localhost");
 	data.usGPSDPort = 2947U;
+	// status server
+	data.bStatusEnable = false;
+	data.usStatusPort = 8080U;
+	// packet capture
+	data.bCaptureEnable = false;
+	data.iCaptureMB = 64;
 }
 
 void CConfigure::ReadData()
@@ -67,9 +165,12 @@ void CConfigure::ReadData()
 	std::string path(CFG_DIR);
 	path.append("qdv.cfg");
 
+	// anything missing from the file keeps its default
+	CFGDATA data;
+	SetDefaultValues(data);
 	std::ifstream cfg(path.c_str(), std::ifstream::in);
 	if (! cfg.is_open()) {
-		SetDefaultValues();
+		Publish(data);
 		return;
 	}
 
@@ -90,6 +191,8 @@ void CConfigure::ReadData()
 
 		if (0 == strcmp(key, "RouteEnable"))
 			data.bRouteEnable = IS_TRUE(*val);
+		else if (0 == strcmp(key, "CacheKB"))
+			data.iCacheKB = std::stoi(val);
 		else if (0 == strcmp(key, "LinkEnable"))
 			data.bLinkEnable = IS_TRUE(*val);
 		else if (0 == strcmp(key, "MyCall")) {
@@ -125,8 +228,12 @@ void CConfigure::ReadData()
 			data.sURL.assign(val);
 		} else if (0 == strcmp(key, "LinkAtStart")) {
 			data.sLinkAtStart.assign(val);
+		} else if (0 == strcmp(key, "AcceptLinks")) {
+			data.bAcceptLinks = IS_TRUE(*val);
 		} else if (0 == strcmp(key, "Module")) {
 			data.cModule = *val;
+		} else if (0 == strcmp(key, "Modules")) {
+			data.sModules.assign(val);
 		} else if (0 == strcmp(key, "AudioInput")) {
 			data.sAudioIn.assign(val);
 		} else if (0 == strcmp(key, "AudioOutput")) {
@@ -145,13 +252,23 @@ void CConfigure::ReadData()
 			data.sGPSDServer.assign(val);
 		} else if (0 == strcmp(key, "GPSDPort")) {
 			data.usGPSDPort = std::stoul(val);
+		} else if (0 == strcmp(key, "StatusEnable")) {
+			data.bStatusEnable = IS_TRUE(*val);
+		} else if (0 == strcmp(key, "StatusPort")) {
+			data.usStatusPort = std::stoul(val);
+		} else if (0 == strcmp(key, "CaptureEnable")) {
+			data.bCaptureEnable = IS_TRUE(*val);
+		} else if (0 == strcmp(key, "CaptureMB")) {
+			data.iCaptureMB = std::stoi(val);
 		}
 	}
 	cfg.close();
+	Publish(data);
 }
 
 void CConfigure::WriteData()
 {
+	const CFGDATA &data = *Current();
 
 	std::string path(CFG_DIR);
 	path.append("qdv.cfg");
@@ -165,6 +282,7 @@ void CConfigure::WriteData()
 	file << "#Generated Automatically, DO NOT MANUALLY EDIT!" << std::endl;
 	// mode and module
 	file << "RouteEnable=" << (data.bRouteEnable ? "true" : "false") << std::endl;
+	file << "CacheKB=" << data.iCacheKB << std::endl;
 	file << "LinkEnable=" << (data.bLinkEnable ? "true" : "false") << std::endl;
 	file << "QuadNetType=";
 	if (data.eNetType == EQuadNetType::ipv6only)
@@ -175,6 +293,7 @@ void CConfigure::WriteData()
 		file << "IPv4";
 	file << std::endl;
 	file << "Module=" << data.cModule << std::endl;
+	file << "Modules=" << data.sModules << std::endl;
 	// station
 	file << "UseMyCall=" << (data.bUseMyCall ? "true" : "false") << std::endl;
 	file << "MyCall=" << data.sCallsign << std::endl;
@@ -188,6 +307,7 @@ void CConfigure::WriteData()
 	// linking
 	file << "DPlusEnable=" << (data.bDPlusEnable ? "true" : "false") << std::endl;
 	file << "LinkAtStart='" << data.sLinkAtStart << "'" << std::endl;
+	file << "AcceptLinks=" << (data.bAcceptLinks ? "true" : "false") << std::endl;
 	// audio
 	file << "BaudRate=" << data.iBaudRate << std::endl;
 	file << "AudioInput='" << data.sAudioIn << "'" << std::endl;
@@ -201,84 +321,29 @@ void CConfigure::WriteData()
 	file << "GPSDEnable=" << (data.bGPSDEnable ? "true" : "false") << std::endl;
 	file << "GPSDServer=" << data.sGPSDServer << std::endl;
 	file << "GPSDPort=" << data.usGPSDPort << std::endl;
+	// status server
+	file << "StatusEnable=" << (data.bStatusEnable ? "true" : "false") << std::endl;
+	file << "StatusPort=" << data.usStatusPort << std::endl;
+	// packet capture
+	file << "CaptureEnable=" << (data.bCaptureEnable ? "true" : "false") << std::endl;
+	file << "CaptureMB=" << data.iCaptureMB << std::endl;
 
 	file.close();
 }
 
 void CConfigure::CopyFrom(const CFGDATA &from)
 {
-	// mode and module
-	data.bRouteEnable = from.bRouteEnable;
-	data.bLinkEnable = from.bLinkEnable;
-	data.eNetType = from.eNetType;
-	data.cModule = from.cModule;
-	// station
-	data.bUseMyCall = from.bUseMyCall;
-	data.sCallsign.assign(from.sCallsign);
-	data.sLocation[0].assign(from.sLocation[0]);
-	data.sLocation[1].assign(from.sLocation[1]);
-	data.sMessage.assign(from.sMessage);
-	data.sName.assign(from.sName);
-	data.sStation.assign(from.sStation);
-	data.sURL.assign(from.sURL);
-	data.dLatitude = from.dLatitude;
-	data.dLongitude = from.dLongitude;
-	// linking
-	data.bDPlusEnable = from.bDPlusEnable;
-	data.sLinkAtStart.assign(from.sLinkAtStart);
-	// audio
-	data.iBaudRate = from.iBaudRate;
-	data.sAudioIn.assign(from.sAudioIn);
-	data.sAudioOut.assign(from.sAudioOut);
-	// aprs
-	data.bAPRSEnable = from.bAPRSEnable;
-	data.sAPRSServer.assign(from.sAPRSServer);
-	data.usAPRSPort = from.usAPRSPort;
-	data.iAPRSInterval = from.iAPRSInterval;
-	// gps
-	data.bGPSDEnable = from.bGPSDEnable;
-	data.sGPSDServer.assign(from.sGPSDServer);
-	data.usGPSDPort = from.usGPSDPort;
+	Publish(from);
 }
 
 void CConfigure::CopyTo(CFGDATA &to)
 {
-	// mode and module
-	to.bRouteEnable = data.bRouteEnable;
-	to.bLinkEnable = data.bLinkEnable;
-	to.eNetType = data.eNetType;
-	to.cModule = data.cModule;
-	// station
-	to.bUseMyCall = data.bUseMyCall;
-	to.sCallsign.assign(data.sCallsign);
-	to.sLocation[0].assign(data.sLocation[0]);
-	to.sLocation[1].assign(data.sLocation[1]);
-	to.sMessage.assign(data.sMessage);
-	to.sName.assign(data.sName);
-	to.sStation.assign(data.sStation);
-	to.sURL.assign(data.sURL);
-	to.dLatitude = data.dLatitude;
-	to.dLongitude = data.dLongitude;
-	// linking
-	to.bDPlusEnable = data.bDPlusEnable;
-	to.sLinkAtStart.assign(data.sLinkAtStart);
-	// audio
-	to.iBaudRate = data.iBaudRate;
-	to.sAudioIn.assign(data.sAudioIn);
-	to.sAudioOut.assign(data.sAudioOut);
-	// aprs
-	to.bAPRSEnable = data.bAPRSEnable;
-	to.sAPRSServer.assign(data.sAPRSServer);
-	to.usAPRSPort = data.usAPRSPort;
-	to.iAPRSInterval = data.iAPRSInterval;
-	// gps
-	to.bGPSDEnable = data.bGPSDEnable;
-	to.sGPSDServer.assign(data.sGPSDServer);
-	to.usGPSDPort = data.usGPSDPort;
+	to = *Current();
 }
 
 bool CConfigure::IsOkay()
 {
+	const CFGDATA &data = *Current();
 	bool station = (data.sStation.size() > 0);
 	bool module = isalpha(data.cModule);
 	bool call = (data.sCallsign.size() > 0);
@@ -288,5 +353,5 @@ bool CConfigure::IsOkay()
 
 const CFGDATA *CConfigure::GetData()
 {
-	return &data;
+	return Current();
 }
@@ -19,36 +19,64 @@
 #pragma once
 
 #include <string>
+#include <functional>
 
 #define IS_TRUE(a) (a=='t' || a=='T' || a=='1')
 
+// the parts of the configuration, so that subscribers only hear about the changes they use
+#define CFG_STATION  0x001U	// station callsign and module, the gateway and link have to be restarted
+#define CFG_NETWORK  0x002U	// the QuadNet type, the gateway has to be restarted
+#define CFG_USER     0x004U	// callsign, name and message, used for each transmission
+#define CFG_LOCATION 0x008U	// location, latitude, longitude and URL
+#define CFG_LINK     0x010U	// linking, link at start and DPlus
+#define CFG_ROUTE    0x020U
+#define CFG_AUDIO    0x040U
+#define CFG_APRS     0x080U
+#define CFG_GPSD     0x100U
+#define CFG_STATUS   0x200U
+#define CFG_CAPTURE  0x400U
+
 enum class EQuadNetType { ipv4only, ipv6only, dualstack };
 
 using CFGDATA = struct CFGData_struct {
-	std::string sCallsign, sName, sStation, sMessage, sLocation[2], sURL, sLinkAtStart, sAudioIn, sAudioOut, sAPRSServer, sGPSDServer;
-	bool bUseMyCall, bDPlusEnable, bGPSDEnable, bAPRSEnable, bLinkEnable, bRouteEnable;
-	int iBaudRate, iAPRSInterval;
-	unsigned short usAPRSPort, usGPSDPort;
+	std::string sCallsign, sName, sStation, sMessage, sLocation[2], sURL, sLinkAtStart, sAudioIn, sAudioOut, sAPRSServer, sGPSDServer, sModules;
+	bool bUseMyCall, bDPlusEnable, bGPSDEnable, bAPRSEnable, bLinkEnable, bRouteEnable, bStatusEnable, bCaptureEnable, bAcceptLinks;
+	int iBaudRate, iAPRSInterval, iCaptureMB, iCacheKB;
+	unsigned short usAPRSPort, usGPSDPort, usStatusPort;
 	EQuadNetType eNetType;
 	double dLatitude, dLongitude;
 	char cModule;
+	unsigned version;	// one more for each snapshot that's published
 };
 
+// The configuration is published as a series of immutable snapshots. Readers get the current
+// one with a single atomic load and never wait. Snapshots are never freed, so a pointer to one
+// stays good for as long as the process runs. There is one for each time the settings are
+// changed, which isn't often.
 class CConfigure {
 public:
-	CConfigure() { ReadData(); }
+	CConfigure() {}	// qdv.cfg is read the first time the configuration is needed
 	~CConfigure() {}
 
+	// read qdv.cfg and publish it
 	void ReadData();
+	// write the current snapshot to qdv.cfg
 	void WriteData();
+	// publish a new snapshot
 	void CopyFrom(const CFGDATA &);
 	void CopyTo(CFGDATA &);
 	bool IsOkay();
 	const CFGDATA *GetData();
 
+	static const CFGDATA *Current();
+	static void Publish(const CFGDATA &data);
+	// callback(old, now) is called on the publishing thread when anything in groups changes, so
+	// it should be quick, and it can't publish
+	static int Subscribe(unsigned groups, std::function<void(const CFGDATA &, const CFGDATA &)> callback);
+	static void Unsubscribe(int id);
+	// which groups are different
+	static unsigned Compare(const CFGDATA &a, const CFGDATA &b);
+
 private:
-	// data
-	CFGDATA data;
-	// methods
-	void SetDefaultValues();
+	static void SetDefaultValues(CFGDATA &data);
 };
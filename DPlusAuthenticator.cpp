@@ -24,39 +24,139 @@
 #include <cstring>
 #include <thread>
 #include <chrono>
+#include <vector>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <netdb.h>
+#include <cerrno>
 
 #include "DPlusAuthenticator.h"
 #include "Utilities.h"
 
-CDPlusAuthenticator::CDPlusAuthenticator(const std::string &loginCallsign, const std::string &address) :
-m_loginCallsign(loginCallsign),
-m_address(address)
+// seconds between failed downloads, the network may not be up yet
+#define DPLUS_RETRY_MIN 5
+#define DPLUS_RETRY_MAX 300
+// a server that stops sending doesn't hold up Stop() for long
+#define DPLUS_READ_TIMEOUT 30
+
+CDPlusAuthenticator::CDPlusAuthenticator() : m_reflectors(true), m_repeaters(false), keep_running(false), ready(false)
+{
+}
+
+CDPlusAuthenticator::~CDPlusAuthenticator()
+{
+	Stop();
+}
+
+void CDPlusAuthenticator::Start(const std::string &loginCallsign, const std::string &address, const bool reflectors, const bool repeaters)
 {
 	assert(loginCallsign.size());
 
+	Stop();
+	m_loginCallsign.assign(loginCallsign);
 	trim(m_loginCallsign);
+	m_address.assign(address);
+	m_reflectors = reflectors;
+	m_repeaters = repeaters;
+	records.clear();
+	ready = false;
+	keep_running = true;
+	worker = std::async(std::launch::async, &CDPlusAuthenticator::Worker, this);
 }
 
-CDPlusAuthenticator::~CDPlusAuthenticator()
+void CDPlusAuthenticator::Stop()
 {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (! keep_running)
+			return;
+		keep_running = false;
+	}
+	cv.notify_one();
+	worker.get();
+	records.clear();
+	ready = false;
 }
 
-int CDPlusAuthenticator::Process(CQnetDB &db, const bool reflectors, const bool repeaters)
-// return true if everything went okay
+void CDPlusAuthenticator::Worker()
 {
-	int result = client.Open(m_address, AF_UNSPEC, "20001");
-	if (result) {
-		fprintf(stderr, "DPlus Authorization failed: %s\n", gai_strerror(result));
+	unsigned delay = DPLUS_RETRY_MIN;
+	std::unique_lock<std::mutex> lock(mtx);
+	while (keep_running) {
+		lock.unlock();
+		std::vector<unsigned char> list;
+		bool failed = authenticate(list);
+		lock.lock();
+		if (! failed) {
+			records.swap(list);
+			ready = true;
+			return;
+		}
+		fprintf(stderr, "DPlus Authorization failed, trying again in %u seconds\n", delay);
+		cv.wait_for(lock, std::chrono::seconds(delay), [this]() { return ! keep_running; });
+		if (delay < DPLUS_RETRY_MAX)
+			delay = (2 * delay > DPLUS_RETRY_MAX) ? DPLUS_RETRY_MAX : 2 * delay;
+	}
+}
+
+int CDPlusAuthenticator::Store(CQnetDB &db)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	if (! ready)
+		return -1;
+	ready = false;
+
+	if (db.BeginGW()) {
+		records.clear();
 		return 0;
 	}
-	return authenticate(db, reflectors, repeaters);
+
+	int rval = 0;
+	// each 26 byte record is decoded in place, only the inserts are inside the transaction
+	for (size_t i = 0U; i + 26U <= records.size(); i += 26U) {
+		const char *address = (const char *)(records.data() + i);
+		const char *name = (const char *)(records.data() + i + 16U);
+		size_t alen = strnlen(address, 16U);
+		size_t nlen = strnlen(name, 8U);
+		while (alen && isspace(address[alen-1]))
+			alen--;
+		while (alen && isspace(*address)) {
+			address++;
+			alen--;
+		}
+		while (nlen && isspace(name[nlen-1]))
+			nlen--;
+		while (nlen && isspace(*name)) {
+			name++;
+			nlen--;
+		}
+
+		// An empty name or IP address is not added
+		if (0U==alen || 0U==nlen)
+			continue;
+
+		bool isref = (nlen >= 3U && 0 == memcmp(name, "REF", 3));
+		if ((m_reflectors && isref) || (m_repeaters && ! isref)) {
+			if (! db.AddGW(EGWSource::dplus, name, nlen, address, alen, 20001))
+				rval++;
+		}
+	}
+
+	db.EndGW();
+	records.clear();
+	records.shrink_to_fit();
+
+	return rval;
 }
 
-int CDPlusAuthenticator::authenticate(CQnetDB &db, const bool reflectors, const bool repeaters)
+bool CDPlusAuthenticator::authenticate(std::vector<unsigned char> &list)
+// returns true on failure, list has every active record when it succeeds
 {
+	if (client.Open(m_address, AF_UNSPEC, "20001"))
+		return true;
+
+	struct timeval tv = { DPLUS_READ_TIMEOUT, 0 };
+	setsockopt(client.GetFD(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
 	unsigned char buffer[4096U];
 	::memset(buffer, ' ', 56U);
 
@@ -73,57 +173,52 @@ int CDPlusAuthenticator::authenticate(CQnetDB &db, const bool reflectors, const
 	if (client.Write(buffer, 56U)) {
 		fprintf(stderr, "ERROR: could not write opening phrase\n");
 		client.Close();
-		return 0;
+		return true;
 	}
 
-	int ret = client.ReadExact(buffer, 2U);
-	unsigned int rval = 0;
-	CHostQueue hqueue;
+	// the whole list is read before anything is stored, so qn.db isn't locked while we wait on the network
+	bool failed = false;
 
-	while (ret == 2) {
+	while (true) {
+		errno = 0;
+		if (2 != client.ReadExact(buffer, 2U)) {
+			// the server closes the connection after the last packet, anything else is an error or a timeout
+			failed = (0 != errno);
+			break;
+		}
 		unsigned int len = (buffer[1U] & 0x0FU) * 256U + buffer[0U];
+		if (len < 3U) {
+			fprintf(stderr, "Invalid packet length %u received from 20001\n", len);
+			failed = true;
+			break;
+		}
 		// Ensure that we get exactly len - 2U bytes from the TCP stream
-		ret = client.ReadExact(buffer + 2U, len - 2U);
-		if (0 > ret) {
+		if (0 > client.ReadExact(buffer + 2U, len - 2U)) {
 			fprintf(stderr, "Problem reading line, it returned %d\n", errno);
-			return rval;
+			failed = true;
+			break;
 		}
 
 		if ((buffer[1U] & 0xC0U) != 0xC0U || buffer[2U] != 0x01U) {
 			fprintf(stderr, "Invalid packet received from 20001\n");
-			return rval;
+			failed = true;
+			break;
 		}
 
+		// An inactive gateway/reflector is not kept
 		for (unsigned int i = 8U; (i + 25U) < len; i += 26U) {
-			std::string address((char *)(buffer + i));
-			std::string name((char *)(buffer + i + 16U));
-
-			trim(address);
-			trim(name);
-			name.resize(6, ' ');
-
-			// Get the active flag
-			bool active = (buffer[i + 25U] & 0x80U) == 0x80U;
-
-			// An empty name or IP address or an inactive gateway/reflector is not added
-			if (address.size()>0U && name.size()>0U && active) {
-				if (reflectors && 0==name.compare(0, 3, "REF")) {
-					rval++;
-					hqueue.Push(CHost(name.c_str(), address.c_str(), 20001));
-				} else if (repeaters && name.compare(0, 3, "REF")) {
-					rval++;
-					hqueue.Push(CHost(name.c_str(), address.c_str(), 20001));
-				}
-			}
+			if (buffer[i + 25U] & 0x80U)
+				list.insert(list.end(), buffer + i, buffer + i + 26U);
 		}
-		if (! hqueue.Empty())
-			db.UpdateGW(hqueue);
-
-		ret = client.ReadExact(buffer, 2U);
 	}
+	client.Close();
 
+	if (failed || list.empty()) {
+		fprintf(stderr, "The DPlus gateway list from %s is incomplete, none of it was loaded\n", m_address.c_str());
+		list.clear();
+		return true;
+	}
 	printf("Probably authorized DPlus on %s using callsign %s\n", m_address.c_str(), m_loginCallsign.c_str());
-	client.Close();
 
-	return rval;
+	return false;
 }
@@ -18,24 +18,40 @@
  *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 **/
 
-#include <netinet/in.h>
-#include <map>
 #include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <future>
 
 #include "TCPReaderWriterClient.h"
 #include "QnetDB.h"
 
+#define DPLUS_AUTH_SERVER "auth.dstargateway.org"
+
+// the gateway list is downloaded on a worker thread, the database is only written by the thread that owns it
 class CDPlusAuthenticator {
 public:
-	CDPlusAuthenticator(const std::string &loginCallsign, const std::string &address);
+	CDPlusAuthenticator();
 	~CDPlusAuthenticator();
 
-	int Process(CQnetDB &qn, const bool reflectors, const bool repeaters);
+	// a failed download is tried again, with a growing delay, until one works or Stop() is called
+	void Start(const std::string &loginCallsign, const std::string &address, const bool reflectors, const bool repeaters);
+	void Stop();
+	// never blocks, returns -1 until a list has arrived, then the number of gateways added from it, once
+	int Store(CQnetDB &db);
 
 private:
 	std::string m_loginCallsign;
 	std::string m_address;
+	bool m_reflectors, m_repeaters;
 	CTCPReaderWriterClient client;
+	std::vector<unsigned char> records;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::future<void> worker;
+	bool keep_running, ready;
 
-	int authenticate(CQnetDB &db, const bool reflectors, const bool repeaters);
+	void Worker();
+	bool authenticate(std::vector<unsigned char> &list);
 };
@@ -0,0 +1,83 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include "FanOut.h"
+
+CFanOut::CFanOut() : count(0)
+{
+	memset(msgs, 0, sizeof(msgs));
+	for (unsigned i=0; i<FANOUT_BATCH; i++) {
+		iovs[i].iov_base = data[i];
+		msgs[i].msg_hdr.msg_name = addrs + i;
+		msgs[i].msg_hdr.msg_iov = iovs + i;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+void CFanOut::Add(int sock, const void *buf, size_t size, const CSockAddress &to)
+{
+	if (size > FANOUT_SIZE)
+		return;
+	memcpy(Reserve(), buf, size);
+	Commit(sock, size, to);
+}
+
+unsigned char *CFanOut::Reserve()
+{
+	if (FANOUT_BATCH == count)
+		Flush();
+	return data[count];
+}
+
+void CFanOut::Commit(int sock, size_t size, const CSockAddress &to)
+{
+	if (sock<0 || 0==size || size>FANOUT_SIZE)
+		return;
+	iovs[count].iov_len = size;
+	memcpy(addrs + count, to.GetCPointer(), to.GetSize());
+	msgs[count].msg_hdr.msg_namelen = to.GetSize();
+	socks[count] = sock;
+	count++;
+}
+
+void CFanOut::Flush()
+{
+	unsigned start = 0;
+	while (start < count) {
+		unsigned end = start + 1;
+		while (end<count && socks[end]==socks[start])
+			end++;
+		// the sockets are non-blocking, so anything that doesn't fit is dropped, like a lost datagram
+		unsigned sent = start;
+		while (sent < end) {
+			int rval = sendmmsg(socks[start], msgs + sent, end - sent, 0);
+			if (rval <= 0) {
+				if (rval<0 && EINTR==errno)
+					continue;
+				sent++;	// skip the one that failed
+			} else
+				sent += rval;
+		}
+		start = end;
+	}
+	count = 0;
+}
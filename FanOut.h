@@ -0,0 +1,52 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "SockAddress.h"
+
+#define FANOUT_BATCH 32
+// big enough for anything the link sends
+#define FANOUT_SIZE 520
+
+// Datagrams for the peers are queued here and sent with one sendmmsg() for each run on the
+// same socket, instead of one sendto() each.
+class CFanOut
+{
+public:
+	CFanOut();
+	// the datagram and the address are copied, so both can be reused right away
+	void Add(int sock, const void *buf, size_t size, const CSockAddress &to);
+	// FANOUT_SIZE bytes to build the next datagram in, it's queued by Commit()
+	unsigned char *Reserve();
+	// queues the datagram built in the last Reserve(), a size of 0 drops it
+	void Commit(int sock, size_t size, const CSockAddress &to);
+	// send everything that's queued
+	void Flush();
+	unsigned Pending() const { return count; }
+
+private:
+	struct mmsghdr msgs[FANOUT_BATCH];
+	struct iovec iovs[FANOUT_BATCH];
+	struct sockaddr_storage addrs[FANOUT_BATCH];
+	int socks[FANOUT_BATCH];
+	unsigned char data[FANOUT_BATCH][FANOUT_SIZE];
+	unsigned count;
+};
@@ -0,0 +1,274 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "FrameRing.h"
+#include "PipelineStats.h"
+
+static CDSVT pool[FRAME_POOL_SIZE];
+static std::atomic<unsigned short> refs[FRAME_POOL_SIZE];
+static unsigned short lengths[FRAME_POOL_SIZE];
+static uint64_t times[FRAME_POOL_SIZE];
+static std::atomic<unsigned> next_slot(0);
+
+static inline unsigned SlotIndex(const void *frame)
+{
+	return unsigned((const CDSVT *)frame - pool);
+}
+
+CDSVT *CFramePool::Alloc()
+{
+	const unsigned start = next_slot++;
+	for (unsigned i=0; i<FRAME_POOL_SIZE; i++) {
+		const unsigned n = (start + i) % FRAME_POOL_SIZE;
+		unsigned short expected = 0;
+		if (refs[n].compare_exchange_strong(expected, 1)) {
+			lengths[n] = 0;
+			times[n] = 0;
+			return pool + n;
+		}
+	}
+	return nullptr;
+}
+
+void CFramePool::AddRef(CDSVT *frame)
+{
+	refs[SlotIndex(frame)]++;
+}
+
+void CFramePool::Release(CDSVT *frame)
+{
+	if (Owns(frame))
+		refs[SlotIndex(frame)]--;
+}
+
+bool CFramePool::Owns(const void *frame)
+{
+	const unsigned char *p = (const unsigned char *)frame;
+	const unsigned char *base = (const unsigned char *)pool;
+	return (p >= base && p < base + sizeof(pool) && 0 == (p - base) % sizeof(CDSVT));
+}
+
+bool CFramePool::IsUnique(const CDSVT *frame)
+{
+	return (! Owns(frame)) || 1U == refs[SlotIndex(frame)];
+}
+
+unsigned short CFramePool::GetLength(const CDSVT *frame)
+{
+	return lengths[SlotIndex(frame)];
+}
+
+void CFramePool::SetLength(CDSVT *frame, unsigned short length)
+{
+	lengths[SlotIndex(frame)] = length;
+}
+
+uint64_t CFramePool::GetTime(const CDSVT *frame)
+{
+	return Owns(frame) ? times[SlotIndex(frame)] : 0;
+}
+
+void CFramePool::SetTime(CDSVT *frame, uint64_t when)
+{
+	if (Owns(frame))
+		times[SlotIndex(frame)] = when;
+}
+
+unsigned CFramePool::InUse()
+{
+	unsigned count = 0;
+	for (unsigned i=0; i<FRAME_POOL_SIZE; i++) {
+		if (refs[i])
+			count++;
+	}
+	return count;
+}
+
+CFrameRef::CFrameRef()
+{
+	frame = CFramePool::Alloc();
+	if (nullptr == frame) {
+		frame = &backup;
+		CPipelineStats::Count(ECounter::pool_exhausted);
+	}
+}
+
+CFrameRef::~CFrameRef()
+{
+	CFramePool::Release(frame);
+}
+
+// a named queue of slot indices with an eventfd to wake up the reader
+class CFrameChannel
+{
+public:
+	CFrameChannel() : efd(-1), head(0), count(0) {}
+
+	bool Push(CDSVT *frame)
+	// returns true if the frame could not be queued
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (efd < 0 || count >= FRAME_POOL_SIZE)
+			return true;
+		queue[(head + count) % FRAME_POOL_SIZE] = (unsigned short)SlotIndex(frame);
+		// the reader drains everything when it wakes, so only the first frame needs to wake it
+		if (0 == count++)
+			eventfd_write(efd, 1);
+		return false;
+	}
+
+	CDSVT *Pop()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (0 == count)
+			return nullptr;
+		CDSVT *frame = pool + queue[head];
+		head = (head + 1) % FRAME_POOL_SIZE;
+		count--;
+		return frame;
+	}
+
+	static CFrameChannel *Find(const char *name)
+	{
+		static std::mutex mapmtx;
+		static std::map<std::string, std::unique_ptr<CFrameChannel>> channels;
+		std::lock_guard<std::mutex> lock(mapmtx);
+		auto &c = channels[name];
+		if (! c)
+			c.reset(new CFrameChannel);
+		return c.get();
+	}
+
+	std::mutex mtx;
+	int efd;
+private:
+	unsigned short queue[FRAME_POOL_SIZE];
+	unsigned head, count;
+};
+
+CFrameReader::CFrameReader() : channel(nullptr) {}
+
+CFrameReader::~CFrameReader()
+{
+	Close();
+}
+
+bool CFrameReader::Open(const char *name)
+{
+	channel = CFrameChannel::Find(name);
+	std::lock_guard<std::mutex> lock(channel->mtx);
+	if (channel->efd >= 0) {
+		fprintf(stderr, "CFrameReader::Open: %s is already open\n", name);
+		channel = nullptr;
+		return true;
+	}
+	channel->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (channel->efd < 0) {
+		fprintf(stderr, "CFrameReader::Open eventfd error: %s\n", strerror(errno));
+		channel = nullptr;
+		return true;
+	}
+	return false;
+}
+
+void CFrameReader::Close()
+{
+	if (nullptr == channel)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(channel->mtx);
+		if (channel->efd >= 0)
+			close(channel->efd);
+		channel->efd = -1;
+	}
+	// anything left in the queue is dropped
+	CDSVT *frame;
+	while (nullptr != (frame = channel->Pop()))
+		CFramePool::Release(frame);
+	channel = nullptr;
+}
+
+int CFrameReader::GetFD()
+{
+	return channel ? channel->efd : -1;
+}
+
+void CFrameReader::Clear()
+{
+	eventfd_t value;
+	if (channel)
+		eventfd_read(channel->efd, &value);
+}
+
+CDSVT *CFrameReader::Read(ssize_t &length)
+{
+	CDSVT *frame = channel ? channel->Pop() : nullptr;
+	length = frame ? CFramePool::GetLength(frame) : 0;
+	return frame;
+}
+
+CFrameWriter::CFrameWriter() : channel(nullptr) {}
+
+void CFrameWriter::SetUp(const char *name)
+{
+	channel = CFrameChannel::Find(name);
+}
+
+ssize_t CFrameWriter::Write(const void *buf, size_t size)
+{
+	if (nullptr == channel || size > sizeof(CDSVT))
+		return -1;
+
+	CDSVT *frame;
+	if (CFramePool::Owns(buf)) {
+		frame = (CDSVT *)buf;
+		CFramePool::AddRef(frame);
+	} else {
+		frame = CFramePool::Alloc();
+		if (nullptr == frame) {
+			CPipelineStats::Count(ECounter::pool_exhausted);
+			return -1;
+		}
+		memcpy(frame->title, buf, size);
+	}
+	CFramePool::SetLength(frame, (unsigned short)size);
+
+	if (channel->Push(frame)) {
+		CFramePool::Release(frame);
+		CPipelineStats::Count(ECounter::frame_dropped);
+		return -1;
+	}
+	return size;
+}
+
+bool CFrameWriter::HasReader()
+{
+	if (nullptr == channel)
+		return false;
+	std::lock_guard<std::mutex> lock(channel->mtx);
+	return channel->efd >= 0;
+}
@@ -0,0 +1,97 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/types.h>
+#include <cstdint>
+#include <atomic>
+
+#include "DSVT.h"
+
+#define FRAME_POOL_SIZE 512
+
+// Every frame passed between the link, the gateway and the audio manager lives in one
+// process-wide pool of 56-byte slots. The channels only carry slot indices, and a slot
+// is free again when its last reference is released.
+class CFramePool
+{
+public:
+	// returns a slot with one reference, or nullptr if the pool is exhausted
+	static CDSVT *Alloc();
+	static void AddRef(CDSVT *frame);
+	static void Release(CDSVT *frame);
+	// true if frame is a pool slot
+	static bool Owns(const void *frame);
+	// true if the caller holds the only reference, so the frame can be modified in place
+	static bool IsUnique(const CDSVT *frame);
+	static unsigned short GetLength(const CDSVT *frame);
+	static void SetLength(CDSVT *frame, unsigned short length);
+	// when the frame arrived from the network, 0 if it isn't a pool slot or wasn't stamped
+	static uint64_t GetTime(const CDSVT *frame);
+	static void SetTime(CDSVT *frame, uint64_t when);
+	static unsigned InUse();
+};
+
+// holds one reference to a pool slot for as long as it's in scope
+class CFrameRef
+{
+public:
+	CFrameRef();
+	~CFrameRef();
+	CDSVT &operator*() { return *frame; }
+	CDSVT *operator->() { return frame; }
+	CDSVT *Get() { return frame; }
+private:
+	CFrameRef(const CFrameRef &) = delete;
+	CFrameRef &operator=(const CFrameRef &) = delete;
+	CDSVT *frame;
+	CDSVT backup;	// only used if the pool is exhausted
+};
+
+class CFrameChannel;
+
+class CFrameReader
+{
+public:
+	CFrameReader();
+	~CFrameReader();
+	bool Open(const char *name);
+	void Close();
+	// readable when frames are waiting, call Clear() and then Read() until it returns nullptr
+	int GetFD();
+	void Clear();
+	// the returned frame is held by the caller until Release()
+	CDSVT *Read(ssize_t &length);
+	void Release(CDSVT *frame) { CFramePool::Release(frame); }
+private:
+	CFrameChannel *channel;
+};
+
+class CFrameWriter
+{
+public:
+	CFrameWriter();
+	~CFrameWriter() {}
+	void SetUp(const char *name);
+	// if buf is a pool slot it's passed by reference, otherwise it's copied into a new slot
+	ssize_t Write(const void *buf, size_t size);
+	// true if a reader has the channel open
+	bool HasReader();
+private:
+	CFrameChannel *channel;
+};
@@ -0,0 +1,197 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "GPSD.h"
+
+// how long to wait before trying gpsd again
+#define GPSD_RETRY 10
+
+CGPSD::CGPSD() : port(0), state(EGPSDState::closed), fd(-1), retry(0), used(0), discard(false)
+{
+	memset(&fix, 0, sizeof(SGPSFIX));
+}
+
+CGPSD::~CGPSD()
+{
+	Close();
+}
+
+void CGPSD::Open(const std::string &s, unsigned short p)
+{
+	if (EGPSDState::closed!=state && 0==server.compare(s) && port==p)
+		return;
+	Close();
+	server.assign(s);
+	port = p;
+	state = EGPSDState::idle;
+	retry = 0;
+	resolver.Start();
+}
+
+void CGPSD::Close()
+{
+	Disconnect();
+	state = EGPSDState::closed;
+	std::lock_guard<std::mutex> lock(mtx);
+	fix.when = 0;
+}
+
+void CGPSD::Disconnect()
+{
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+	used = 0;
+	discard = false;
+	if (EGPSDState::closed != state) {
+		state = EGPSDState::idle;
+		retry = time(nullptr) + GPSD_RETRY;
+	}
+}
+
+void CGPSD::Connect()
+{
+	CSockAddress addr;
+	switch (resolver.Find(server, port, addr)) {
+		case EResolveState::pending:
+			return;	// try again on the next Poll()
+		case EResolveState::failed:
+			fprintf(stderr, "gpsd: could not find %s\n", server.c_str());
+			Disconnect();
+			return;
+		case EResolveState::found:
+			break;
+	}
+	fd = socket(addr.GetFamily(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0 || (connect(fd, addr.GetCPointer(), addr.GetSize()) && EINPROGRESS != errno)) {
+		fprintf(stderr, "gpsd: could not connect to %s:%u: %s\n", server.c_str(), port, strerror(errno));
+		Disconnect();
+		return;
+	}
+	state = EGPSDState::connecting;
+}
+
+void CGPSD::Poll()
+{
+	if (EGPSDState::idle == state) {
+		if (time(nullptr) >= retry)
+			Connect();
+		return;
+	}
+
+	if (EGPSDState::connecting == state) {
+		struct pollfd pfd = { fd, POLLOUT, 0 };
+		if (poll(&pfd, 1, 0) < 1)
+			return;
+		int err = 0;
+		socklen_t len = sizeof(err);
+		getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+		const char *watch = "?WATCH={\"enable\":true,\"json\":true};\n";
+		if (err || send(fd, watch, strlen(watch), MSG_NOSIGNAL) < 0) {
+			fprintf(stderr, "gpsd: could not connect to %s:%u: %s\n", server.c_str(), port, strerror(err ? err : errno));
+			Disconnect();
+			return;
+		}
+		printf("gpsd: watching %s:%u\n", server.c_str(), port);
+		state = EGPSDState::watching;
+	}
+
+	if (EGPSDState::watching != state)
+		return;
+
+	while (true) {
+		ssize_t len = recv(fd, buf + used, GPSD_LINE - 1 - used, 0);
+		if (len < 0 && (EAGAIN==errno || EWOULDBLOCK==errno || EINTR==errno))
+			return;
+		if (len <= 0) {
+			fprintf(stderr, "gpsd: %s:%u closed the connection\n", server.c_str(), port);
+			Disconnect();
+			return;
+		}
+		used += len;
+		buf[used] = '\0';
+		// parse every complete line, the rest waits for the next read
+		char *line = buf;
+		char *eol;
+		while (nullptr != (eol = strchr(line, '\n'))) {
+			*eol = '\0';
+			if (! discard)
+				Parse(line);
+			discard = false;
+			line = eol + 1;
+		}
+		used -= line - buf;
+		memmove(buf, line, used);
+		if (GPSD_LINE - 1 == used) {
+			// nobody sends a line this long, skip to the next one
+			used = 0;
+			discard = true;
+		}
+	}
+}
+
+bool CGPSD::Find(const char *line, const char *key, double &value)
+{
+	const char *p = strstr(line, key);
+	if (nullptr == p)
+		return false;
+	p += strlen(key);
+	while (' '==*p || ':'==*p)
+		p++;
+	char *end;
+	value = strtod(p, &end);
+	return end != p;
+}
+
+void CGPSD::Parse(const char *line)
+{
+	// only the time-position-velocity reports are interesting
+	if (nullptr == strstr(line, "\"class\":\"TPV\""))
+		return;
+	double mode, lat, lon;
+	if (! Find(line, "\"mode\"", mode) || mode < 2.0 || ! Find(line, "\"lat\"", lat) || ! Find(line, "\"lon\"", lon))
+		return;
+	SGPSFIX f;
+	f.latitude = lat;
+	f.longitude = lon;
+	if (! Find(line, "\"speed\"", f.speed))
+		f.speed = 0.0;
+	if (! Find(line, "\"track\"", f.track))
+		f.track = -1.0;
+	f.when = time(nullptr);
+	std::lock_guard<std::mutex> lock(mtx);
+	fix = f;
+}
+
+bool CGPSD::GetFix(SGPSFIX &f, int maxage) const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	if (0 == fix.when || time(nullptr) - fix.when > maxage)
+		return false;
+	f = fix;
+	return true;
+}
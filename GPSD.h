@@ -0,0 +1,68 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <string>
+#include <mutex>
+#include <ctime>
+
+#include "Resolver.h"
+
+#define GPSD_LINE 4096
+
+using SGPSFIX = struct gpsfix_tag {
+	double latitude, longitude;	// degrees
+	double speed;				// meters per second
+	double track;				// degrees from true north, negative if it isn't known
+	time_t when;				// when the fix arrived
+};
+
+// A client for gpsd's JSON stream. Poll() only does the I/O that's ready and returns right
+// away, so it can be called from a thread that has other work to do.
+class CGPSD
+{
+public:
+	CGPSD();
+	~CGPSD();
+	// nothing happens until Poll(), and nothing at all if it's already using this server
+	void Open(const std::string &server, unsigned short port);
+	void Close();
+	void Poll();
+	// true if there's a 2D or 3D fix that's no older than maxage seconds
+	bool GetFix(SGPSFIX &fix, int maxage) const;
+
+private:
+	enum class EGPSDState { closed, idle, connecting, watching };
+
+	void Connect();
+	void Disconnect();
+	void Parse(const char *line);
+	static bool Find(const char *line, const char *key, double &value);
+
+	std::string server;
+	unsigned short port;
+	EGPSDState state;
+	int fd;
+	time_t retry;
+	char buf[GPSD_LINE];
+	size_t used;
+	bool discard;	// the current line didn't fit in buf
+	CResolver resolver;	// so a name lookup doesn't hold up the caller
+	mutable std::mutex mtx;
+	SGPSFIX fix;
+};
@@ -0,0 +1,203 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cctype>
+#include <ctime>
+
+#include "HostFile.h"
+
+void CHostFile::Stat(ino_t &i, off_t &s, time_t &t, long &ns) const
+{
+	struct stat sbuf;
+	if (stat(path.c_str(), &sbuf)) {
+		i = 0;
+		s = 0;
+		t = 0;
+		ns = 0;
+	} else {
+		i = sbuf.st_ino;
+		s = sbuf.st_size;
+		t = sbuf.st_mtim.tv_sec;
+		ns = sbuf.st_mtim.tv_nsec;
+	}
+}
+
+bool CHostFile::Changed() const
+{
+	ino_t i;
+	off_t s;
+	time_t t;
+	long ns;
+	Stat(i, s, t, ns);
+	if (0 == i)	// it's missing, probably being rebuilt
+		return false;
+	if (i==ino && s==size && t==mtime && ns==mtime_ns)
+		return false;
+	// wait until whoever is writing it has had time to finish
+	return time(nullptr) - t > 1;
+}
+
+int CHostFile::Parse(const char *data, size_t len, std::unordered_map<std::string, SHOSTADDR> &hosts) const
+{
+	int bad = 0, lineno = 0;
+	const char *p = data;
+	const char *end = data + len;
+
+	while (p < end) {
+		lineno++;
+		const char *eol = p;
+		while (eol < end && '\n' != *eol)
+			eol++;
+		const char *next = eol + 1;
+		// strip a trailing comment
+		for (const char *c=p; c<eol; c++) {
+			if ('#' == *c) {
+				eol = c;
+				break;
+			}
+		}
+
+		const char *tok[3];
+		size_t toklen[3];
+		int count = 0;
+		const char *q = p;
+		while (q < eol && count < 3) {
+			while (q < eol && isspace(*q))
+				q++;
+			if (q == eol)
+				break;
+			tok[count] = q;
+			while (q < eol && ! isspace(*q))
+				q++;
+			toklen[count] = q - tok[count];
+			count++;
+		}
+		p = next;
+
+		if (0 == count)
+			continue;	// blank or comment line
+
+		bool valid = (3 == count && toklen[0] <= 6);
+		for (size_t j=0; valid && j<toklen[0]; j++)
+			valid = (0 != isalnum(tok[0][j]));
+		for (size_t j=0; valid && j<toklen[1]; j++)
+			valid = (isalnum(tok[1][j]) || '.'==tok[1][j] || '-'==tok[1][j] || ':'==tok[1][j]);
+		unsigned long port = 0;
+		for (size_t j=0; valid && j<toklen[2]; j++) {
+			valid = (0 != isdigit(tok[2][j]));
+			port = 10 * port + (tok[2][j] - '0');
+			if (port > 65535UL)
+				valid = false;
+		}
+		if (! valid || 0 == port) {
+			fprintf(stderr, "%s line %d is not valid: '%.*s'\n", path.c_str(), lineno, int(eol - tok[0]), tok[0]);
+			bad++;
+			continue;
+		}
+
+		std::string name(tok[0], toklen[0]);
+		name.resize(6, ' ');
+		SHOSTADDR &h = hosts[name];
+		h.addr.assign(tok[1], toklen[1]);
+		h.port = (unsigned short)port;
+	}
+	return bad;
+}
+
+int CHostFile::Load(CQnetDB &db)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Could not open %s\n", path.c_str());
+		return -1;
+	}
+	struct stat sbuf;
+	if (fstat(fd, &sbuf)) {
+		close(fd);
+		return -1;
+	}
+
+	// the file is read rather than mapped, a mapped file that is truncated while it's parsed raises SIGBUS,
+	// and it's read to the end, whatever size fstat() said it was
+	std::string data(sbuf.st_size + 1, '\0');
+	size_t len = 0;
+	while (true) {
+		if (len == data.size())
+			data.resize(2 * data.size());
+		ssize_t n = read(fd, &data[len], data.size() - len);
+		if (n < 0) {
+			if (EINTR == errno)
+				continue;
+			perror("CHostFile::Load read");
+			close(fd);
+			return -1;
+		}
+		if (0 == n)
+			break;
+		len += n;
+	}
+	close(fd);
+
+	std::unordered_map<std::string, SHOSTADDR> hosts;
+	hosts.reserve(current.size() ? current.size() : 1024);
+	int bad = Parse(data.data(), len, hosts);
+
+	// only the rows that are new, changed or gone are written
+	int added = 0, deleted = 0;
+	bool intransaction = false;
+	for (const auto &h : hosts) {
+		const auto it = current.find(h.first);
+		if (current.end()!=it && it->second.port==h.second.port && 0==it->second.addr.compare(h.second.addr))
+			continue;
+		if (! intransaction) {
+			if (db.BeginGW())
+				return -1;
+			intransaction = true;
+		}
+		db.AddGW(EGWSource::hostfile, h.first.c_str(), h.second.addr.c_str(), h.second.port);
+		added++;
+	}
+	for (const auto &c : current) {
+		if (hosts.end() != hosts.find(c.first))
+			continue;
+		if (! intransaction) {
+			if (db.BeginGW())
+				return -1;
+			intransaction = true;
+		}
+		db.DelGW(EGWSource::hostfile, c.first.c_str());
+		deleted++;
+	}
+	if (intransaction)
+		db.EndGW();
+
+	current.swap(hosts);
+	ino = sbuf.st_ino;
+	size = sbuf.st_size;
+	mtime = sbuf.st_mtim.tv_sec;
+	mtime_ns = sbuf.st_mtim.tv_nsec;
+
+	if (added || deleted || bad)
+		printf("%s: %d hosts, %d added or changed, %d removed, %d invalid lines\n", path.c_str(), int(current.size()), added, deleted, bad);
+	return int(current.size());
+}
@@ -0,0 +1,57 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/types.h>
+#include <string>
+#include <unordered_map>
+
+#include "QnetDB.h"
+
+// the gwys.txt host file: "NAME ADDRESS PORT" per line, '#' starts a comment
+// the last loaded set is kept so that a reload only touches rows that changed
+class CHostFile {
+public:
+	CHostFile() : ino(0), size(0), mtime(0), mtime_ns(0) {}
+	~CHostFile() {}
+
+	void SetPath(const std::string &p) { path.assign(p); }
+	const std::string &GetPath() const { return path; }
+	// apply the differences to the GATEWAYS table, returns the number of hosts in the file, or -1 on error
+	int Load(CQnetDB &db);
+	// true if the file has been replaced or modified since the last Load
+	bool Changed() const;
+	// the next Load will write every row, use this after the GATEWAYS table has been cleared
+	void Forget() { current.clear(); }
+	int Count() const { return int(current.size()); }
+
+private:
+	using SHOSTADDR = struct hostaddr_tag {
+		std::string addr;
+		unsigned short port;
+	};
+	int Parse(const char *data, size_t len, std::unordered_map<std::string, SHOSTADDR> &hosts) const;
+	void Stat(ino_t &i, off_t &s, time_t &t, long &ns) const;
+
+	std::string path;
+	std::unordered_map<std::string, SHOSTADDR> current;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	long mtime_ns;
+};
@@ -21,38 +21,6 @@
 #include <queue>
 #include <string>
 
-class CHost {
-public:
-	CHost() {}
-
-	~CHost() {}
-
-	CHost(const CHost &from)
-	{
-		name.assign(from.name);
-		addr.assign(from.addr);
-		port = from.port;
-	}
-
-	CHost(const std::string n, const std::string a, unsigned short p)
-	{
-		name.assign(n);
-		addr.assign(a);
-		port = p;
-	}
-
-	CHost &operator=(const CHost &from)
-	{
-		name.assign(from.name);
-		addr.assign(from.addr);
-		port = from.port;
-		return *this;
-	}
-
-	std::string name, addr;
-	unsigned short port;
-};
-
 template <class T> class CTQueue
 {
 public:
@@ -80,6 +48,11 @@ public:
 		return queue.empty();
 	}
 
+	size_t Size()
+	{
+		return queue.size();
+	}
+
 	void Clear()
 	{
 		while (queue.size())
@@ -89,5 +62,3 @@ public:
 private:
 	std::queue<T> queue;
 };
-
-using CHostQueue = CTQueue<CHost>;
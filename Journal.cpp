@@ -0,0 +1,273 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <arpa/inet.h>
+
+#include "Journal.h"
+
+static size_t JournalSize()
+{
+	return sizeof(SJOURNALHEADER) + JOURNAL_CAPACITY * sizeof(SJOURNAL);
+}
+
+static bool IsJournal(const SJOURNALHEADER *h)
+{
+	return 0==memcmp(h->magic, JOURNAL_MAGIC, 4) && JOURNAL_VERSION==h->version && sizeof(SJOURNAL)==h->record_size && JOURNAL_CAPACITY==h->capacity;
+}
+
+CJournal::CJournal() : header(nullptr), records(nullptr) {}
+
+CJournal::~CJournal()
+{
+	Close();
+}
+
+bool CJournal::Open(const char *path)
+{
+	Close();
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "CJournal::Open can't open %s: %s\n", path, strerror(errno));
+		return true;
+	}
+	// the gateway and the link both write, so only one of them can (re)create it
+	flock(fd, LOCK_EX);
+	struct stat sbuf;
+	if (fstat(fd, &sbuf)) {
+		fprintf(stderr, "CJournal::Open can't stat %s: %s\n", path, strerror(errno));
+		flock(fd, LOCK_UN);
+		close(fd);
+		return true;
+	}
+	const bool fresh = (size_t(sbuf.st_size) != JournalSize());
+	if (fresh && (ftruncate(fd, 0) || ftruncate(fd, JournalSize()))) {
+		fprintf(stderr, "CJournal::Open can't size %s: %s\n", path, strerror(errno));
+		flock(fd, LOCK_UN);
+		close(fd);
+		return true;
+	}
+	void *map = mmap(nullptr, JournalSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (MAP_FAILED == map) {
+		fprintf(stderr, "CJournal::Open can't map %s: %s\n", path, strerror(errno));
+		flock(fd, LOCK_UN);
+		close(fd);
+		return true;
+	}
+	header = (SJOURNALHEADER *)map;
+	records = (SJOURNAL *)((char *)map + sizeof(SJOURNALHEADER));
+	if (fresh || ! IsJournal(header)) {
+		memset(map, 0, JournalSize());
+		memcpy(header->magic, JOURNAL_MAGIC, 4);
+		header->version = JOURNAL_VERSION;
+		header->record_size = sizeof(SJOURNAL);
+		header->capacity = JOURNAL_CAPACITY;
+	}
+	flock(fd, LOCK_UN);
+	close(fd);	// the mapping stays
+	return false;
+}
+
+void CJournal::Close()
+{
+	if (header) {
+		munmap(header, JournalSize());
+		header = nullptr;
+		records = nullptr;
+	}
+}
+
+int64_t CJournal::Now()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void CJournal::Append(SJOURNAL &rec)
+{
+	if (nullptr == header)
+		return;
+	if (0 == rec.time)
+		rec.time = Now();
+	const uint64_t n = __atomic_fetch_add(&header->head, 1, __ATOMIC_ACQ_REL);
+	SJOURNAL *slot = records + (n % JOURNAL_CAPACITY);
+	// a reader that sees a zero sequence knows the slot is being written
+	__atomic_store_n(&slot->sequence, 0, __ATOMIC_RELEASE);
+	memcpy((char *)slot + sizeof(slot->sequence), (const char *)&rec + sizeof(rec.sequence), sizeof(SJOURNAL) - sizeof(rec.sequence));
+	rec.sequence = n + 1;
+	__atomic_store_n(&slot->sequence, rec.sequence, __ATOMIC_RELEASE);
+}
+
+CJournalReader::CJournalReader() : header(nullptr), records(nullptr), mapsize(0), next(0), missed(0) {}
+
+CJournalReader::~CJournalReader()
+{
+	Close();
+}
+
+bool CJournalReader::Open(const char *path)
+{
+	Close();
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "CJournalReader::Open can't open %s: %s\n", path, strerror(errno));
+		return true;
+	}
+	struct stat sbuf;
+	if (fstat(fd, &sbuf) || size_t(sbuf.st_size) != JournalSize()) {
+		fprintf(stderr, "CJournalReader::Open %s is not a journal\n", path);
+		close(fd);
+		return true;
+	}
+	void *map = mmap(nullptr, JournalSize(), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map) {
+		fprintf(stderr, "CJournalReader::Open can't map %s: %s\n", path, strerror(errno));
+		return true;
+	}
+	header = (const SJOURNALHEADER *)map;
+	if (! IsJournal(header)) {
+		fprintf(stderr, "CJournalReader::Open %s is not a journal\n", path);
+		munmap(map, JournalSize());
+		header = nullptr;
+		return true;
+	}
+	records = (const SJOURNAL *)((const char *)map + sizeof(SJOURNALHEADER));
+	mapsize = JournalSize();
+	SeekOldest();
+	return false;
+}
+
+void CJournalReader::Close()
+{
+	if (header) {
+		munmap((void *)header, mapsize);
+		header = nullptr;
+		records = nullptr;
+	}
+}
+
+void CJournalReader::SeekOldest()
+{
+	if (nullptr == header)
+		return;
+	const uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+	next = (head > JOURNAL_CAPACITY) ? head - JOURNAL_CAPACITY : 0;
+	missed = 0;
+}
+
+void CJournalReader::SeekNewest()
+{
+	if (nullptr == header)
+		return;
+	next = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+	missed = 0;
+}
+
+void CJournalReader::SeekBack(uint64_t count)
+{
+	if (nullptr == header)
+		return;
+	const uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+	if (count > JOURNAL_CAPACITY)
+		count = JOURNAL_CAPACITY;
+	next = (head > count) ? head - count : 0;
+	missed = 0;
+}
+
+bool CJournalReader::Read(SJOURNAL &rec)
+{
+	if (nullptr == header)
+		return true;
+	while (true) {
+		const uint64_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+		if (next >= head)
+			return true;
+		if (head - next > JOURNAL_CAPACITY) {
+			// the writers lapped us
+			missed += head - next - JOURNAL_CAPACITY;
+			next = head - JOURNAL_CAPACITY;
+		}
+		const SJOURNAL *slot = records + (next % JOURNAL_CAPACITY);
+		const uint64_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		if (seq < next + 1)
+			return true;	// still being written
+		if (seq == next + 1) {
+			memcpy(&rec, slot, sizeof(SJOURNAL));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == seq) {
+				rec.sequence = seq;
+				next++;
+				return false;
+			}
+		}
+		// it was overwritten
+		missed++;
+		next++;
+	}
+}
+
+const char *JournalEventName(EJournalEvent event)
+{
+	switch (event) {
+		case EJournalEvent::rx_start:     return "rx_start";
+		case EJournalEvent::rx_end:       return "rx_end";
+		case EJournalEvent::tx_start:     return "tx_start";
+		case EJournalEvent::tx_end:       return "tx_end";
+		case EJournalEvent::linked:       return "linked";
+		case EJournalEvent::unlinked:     return "unlinked";
+		case EJournalEvent::link_timeout: return "link_timeout";
+		case EJournalEvent::link_failed:  return "link_failed";
+		default:                          return "none";
+	}
+}
+
+std::string JournalField(const char *field, size_t size)
+{
+	std::string s(field, strnlen(field, size));
+	while (s.size() && ' ' == s.back())
+		s.pop_back();
+	for (auto &c : s) {
+		if (c < 0x20 || c > 0x7e || '"' == c || '\\' == c)
+			c = '?';
+	}
+	return s;
+}
+
+std::string JournalJSON(const SJOURNAL &rec)
+{
+	char buf[384];
+	int len = snprintf(buf, sizeof(buf), "{\"seq\":%llu,\"time\":%lld,\"event\":\"%s\",\"module\":\"%c\"", (unsigned long long)rec.sequence, (long long)rec.time, JournalEventName(rec.event), isprint(rec.module) ? rec.module : ' ');
+	if (rec.event >= EJournalEvent::linked) {
+		snprintf(buf + len, sizeof(buf) - len, ",\"reflector\":\"%s\"}", JournalField(rec.urcall, 8).c_str());
+		return std::string(buf);
+	}
+	len += snprintf(buf + len, sizeof(buf) - len, ",\"streamid\":%u,\"mycall\":\"%s\",\"sfx\":\"%s\",\"urcall\":\"%s\",\"rpt1\":\"%s\",\"rpt2\":\"%s\"", ntohs(rec.streamid), JournalField(rec.mycall, 8).c_str(), JournalField(rec.sfx, 4).c_str(), JournalField(rec.urcall, 8).c_str(), JournalField(rec.rpt1, 8).c_str(), JournalField(rec.rpt2, 8).c_str());
+	if (EJournalEvent::rx_end==rec.event || EJournalEvent::tx_end==rec.event)
+		len += snprintf(buf + len, sizeof(buf) - len, ",\"duration\":%u,\"frames\":%u,\"silent\":%u,\"lost\":%u,\"bit_errors\":%u", rec.duration, rec.frames, rec.silent, rec.lost, rec.bit_errors);
+	snprintf(buf + len, sizeof(buf) - len, "}");
+	return std::string(buf);
+}
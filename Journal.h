@@ -0,0 +1,107 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/types.h>
+#include <cstdint>
+#include <string>
+
+// A fixed size, memory-mapped file of fixed size records. Writers append at the head and
+// overwrite the oldest records when it wraps around. Readers map the same file and follow
+// the head without ever blocking a writer.
+
+#define JOURNAL_MAGIC "QDVJ"
+#define JOURNAL_VERSION 1
+#define JOURNAL_CAPACITY 16384
+
+enum class EJournalEvent : uint8_t { none, rx_start, rx_end, tx_start, tx_end, linked, unlinked, link_timeout, link_failed };
+
+using SJOURNAL = struct journal_tag {
+	uint64_t sequence;	// one more than the record number, it's written last
+	int64_t time;		// milliseconds since the epoch
+	EJournalEvent event;
+	char module;
+	uint16_t streamid;	// in network byte order, as it is in the stream
+	uint32_t duration;	// in milliseconds, for the *_end events
+	uint16_t frames;	// voice frames in the stream
+	uint16_t silent;	// silent voice frames
+	uint16_t lost;		// frames missing from the stream
+	uint16_t reserved;
+	uint32_t bit_errors;
+	char mycall[8], sfx[4], urcall[8], rpt1[8], rpt2[8];	// for link events, urcall is the reflector
+};
+
+using SJOURNALHEADER = struct journal_header_tag {
+	char magic[4];
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t capacity;
+	uint32_t reserved;
+	uint64_t head;		// the number of records ever appended
+	char pad[40];
+};
+
+static_assert(sizeof(SJOURNAL) == 72, "the journal record layout has changed");
+static_assert(sizeof(SJOURNALHEADER) == 64, "the journal header layout has changed");
+
+class CJournal
+{
+public:
+	CJournal();
+	~CJournal();
+	// creates the file if it's missing or not a journal, returns true on error
+	bool Open(const char *path);
+	void Close();
+	bool IsOpen() const { return nullptr != header; }
+	// the sequence and time are filled in, if time is zero
+	void Append(SJOURNAL &rec);
+	static int64_t Now();
+
+private:
+	SJOURNALHEADER *header;
+	SJOURNAL *records;
+};
+
+class CJournalReader
+{
+public:
+	CJournalReader();
+	~CJournalReader();
+	bool Open(const char *path);
+	void Close();
+	// position at the oldest record still in the journal, after the newest one, or count records before that
+	void SeekOldest();
+	void SeekNewest();
+	void SeekBack(uint64_t count);
+	// returns true if there is nothing new, records that were overwritten while being read are skipped
+	bool Read(SJOURNAL &rec);
+	// the number of records that were overwritten before they could be read
+	uint64_t Missed() const { return missed; }
+
+private:
+	const SJOURNALHEADER *header;
+	const SJOURNAL *records;
+	size_t mapsize;
+	uint64_t next, missed;
+};
+
+const char *JournalEventName(EJournalEvent event);
+// a callsign field without the padding, and with anything unprintable replaced
+std::string JournalField(const char *field, size_t size);
+// one record as a JSON object
+std::string JournalJSON(const SJOURNAL &rec);
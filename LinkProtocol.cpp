@@ -0,0 +1,280 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cstring>
+
+#include "LinkProtocol.h"
+#include "Capture.h"
+
+static const unsigned short crc_tabccitt[256] = {
+	0x0000,0x1189,0x2312,0x329b,0x4624,0x57ad,0x6536,0x74bf,0x8c48,0x9dc1,0xaf5a,0xbed3,0xca6c,0xdbe5,0xe97e,0xf8f7,
+	0x1081,0x0108,0x3393,0x221a,0x56a5,0x472c,0x75b7,0x643e,0x9cc9,0x8d40,0xbfdb,0xae52,0xdaed,0xcb64,0xf9ff,0xe876,
+	0x2102,0x308b,0x0210,0x1399,0x6726,0x76af,0x4434,0x55bd,0xad4a,0xbcc3,0x8e58,0x9fd1,0xeb6e,0xfae7,0xc87c,0xd9f5,
+	0x3183,0x200a,0x1291,0x0318,0x77a7,0x662e,0x54b5,0x453c,0xbdcb,0xac42,0x9ed9,0x8f50,0xfbef,0xea66,0xd8fd,0xc974,
+	0x4204,0x538d,0x6116,0x709f,0x0420,0x15a9,0x2732,0x36bb,0xce4c,0xdfc5,0xed5e,0xfcd7,0x8868,0x99e1,0xab7a,0xbaf3,
+	0x5285,0x430c,0x7197,0x601e,0x14a1,0x0528,0x37b3,0x263a,0xdecd,0xcf44,0xfddf,0xec56,0x98e9,0x8960,0xbbfb,0xaa72,
+	0x6306,0x728f,0x4014,0x519d,0x2522,0x34ab,0x0630,0x17b9,0xef4e,0xfec7,0xcc5c,0xddd5,0xa96a,0xb8e3,0x8a78,0x9bf1,
+	0x7387,0x620e,0x5095,0x411c,0x35a3,0x242a,0x16b1,0x0738,0xffcf,0xee46,0xdcdd,0xcd54,0xb9eb,0xa862,0x9af9,0x8b70,
+	0x8408,0x9581,0xa71a,0xb693,0xc22c,0xd3a5,0xe13e,0xf0b7,0x0840,0x19c9,0x2b52,0x3adb,0x4e64,0x5fed,0x6d76,0x7cff,
+	0x9489,0x8500,0xb79b,0xa612,0xd2ad,0xc324,0xf1bf,0xe036,0x18c1,0x0948,0x3bd3,0x2a5a,0x5ee5,0x4f6c,0x7df7,0x6c7e,
+	0xa50a,0xb483,0x8618,0x9791,0xe32e,0xf2a7,0xc03c,0xd1b5,0x2942,0x38cb,0x0a50,0x1bd9,0x6f66,0x7eef,0x4c74,0x5dfd,
+	0xb58b,0xa402,0x9699,0x8710,0xf3af,0xe226,0xd0bd,0xc134,0x39c3,0x284a,0x1ad1,0x0b58,0x7fe7,0x6e6e,0x5cf5,0x4d7c,
+	0xc60c,0xd785,0xe51e,0xf497,0x8028,0x91a1,0xa33a,0xb2b3,0x4a44,0x5bcd,0x6956,0x78df,0x0c60,0x1de9,0x2f72,0x3efb,
+	0xd68d,0xc704,0xf59f,0xe416,0x90a9,0x8120,0xb3bb,0xa232,0x5ac5,0x4b4c,0x79d7,0x685e,0x1ce1,0x0d68,0x3ff3,0x2e7a,
+	0xe70e,0xf687,0xc41c,0xd595,0xa12a,0xb0a3,0x8238,0x93b1,0x6b46,0x7acf,0x4854,0x59dd,0x2d62,0x3ceb,0x0e70,0x1ff9,
+	0xf78f,0xe606,0xd49d,0xc514,0xb1ab,0xa022,0x92b9,0x8330,0x7bc7,0x6a4e,0x58d5,0x495c,0x3de3,0x2c6a,0x1ef1,0x0f78
+};
+
+static const unsigned char endbytes[6] = { 0x55U, 0x55U, 0x55U, 0x55U, 0xC8U, 0x7AU };
+
+void CLinkFrame::CalcPFCS(unsigned char *packet, int len)
+{
+	unsigned short crc_dstar_ffff = 0xffff;
+	unsigned short tmp;
+	short int low, high;
+
+	if (len == 56) {
+		low = 15;
+		high = 54;
+	} else if (len == 58) {
+		low = 17;
+		high = 56;
+	} else
+		return;
+
+	for (short int i=low; i<high ; i++) {
+		unsigned short short_c = 0x00ff & (unsigned short)packet[i];
+		tmp = (crc_dstar_ffff & 0x00ff) ^ short_c;
+		crc_dstar_ffff = (crc_dstar_ffff >> 8) ^ crc_tabccitt[tmp];
+	}
+	crc_dstar_ffff =  ~crc_dstar_ffff;
+	tmp = crc_dstar_ffff;
+
+	packet[high] = (unsigned char)(crc_dstar_ffff & 0xff);
+	packet[high+1] = (unsigned char)((tmp >> 8) & 0xff);
+}
+
+bool CLinkFrame::IsFrame(const unsigned char *buf, int length)
+{
+	if (56 == length)
+		return 0==memcmp(buf, "DSVT", 4) && 0x10U==buf[4] && 0x20U==buf[8];
+	if (27 <= length && 30 >= length)
+		return 0==memcmp(buf, "DSVT", 4) && 0x20U==buf[4] && 0x20U==buf[8];
+	return false;
+}
+
+void CLinkFrame::FixFlag(CDSVT &dsvt)
+{
+	if (dsvt.hdr.flag[0]==0x40U || dsvt.hdr.flag[0]==0x48U || dsvt.hdr.flag[0]==0x60U || dsvt.hdr.flag[0]==0x68U)
+		dsvt.hdr.flag[0] -= 0x40U;
+}
+
+void CLinkFrame::PeerHeader(const CDSVT &hdr, const std::string &owner, const SPEER &peer, CDSVT &out)
+{
+	// a link gets the reflector's callsigns, a dongle gets ours
+	const char *call = peer.inbound ? owner.c_str() : peer.to_call;
+	const size_t len = strnlen(call, CALL_SIZE);
+	memcpy(out.title, hdr.title, 56);
+	memset(out.hdr.rpt1, ' ', CALL_SIZE);
+	memcpy(out.hdr.rpt1, call, len);
+	out.hdr.rpt1[7] = peer.inbound ? peer.from_mod : peer.to_mod;
+	memset(out.hdr.rpt2, ' ', CALL_SIZE);
+	memcpy(out.hdr.rpt2, call, len);
+	out.hdr.rpt2[7] = 'G';
+	memcpy(out.hdr.urcall, "CQCQCQ  ", CALL_SIZE);
+}
+
+// the gateway, the dcs header and the xrf voice frame all use the band in flagb[2]
+static unsigned char Band(char module)
+{
+	if ('A' == module)
+		return 0x03U;
+	if ('B' == module)
+		return 0x01U;
+	return 0x02U;
+}
+
+static void Receive(int sock, CSockAddress &from, struct iovec *iov, int iovlen, SLINKPACKET &pkt)
+{
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_name = from.GetPointer();
+	msg.msg_namelen = sizeof(struct sockaddr_storage);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovlen;
+	pkt.length = recvmsg(sock, &msg, 0);
+	pkt.frame = 0;
+}
+
+void CLinkProtocol<EPeerProto::xrf>::Receive(int sock, CSockAddress &from, CDSVT &dsvt, SLINKPACKET &pkt)
+{
+	// a frame lands in the slot, anything longer is never a frame
+	struct iovec iov[2];
+	iov[0].iov_base = dsvt.title;
+	iov[0].iov_len = sizeof(CDSVT);
+	iov[1].iov_base = pkt.raw + sizeof(CDSVT);
+	iov[1].iov_len = LINK_PACKET_SIZE - sizeof(CDSVT);
+	::Receive(sock, from, iov, 2, pkt);
+	if (pkt.length <= 0)
+		return;
+
+	if ((56==pkt.length || 27==pkt.length) && IsFrame(dsvt.title, pkt.length))
+		pkt.frame = pkt.length;
+	else
+		memcpy(pkt.raw, dsvt.title, (pkt.length < int(sizeof(CDSVT))) ? pkt.length : sizeof(CDSVT));
+
+	if (CCapture::IsOpen())
+		CCapture::Write(ECapture::xrf, from, pkt.frame ? dsvt.title : pkt.raw, pkt.length);
+}
+
+int CLinkProtocol<EPeerProto::xrf>::Encode(const CDSVT &dsvt, int length, const CDSVT &, const std::string &owner, SPEER &peer, unsigned char *buf)
+{
+	CDSVT &out = *(CDSVT *)buf;
+	if (56 == length) {
+		PeerHeader(dsvt, owner, peer, out);
+		/* inform XRF about the source */
+		out.flagb[2] = peer.from_mod;
+		CalcPFCS(out.title, 56);
+		return 56;
+	}
+	memcpy(out.title, dsvt.title, 27);
+	out.flagb[2] = peer.from_mod;
+	return 27;
+}
+
+void CLinkProtocol<EPeerProto::ref>::Receive(int sock, CSockAddress &from, CDSVT &dsvt, SLINKPACKET &pkt)
+{
+	// the length and type go in raw and the frame in the slot
+	struct iovec iov[3];
+	iov[0].iov_base = pkt.raw;
+	iov[0].iov_len = 2;
+	iov[1].iov_base = dsvt.title;
+	iov[1].iov_len = sizeof(CDSVT);
+	iov[2].iov_base = pkt.raw + 2 + sizeof(CDSVT);
+	iov[2].iov_len = LINK_PACKET_SIZE - 2 - sizeof(CDSVT);
+	::Receive(sock, from, iov, 3, pkt);
+	if (pkt.length <= 0)
+		return;
+
+	if ((58==pkt.length || 29==pkt.length || 32==pkt.length) && IsFrame(dsvt.title, pkt.length - 2))
+		pkt.frame = (58 == pkt.length) ? 56 : 27;
+	// the control packets are short, so it doesn't cost much to have them in one piece
+	if (0==pkt.frame || CCapture::IsOpen()) {
+		const int n = pkt.length - 2;
+		if (n > 0)
+			memcpy(pkt.raw + 2, dsvt.title, (n < int(sizeof(CDSVT))) ? n : sizeof(CDSVT));
+		CCapture::Write(ECapture::ref, from, pkt.raw, pkt.length);
+	}
+}
+
+int CLinkProtocol<EPeerProto::ref>::Encode(const CDSVT &dsvt, int length, const CDSVT &, const std::string &owner, SPEER &peer, unsigned char *buf)
+{
+	CREFDSVT &out = *(CREFDSVT *)buf;
+	out.head[1] = 0x80U;
+	if (56 == length) {
+		out.head[0] = 58U;
+		PeerHeader(dsvt, owner, peer, out.dsvt);
+		CalcPFCS(out.dsvt.title, 56);
+		return 58;
+	}
+	out.head[0] = (dsvt.ctrl & 0x40U) ? 32U : 29U;
+	memcpy(out.dsvt.title, dsvt.title, 27);
+	if (32U == out.head[0])
+		memcpy(out.dsvt.vend.end, endbytes, 6);
+	return out.head[0];
+}
+
+void CLinkProtocol<EPeerProto::dcs>::Receive(int sock, CSockAddress &from, CDSVT &dsvt, SLINKPACKET &pkt)
+{
+	struct iovec iov;
+	iov.iov_base = pkt.raw;
+	iov.iov_len = LINK_PACKET_SIZE;
+	::Receive(sock, from, &iov, 1, pkt);
+	if (pkt.length <= 0)
+		return;
+	CCapture::Write(ECapture::dcs, from, pkt.raw, pkt.length);
+
+	const unsigned char *raw = pkt.raw;
+	if (100!=pkt.length || memcmp(raw, "0001", 4))
+		return;
+	memcpy(dsvt.title, "DSVT", 4);
+	dsvt.config = 0x20;
+	dsvt.flaga[0] = dsvt.flaga[1] = dsvt.flaga[2] = 0x00;
+	dsvt.id = 0x20;
+	dsvt.flagb[0] = 0x00;
+	dsvt.flagb[1] = 0x01;
+	dsvt.flagb[2] = Band(raw[22]);
+	memcpy(&dsvt.streamid, raw+43, 2);
+	dsvt.ctrl = raw[45];
+	memcpy(dsvt.vasd.voice, raw+46, 12);
+	pkt.frame = 27;
+}
+
+void CLinkProtocol<EPeerProto::dcs>::Header(const SLINKPACKET &pkt, CDSVT &hdr)
+{
+	// it looks like a header from the reflector, rpt1 is the reflector's
+	const unsigned char *raw = pkt.raw;
+	memcpy(hdr.title, "DSVT", 4);
+	hdr.config = 0x10;
+	hdr.flaga[0] = hdr.flaga[1] = hdr.flaga[2] = 0x00;
+	hdr.id = 0x20;
+	hdr.flagb[0] = 0x00;
+	hdr.flagb[1] = 0x01;
+	hdr.flagb[2] = Band(raw[22]);
+	memcpy(&hdr.streamid, raw+43, 2);
+	hdr.ctrl = 0x80;
+	hdr.hdr.flag[0] = hdr.hdr.flag[1] = hdr.hdr.flag[2] = 0x00;
+	memcpy(hdr.hdr.rpt1, raw + 7, CALL_SIZE);
+	memcpy(hdr.hdr.rpt2, raw + 7, CALL_SIZE);
+	hdr.hdr.rpt2[7] = 'G';
+	memcpy(hdr.hdr.urcall, raw + 23, CALL_SIZE);
+	memcpy(hdr.hdr.mycall, raw + 31, CALL_SIZE);
+	memcpy(hdr.hdr.sfx, raw + 39, 4);
+	CalcPFCS(hdr.title, 56);
+}
+
+int CLinkProtocol<EPeerProto::dcs>::Encode(const CDSVT &dsvt, int length, const CDSVT &hdr, const std::string &owner, SPEER &peer, unsigned char *buf)
+{
+	if (56 == length)
+		return 0;	// dcs has no header, every frame has the callsigns
+
+	memset(buf, 0x0, 100);
+	buf[0] = buf[1] = buf[2] = '0';
+	buf[3] = '1';
+	memcpy(buf + 7, peer.to_call, 8);
+	buf[14] = peer.to_mod;
+	memcpy(buf + 15, owner.c_str(), CALL_SIZE);
+	buf[22] = peer.from_mod;
+	memcpy(buf + 23, "CQCQCQ  ", 8);
+	memcpy(buf + 31, hdr.hdr.mycall, 8);
+	memcpy(buf + 39, hdr.hdr.sfx, 4);
+	memcpy(buf + 43, &dsvt.streamid, 2);
+	buf[45] = dsvt.ctrl;  /* cycle sequence */
+	memcpy(buf + 46, dsvt.vasd.voice, 12);
+
+	buf[58] = (peer.dcs_seq >> 0)  & 0xff;
+	buf[59] = (peer.dcs_seq >> 8)  & 0xff;
+	buf[60] = (peer.dcs_seq >> 16) & 0xff;
+	peer.dcs_seq++;
+
+	buf[61] = 0x01;
+	buf[62] = 0x00;
+	return 100;
+}
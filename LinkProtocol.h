@@ -0,0 +1,80 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/types.h>
+#include <string>
+
+#include "DSVT.h"
+#include "SockAddress.h"
+#include "PeerTable.h"
+
+// bigger than any datagram a link protocol sends
+#define LINK_PACKET_SIZE 1000
+
+// A datagram from a peer. A D-STAR frame is received, or decoded, straight into a pool slot,
+// so raw only holds the datagrams that aren't frames.
+using SLINKPACKET = struct link_packet_tag {
+	int length;		// of the datagram, -1 if nothing was received
+	int frame;		// 56 or 27 if a header or voice frame is in the slot, otherwise 0
+	unsigned char raw[LINK_PACKET_SIZE];
+};
+
+// what every protocol has in common
+class CLinkFrame
+{
+public:
+	static void CalcPFCS(unsigned char *packet, int len);
+	// true if the 56 or 27 bytes at buf are a D-STAR header or voice frame
+	static bool IsFrame(const unsigned char *buf, int length);
+	// some bad hotspot programs out there using INCORRECT flag
+	static void FixFlag(CDSVT &dsvt);
+	// a header for peer, with the rpt1 and rpt2 it expects
+	static void PeerHeader(const CDSVT &hdr, const std::string &owner, const SPEER &peer, CDSVT &out);
+};
+
+// The framing of each link protocol. Process() and Forward() use the one that goes with
+// the socket, so there's no test of the protocol for each frame.
+template <EPeerProto P> class CLinkProtocol;
+
+// DExtra, a DSVT frame on its own
+template <> class CLinkProtocol<EPeerProto::xrf> : public CLinkFrame
+{
+public:
+	static void Receive(int sock, CSockAddress &from, CDSVT &dsvt, SLINKPACKET &pkt);
+	// builds the datagram for the peer in buf, returns its length, 0 if the peer doesn't get one
+	static int Encode(const CDSVT &dsvt, int length, const CDSVT &hdr, const std::string &owner, SPEER &peer, unsigned char *buf);
+};
+
+// DPlus, a DSVT frame after a two byte length and type
+template <> class CLinkProtocol<EPeerProto::ref> : public CLinkFrame
+{
+public:
+	static void Receive(int sock, CSockAddress &from, CDSVT &dsvt, SLINKPACKET &pkt);
+	static int Encode(const CDSVT &dsvt, int length, const CDSVT &hdr, const std::string &owner, SPEER &peer, unsigned char *buf);
+};
+
+// DCS, a 100 byte frame with the callsigns from the header in every voice frame
+template <> class CLinkProtocol<EPeerProto::dcs> : public CLinkFrame
+{
+public:
+	static void Receive(int sock, CSockAddress &from, CDSVT &dsvt, SLINKPACKET &pkt);
+	// the header for the voice frame in pkt, only needed when the stream id changes
+	static void Header(const SLINKPACKET &pkt, CDSVT &hdr);
+	static int Encode(const CDSVT &dsvt, int length, const CDSVT &hdr, const std::string &owner, SPEER &peer, unsigned char *buf);
+};
@@ -0,0 +1,66 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "LinkState.h"
+
+int CLinkState::Subscribe(std::function<void(const SLINKEVENT &)> callback)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	subscribers[nextid] = callback;
+	return nextid++;
+}
+
+void CLinkState::Unsubscribe(int id)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	subscribers.erase(id);
+}
+
+void CLinkState::Publish(ELinkEvent event, const char *callsign, char mod)
+{
+	SLINKEVENT ev;
+	ev.event = event;
+	ev.callsign.assign(callsign);
+	ev.callsign.resize(7, ' ');
+	ev.callsign.append(1, mod);
+	time(&ev.time);
+
+	std::lock_guard<std::mutex> lock(mtx);
+	// a timeout or a failure of one peer doesn't change the others
+	if (ELinkEvent::linked == event)
+		linked[ev.callsign] = ev;
+	else
+		linked.erase(ev.callsign);
+	for (const auto &s : subscribers)
+		s.second(ev);
+}
+
+std::vector<SLINKEVENT> CLinkState::Linked()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	std::vector<SLINKEVENT> v;
+	for (const auto &l : linked)
+		v.push_back(l.second);
+	return v;
+}
+
+bool CLinkState::IsLinked()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return ! linked.empty();
+}
@@ -0,0 +1,55 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <ctime>
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+enum class ELinkEvent { linked, unlinked, timeout, failed };
+
+using SLINKEVENT = struct link_event_tag {
+	ELinkEvent event;
+	std::string callsign;	// the reflector or repeater, with the module in the last position
+	time_t time;
+};
+
+// CQnetLink publishes its link changes here, and anyone can subscribe to them
+class CLinkState
+{
+public:
+	CLinkState() : nextid(0) {}
+	~CLinkState() {}
+
+	// the callback is run on the publisher's thread, so it should return quickly
+	int Subscribe(std::function<void(const SLINKEVENT &)> callback);
+	void Unsubscribe(int id);
+	void Publish(ELinkEvent event, const char *callsign, char mod);
+	// the link event of every peer that is linked now, the link can have more than one
+	std::vector<SLINKEVENT> Linked();
+	bool IsLinked();
+
+private:
+	std::mutex mtx;
+	std::map<int, std::function<void(const SLINKEVENT &)>> subscribers;
+	std::map<std::string, SLINKEVENT> linked;	// by callsign and module
+	int nextid;
+};
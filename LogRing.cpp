@@ -0,0 +1,85 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cstring>
+#include <atomic>
+
+#include "LogRing.h"
+
+using SLOGSLOT = struct logslot_tag {
+	std::atomic<unsigned> sequence;
+	ELogLevel level;
+	char text[LOG_LINE_SIZE];
+};
+
+// a bounded queue in the style of D. Vyukov: each slot's sequence number says whether
+// it's ready to be written or ready to be read, so no lock is needed. The sequence is
+// kept relative to the slot index so that the zero-initialized ring is ready to go.
+static SLOGSLOT ring[LOG_RING_SIZE];
+static std::atomic<unsigned> write_pos(0), read_pos(0), dropped(0);
+
+static inline unsigned Lap(unsigned pos)
+{
+	return pos & ~(LOG_RING_SIZE - 1U);
+}
+
+bool CLogRing::Push(ELogLevel level, const char *text)
+{
+	unsigned pos = write_pos.load(std::memory_order_relaxed);
+	SLOGSLOT *slot;
+	while (true) {
+		slot = ring + (pos & (LOG_RING_SIZE - 1));
+		const int diff = int(slot->sequence.load(std::memory_order_acquire) - Lap(pos));
+		if (0 == diff) {
+			if (write_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			// the reader hasn't kept up
+			dropped++;
+			return true;
+		} else
+			pos = write_pos.load(std::memory_order_relaxed);
+	}
+
+	slot->level = level;
+	strncpy(slot->text, text, LOG_LINE_SIZE - 1);
+	slot->text[LOG_LINE_SIZE - 1] = '\0';
+	slot->sequence.store(Lap(pos) + 1, std::memory_order_release);
+	return false;
+}
+
+unsigned CLogRing::Drain(const std::function<void(ELogLevel, const char *)> &func, unsigned max)
+{
+	unsigned count = 0;
+	unsigned pos = read_pos.load(std::memory_order_relaxed);
+	while (count < max) {
+		SLOGSLOT *slot = ring + (pos & (LOG_RING_SIZE - 1));
+		if (int(slot->sequence.load(std::memory_order_acquire) - (Lap(pos) + 1)) < 0)
+			break;	// empty, or the writer hasn't finished
+		func(slot->level, slot->text);
+		slot->sequence.store(Lap(pos) + LOG_RING_SIZE, std::memory_order_release);
+		read_pos.store(++pos, std::memory_order_relaxed);
+		count++;
+	}
+	return count;
+}
+
+unsigned CLogRing::Dropped()
+{
+	return dropped.exchange(0);
+}
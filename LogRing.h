@@ -0,0 +1,39 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <functional>
+
+enum class ELogLevel { debug, info, warning, error };
+
+#define LOG_RING_SIZE 1024	// must be a power of two
+#define LOG_LINE_SIZE 256
+
+// Every thread logs into one process-wide ring. Writers never block: if the ring is full
+// the message is counted and dropped. There is only one reader, the GUI or qdvd, and it drains
+// the ring in batches.
+class CLogRing
+{
+public:
+	// returns true if the message was dropped
+	static bool Push(ELogLevel level, const char *text);
+	// calls func for at most max messages, oldest first, and returns how many there were
+	static unsigned Drain(const std::function<void(ELogLevel, const char *)> &func, unsigned max);
+	// the number of messages dropped since the last call
+	static unsigned Dropped();
+};
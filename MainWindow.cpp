@@ -29,24 +29,33 @@
 
 #include "MainWindow.h"
 #include "WaitCursor.h"
-#include "DPlusAuthenticator.h"
 #include "Utilities.h"
 #include "TemplateClasses.h"
+#include "Capture.h"
 
 #ifndef CFG_DIR
 #define CFG_DIR "/tmp/"
 #endif
 
+#define LOG_DRAIN_MS 250	// how often the log view is updated
+#define LOG_MAX_LINES 2000	// and how much of it is kept
+
 static Glib::RefPtr<Gtk::Application> theApp;
 
 CMainWindow::CMainWindow() :
 	pWin(nullptr),
 	pQuitButton(nullptr),
 	pSettingsButton(nullptr),
+	dplus_loaded(false),
+	cfg_subscription(-1),
 	pGate(nullptr),
-	pLink(nullptr)
+	pLink(nullptr),
+	is_receiving(false),
+	rx_pending(false),
+	link_pending(false)
 {
 	cfg.CopyTo(cfgdata);
+	hostfile.SetPath(std::string(CFG_DIR) + "gwys.txt");
 	if (! AudioManager.AMBEDevice.IsOpen()) {
 		AudioManager.AMBEDevice.FindandOpen(cfgdata.iBaudRate, Encoding::dstar);
 	}
@@ -54,17 +63,23 @@ CMainWindow::CMainWindow() :
 
 CMainWindow::~CMainWindow()
 {
+	AudioManager.Close();	// stop the dispatch thread before the dispatcher goes away
+	if (cfg_subscription >= 0)
+		CConfigure::Unsubscribe(cfg_subscription);
+	status.Stop();
 	if (pWin)
 		delete pWin;
 	StopLink();
 	StopGate();
+	CCapture::Close();
 }
 
 void CMainWindow::RunLink()
 {
 	pLink = new CQnetLink;
-	if (! pLink->Init(&cfgdata))
+	if (! pLink->Init(CConfigure::Current(), &linkstate))
 		pLink->Process();
+	pLink->Shutdown();	// unlink and release the ports so the link can be started again
 	delete pLink;
 	pLink = nullptr;
 }
@@ -72,7 +87,7 @@ void CMainWindow::RunLink()
 void CMainWindow::RunGate()
 {
 	pGate = new CQnetGateway;
-	if (! pGate->Init(&cfgdata))
+	if (! pGate->Init(CConfigure::Current()))
 		pGate->Process();
 	delete pGate;
 	pGate = nullptr;
@@ -93,9 +108,10 @@ void CMainWindow::SetState(const CFGDATA &data)
 		pRouteActionButton->set_sensitive(false);
 	}
 
-	if (data.bLinkEnable) { // if data.bLinkEnable==true, then the TimeoutProcess() will handle the link frame widgets
-		if (nullptr == pGate && cfg.IsOkay())
+	if (data.bLinkEnable) { // if data.bLinkEnable==true, then link state events will handle the link frame widgets
+		if (nullptr == pLink && cfg.IsOkay())
 			futLink = std::async(std::launch::async, &CMainWindow::RunLink, this);
+		UpdateLinkWidgets();
 	} else {
 		StopLink();
 		pLinkButton->set_sensitive(false);
@@ -113,40 +129,25 @@ bool CMainWindow::Init(const Glib::RefPtr<Gtk::Builder> builder, const Glib::ust
 		return true;
 	qnDB.ClearLH();
 	qnDB.ClearLS();
+	qnDB.ClearGW();
 	RebuildGateways(cfgdata.bDPlusEnable);
 
-	if (Gate2AM.Open("gate2am"))
-		return true;
-
-	if (Link2AM.Open("link2am")) {
-		Gate2AM.Close();
-		return true;
-	}
-
-	if (LogInput.Open("log_input")) {
-		Gate2AM.Close();
-		Link2AM.Close();
+	if (AudioManager.Init(&cfg, [this](bool is_rx) { Receive(is_rx); }))
 		return true;
-	}
-
-	if (AudioManager.Init(this)) {
-		LogInput.Close();
-		Gate2AM.Close();
-		Link2AM.Close();
-		return true;
-	}
 
  	builder->get_widget(name, pWin);
 	if (nullptr == pWin) {
-		LogInput.Close();
-		Link2AM.Close();
-		Gate2AM.Close();
+		AudioManager.Close();
 		std::cerr << "Failed to Initialize MainWindow!" << std::endl;
 		return true;
 	}
 
-	if (cfgdata.bAPRSEnable)
-		aprs.Init();
+	aprs.Init();
+
+	if (cfgdata.bCaptureEnable)
+		CCapture::Open(std::string(CFG_DIR) + "qdv.cap", 1024UL * 1024UL * cfgdata.iCaptureMB);
+	// the dashboard and the capture follow the settings without a restart
+	cfg_subscription = CConfigure::Subscribe(CFG_STATION | CFG_STATUS | CFG_CAPTURE, [this](const CFGDATA &old, const CFGDATA &now) { ConfigChanged(old, now); });
 
 	//setup our css context and provider
 	Glib::RefPtr<Gtk::CssProvider> css = Gtk::CssProvider::create();
@@ -178,6 +179,14 @@ bool CMainWindow::Init(const Glib::RefPtr<Gtk::Builder> builder, const Glib::ust
 	builder->get_widget("LogTextView", pLogTextView);
 	builder->get_widget("AboutMenuItem", pAboutMenuItem);
 	pLogTextBuffer = pLogTextView->get_buffer();
+	pLogEndMark = pLogTextBuffer->create_mark(pLogTextBuffer->end(), false);
+	pLogTag[int(ELogLevel::debug)] = pLogTextBuffer->create_tag();
+	pLogTag[int(ELogLevel::debug)]->property_foreground() = "gray";
+	pLogTag[int(ELogLevel::info)] = pLogTextBuffer->create_tag();
+	pLogTag[int(ELogLevel::warning)] = pLogTextBuffer->create_tag();
+	pLogTag[int(ELogLevel::warning)]->property_foreground() = "orange";
+	pLogTag[int(ELogLevel::error)] = pLogTextBuffer->create_tag();
+	pLogTag[int(ELogLevel::error)]->property_foreground() = "red";
 
 	// events
 	pSettingsButton->signal_clicked().connect(sigc::mem_fun(*this, &CMainWindow::on_SettingsButton_clicked));
@@ -197,11 +206,16 @@ bool CMainWindow::Init(const Glib::RefPtr<Gtk::Builder> builder, const Glib::ust
 	SetState(cfgdata);
 
 	// i/o events
-	Glib::signal_io().connect(sigc::mem_fun(*this, &CMainWindow::RelayGate2AM), Gate2AM.GetFD(), Glib::IO_IN);
-	Glib::signal_io().connect(sigc::mem_fun(*this, &CMainWindow::RelayLink2AM), Link2AM.GetFD(), Glib::IO_IN);
-	Glib::signal_io().connect(sigc::mem_fun(*this, &CMainWindow::GetLogInput), LogInput.GetFD(), Glib::IO_IN);
-	// idle processing
-	Glib::signal_timeout().connect(sigc::mem_fun(*this, &CMainWindow::TimeoutProcess), 1000);
+	RxDispatcher.connect(sigc::mem_fun(*this, &CMainWindow::on_RxDispatcher));
+	LinkDispatcher.connect(sigc::mem_fun(*this, &CMainWindow::on_LinkDispatcher));
+	linkstate.Subscribe([this](const SLINKEVENT &) { if (! link_pending.exchange(true)) LinkDispatcher.emit(); });
+	Glib::signal_timeout().connect(sigc::mem_fun(*this, &CMainWindow::DrainLog), LOG_DRAIN_MS);
+	// watch the host file
+	Glib::signal_timeout().connect_seconds(sigc::mem_fun(*this, &CMainWindow::HostFileCheck), 2);
+
+	// the dashboard
+	if (cfgdata.bStatusEnable)
+		status.Start(cfgdata.usStatusPort, cfgdata.sStation, cfgdata.cModule, &linkstate);
 
 	return false;
 }
@@ -233,12 +247,17 @@ void CMainWindow::on_SettingsButton_clicked()
 	auto newdata = SettingsDlg.Show();
 	if (newdata) {	// the user clicked okay so we need to see if anything changed. We'll shut things down and let SetState start things up again
 		CWaitCursor wait;
-		if (newdata->sStation.compare(cfgdata.sCallsign) || newdata->cModule!=cfgdata.cModule) {	// the station callsign has changed
+		// the link only has to start over if the station changed, the gateway also reads
+		// the network, the location and your callsign once when it starts
+		const unsigned changed = CConfigure::Compare(cfgdata, *newdata);
+		if (changed & CFG_STATION) {
 			StopGate();
 			StopLink();
-		} else if (newdata->eNetType != cfgdata.eNetType) {
+		} else if ((changed & (CFG_NETWORK | CFG_LOCATION)) || cfgdata.sCallsign.compare(newdata->sCallsign)) {
 			StopGate();
 		}
+		if (cfgdata.bAcceptLinks != newdata->bAcceptLinks)
+			StopLink();	// the link reads this once when it starts
 
 		if (! newdata->bLinkEnable)
 			StopLink();
@@ -247,6 +266,8 @@ void CMainWindow::on_SettingsButton_clicked()
 			StopGate();
 
 		SetState(*newdata);
+		if (pGate && cfgdata.iCacheKB != newdata->iCacheKB)
+			pGate->SetCacheLimit(newdata->iCacheKB);
 		cfg.CopyTo(cfgdata);
 	}
 }
@@ -357,6 +378,15 @@ void CMainWindow::on_EchoTestButton_toggled()
 
 void CMainWindow::Receive(bool is_rx)
 {
+	is_receiving = is_rx;
+	if (! rx_pending.exchange(true))
+		RxDispatcher.emit();
+}
+
+void CMainWindow::on_RxDispatcher()
+{
+	rx_pending = false;
+	const bool is_rx = is_receiving;
 	pPTTButton->set_sensitive(!is_rx);
 	pEchoTestButton->set_sensitive(!is_rx);
 	pQuickKeyButton->set_sensitive(!is_rx);
@@ -386,78 +416,64 @@ void CMainWindow::on_QuickKeyButton_clicked()
 	AudioManager.QuickKey(pRouteEntry->get_text().c_str());
 }
 
-bool CMainWindow::RelayLink2AM(Glib::IOCondition condition)
+bool CMainWindow::DrainLog()
 {
-	if (condition & Glib::IO_IN) {
-		CDSVT dsvt;
-		Link2AM.Read(dsvt.title, 56);
-		if (0 == memcmp(dsvt.title, "DSVT", 4))
-			AudioManager.Link2AudioMgr(dsvt);
-		else if (0 == memcmp(dsvt.title, "PLAY", 4))
-			AudioManager.PlayFile((char *)&dsvt.config);
-	} else {
-		std::cerr << "RelayLink2AM not a read event!" << std::endl;
-	}
-	return true;
-}
+	// consecutive messages of the same level go in with one insert
+	std::string text;
+	ELogLevel level = ELogLevel::info;
+	auto append = [&]() {
+		if (text.size()) {
+			pLogTextBuffer->insert_with_tag(pLogTextBuffer->end(), text, pLogTag[int(level)]);
+			text.clear();
+		}
+	};
+	unsigned count = CLogRing::Drain([&](ELogLevel l, const char *line) {
+		if (l != level) {
+			append();
+			level = l;
+		}
+		text.append(line);
+	}, LOG_RING_SIZE);
+	append();
 
-bool CMainWindow::RelayGate2AM(Glib::IOCondition condition)
-{
-	if (condition & Glib::IO_IN) {
-		CDSVT dsvt;
-		Gate2AM.Read(dsvt.title, 56);
-		if (0 == memcmp(dsvt.title, "DSVT", 4))
-			AudioManager.Gateway2AudioMgr(dsvt);
-		else if (0 == memcmp(dsvt.title, "PLAY", 4))
-			AudioManager.PlayFile((char *)&dsvt.config);
-	} else {
-		std::cerr << "RelayGate2AM not a read event!" << std::endl;
+	unsigned dropped = CLogRing::Dropped();
+	if (dropped) {
+		text.assign(std::to_string(dropped) + " log messages were dropped\n");
+		level = ELogLevel::warning;
+		append();
 	}
+	if (0 == count && 0 == dropped)
+		return true;
+
+	int lines = pLogTextBuffer->get_line_count();
+	if (lines > LOG_MAX_LINES)
+		pLogTextBuffer->erase(pLogTextBuffer->begin(), pLogTextBuffer->get_iter_at_line(lines - LOG_MAX_LINES));
+	pLogTextView->scroll_to(pLogEndMark, 0.0, 0.0, 1.0);
 	return true;
 }
 
-bool CMainWindow::GetLogInput(Glib::IOCondition condition)
+void CMainWindow::on_LinkDispatcher()
 {
-	static auto it = pLogTextBuffer->begin();
-	if (condition & Glib::IO_IN) {
-		char line[256];
-		LogInput.Read(line, 256);
-		it = pLogTextBuffer->insert(it, line);
-		pLogTextView->scroll_to(it, 0.0, 0.0, 1.0);
-	} else {
-		std::cerr << "GetLogInput is not a read event!" << std::endl;
-	}
-	return true;
+	link_pending = false;
+	UpdateLinkWidgets();
 }
 
-bool CMainWindow::TimeoutProcess()
+void CMainWindow::UpdateLinkWidgets()
 {
 	// this is all about syncing the LinkFrame widgets to the actual link state of the module
-	// so if pLink is not up, then we don't need to do anything
-	if ((! cfgdata.bLinkEnable) || (nullptr == pLink))
-		return true;
-
-	std::list<CLink> linkstatus;
-	if (qnDB.FindLS(cfgdata.cModule, linkstatus))	// get the link status list of our module (there should only be one, or none if it's not linked)
-		return true;
-
-	std::string call;
-	if (linkstatus.size()) {	// extract the linked module from the returned list, if the list is empty, it means our module is not linked!
-		CLink ls(linkstatus.front());
-		call.assign(ls.callsign);
-	}
+	if (! cfgdata.bLinkEnable)
+		return;
 
-	if (call.empty()) {
+	if (linkstate.IsLinked()) {
+		pLinkEntry->set_sensitive(false);
+		pLinkButton->set_sensitive(false);
+		pUnlinkButton->set_sensitive(true);
+	} else {
 		pLinkEntry->set_sensitive(true);
 		pUnlinkButton->set_sensitive(false);
 		std::string s(pLinkEntry->get_text().c_str());
 		pLinkButton->set_sensitive((8==s.size() && isalpha(s.at(7)) && qnDB.FindGW(s.c_str())) ? true : false);
-	} else {
-		pLinkEntry->set_sensitive(false);
-		pLinkButton->set_sensitive(false);
-		pUnlinkButton->set_sensitive(true);
 	}
-	return true;
 }
 
 void CMainWindow::on_LinkEntry_changed()
@@ -503,45 +519,64 @@ void CMainWindow::on_UnlinkButton_clicked()
 void CMainWindow::RebuildGateways(bool includelegacy)
 {
 	CWaitCursor WaitCursor;
-	qnDB.ClearGW();
-	CHostQueue qhost;
-
-	std::string filename(CFG_DIR);	// now open the gateways text file
-	filename.append("gwys.txt");
-	int count = 0;
-	std::ifstream hostfile(filename);
-	if (hostfile.is_open()) {
-		std::string line;
-		while (std::getline(hostfile, line)) {
-			trim(line);
-			if (! line.empty() && ('#' != line.at(0))) {
-				std::istringstream iss(line);
-				std::string name, addr;
-				unsigned short port;
-				iss >> name >> addr >> port;
-				CHost host(name, addr, port);
-				qhost.Push(host);
-				count++;
-			}
-		}
-		hostfile.close();
-		qnDB.UpdateGW(qhost);
-	}
-
-	if (includelegacy && ! cfgdata.sStation.empty()) {
-		const std::string website("auth.dstargateway.org");
-		CDPlusAuthenticator auth(cfgdata.sStation, website);
-		int dplus = auth.Process(qnDB, true, false);
-		if (0 == dplus) {
-			fprintf(stdout, "DPlus Authorization failed.\n");
-			printf("# of Gateways: %s=%d\n", filename.c_str(), count);
-		} else {
-			fprintf(stderr, "DPlus Authorization completed!\n");
-			printf("# of Gateways %s=%d %s=%d Total=%d\n", filename.c_str(), count, website.c_str(), dplus, qnDB.Count("GATEWAYS"));
-		}
+	if (dplus_loaded && ! includelegacy) {
+		// a DPlus row may have replaced a host file row with the same name, so the host file is written again
+		dplus.Stop();
+		qnDB.ClearGW(EGWSource::dplus);
+		hostfile.Forget();
+		dplus_loaded = false;
+	}
+
+	// only the differences from the last load are applied
+	int count = hostfile.Load(qnDB);
+	if (count < 0)
+		count = 0;
+	const std::string &filename = hostfile.GetPath();
+
+	if (includelegacy && ! dplus_loaded && ! cfgdata.sStation.empty()) {
+		// the list is stored by HostFileCheck() when it arrives
+		dplus.Start(cfgdata.sStation, DPLUS_AUTH_SERVER, true, false);
+		dplus_loaded = true;
+		printf("# of Gateways: %s=%d, downloading the DPlus list from %s\n", filename.c_str(), count, DPLUS_AUTH_SERVER);
 	} else {
 		printf("#Gateways: %s=%d\n", filename.c_str(), count);
 	}
+	status.SetGateways(qnDB.Count("GATEWAYS"));
+}
+
+void CMainWindow::ConfigChanged(const CFGDATA &old, const CFGDATA &now)
+{
+	if (CConfigure::Compare(old, now) & (CFG_STATION | CFG_STATUS)) {
+		status.Stop();
+		if (now.bStatusEnable)
+			status.Start(now.usStatusPort, now.sStation, now.cModule, &linkstate);
+	}
+	if (old.bCaptureEnable!=now.bCaptureEnable || old.iCaptureMB!=now.iCaptureMB) {
+		if (now.bCaptureEnable)
+			CCapture::Open(std::string(CFG_DIR) + "qdv.cap", 1024UL * 1024UL * now.iCaptureMB);
+		else
+			CCapture::Close();
+	}
+}
+
+bool CMainWindow::HostFileCheck()
+{
+	bool changed = false;
+	if (hostfile.Changed()) {
+		hostfile.Load(qnDB);
+		changed = true;
+	}
+	int count = dplus.Store(qnDB);
+	if (count >= 0) {
+		fprintf(stderr, "DPlus Authorization completed!\n");
+		printf("# of Gateways %s=%d Total=%d\n", DPLUS_AUTH_SERVER, count, qnDB.Count("GATEWAYS"));
+		changed = true;
+	}
+	if (changed) {
+		status.SetGateways(qnDB.Count("GATEWAYS"));
+		on_LinkEntry_changed();	// the link target may have come or gone
+	}
+	return true;
 }
 
 int main (int argc, char **argv)
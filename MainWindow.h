@@ -19,12 +19,18 @@
 #pragma once
 
 #include <future>
+#include <atomic>
 #include <gtkmm.h>
 
 #include "Configure.h"
 #include "QnetGateway.h"
 #include "QnetLink.h"
+#include "LinkState.h"
+#include "LogRing.h"
+#include "StatusServer.h"
 #include "QnetDB.h"
+#include "HostFile.h"
+#include "DPlusAuthenticator.h"
 #include "SettingsDlg.h"
 #include "AboutDlg.h"
 #include "AudioManager.h"
@@ -41,13 +47,15 @@ public:
 
 	bool Init(const Glib::RefPtr<Gtk::Builder>, const Glib::ustring &);
 	void Run();
-	void Receive(bool is_rx);
+	void Receive(bool is_rx);	// this is called from the audio dispatch thread
 	void RebuildGateways(bool includelegacy);
 private:
 	// classes
 	CSettingsDlg SettingsDlg;
 	CAboutDlg AboutDlg;
 	CQnetDB qnDB;
+	CHostFile hostfile;
+	CDPlusAuthenticator dplus;
 
 	// widgets
 	Gtk::Window *pWin;
@@ -57,12 +65,16 @@ private:
 	Gtk::ToggleButton *pEchoTestButton, *pPTTButton;
 	Gtk::MenuItem *pAboutMenuItem;
 	Glib::RefPtr<Gtk::TextBuffer> pLogTextBuffer;
+	Glib::RefPtr<Gtk::TextBuffer::Mark> pLogEndMark;
+	Glib::RefPtr<Gtk::TextBuffer::Tag> pLogTag[4];	// one for each ELogLevel
 	Gtk::ScrolledWindow *pScrolledWindow;
 	Gtk::TextView *pLogTextView;
 
 	// state data
 	std::set<Glib::ustring> routeset;
 	CFGDATA cfgdata;
+	bool dplus_loaded;
+	int cfg_subscription;
 
 	// helpers
 	void ReadRoutes();
@@ -75,7 +87,15 @@ private:
 	void RunGate();
 	void StopLink();
 	void StopGate();
-	CUnixDgramReader Gate2AM, Link2AM, LogInput;
+	// receive state changes from the audio manager are coalesced into one GUI update
+	Glib::Dispatcher RxDispatcher;
+	std::atomic<bool> is_receiving, rx_pending;
+	// and so are link state changes from CQnetLink
+	CLinkState linkstate;
+	Glib::Dispatcher LinkDispatcher;
+	std::atomic<bool> link_pending;
+	void UpdateLinkWidgets();
+	CStatusServer status;
 	CAPRS aprs;
 
 	// events
@@ -91,8 +111,9 @@ private:
 	void on_UnlinkButton_clicked();
 	void on_LinkEntry_changed();
 	void on_AboutMenuItem_activate();
-	bool RelayLink2AM(Glib::IOCondition condition);
-	bool RelayGate2AM(Glib::IOCondition condition);
-	bool GetLogInput(Glib::IOCondition condition);
-	bool TimeoutProcess();
+	void on_RxDispatcher();
+	bool DrainLog();
+	void on_LinkDispatcher();
+	bool HostFileCheck();
+	void ConfigChanged(const CFGDATA &old, const CFGDATA &now);
 };
@@ -0,0 +1,89 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cstring>
+
+#include "PeerTable.h"
+
+CPeerTable::CPeerTable()
+{
+	Clear();
+}
+
+void CPeerTable::Clear()
+{
+	for (unsigned i=0; i<MAX_PEERS; i++)
+		table[i].in_use = false;
+	count = 0;
+}
+
+SPEER *CPeerTable::Add(EPeerProto proto, bool inbound)
+{
+	for (unsigned i=0; i<MAX_PEERS; i++) {
+		SPEER &p = table[i];
+		if (p.in_use)
+			continue;
+		p.in_use = true;
+		p.proto = proto;
+		p.inbound = inbound;
+		memset(p.to_call, 0, CALL_SIZE + 1);
+		p.addr.Clear();
+		p.from_mod = p.to_mod = ' ';
+		p.deadline = 0U;
+		for (int t=0; t<PEER_TIMERS; t++)
+			p.timers[t] = 0U;
+		p.is_connected = false;
+		p.in_streamid = p.out_streamid = 0U;
+		p.in_ctrl = 0xffU;
+		p.dcs_seq = 0U;
+		p.pending_address.clear();
+		p.pending_port = 0U;
+		p.pending_time = 0;
+		count++;
+		return &p;
+	}
+	return nullptr;
+}
+
+void CPeerTable::Remove(SPEER *peer)
+{
+	if (peer->in_use) {
+		peer->in_use = false;
+		count--;
+	}
+}
+
+SPEER *CPeerTable::Find(const CSockAddress &addr)
+{
+	for (unsigned i=0; i<MAX_PEERS; i++) {
+		// CSockAddress::operator== doesn't compare the ports
+		if (table[i].in_use && addr==table[i].addr && addr.GetPort()==table[i].addr.GetPort())
+			return table + i;
+	}
+	return nullptr;
+}
+
+SPEER *CPeerTable::Find(const char *call, char mod)
+{
+	for (unsigned i=0; i<MAX_PEERS; i++) {
+		const SPEER &p = table[i];
+		if (p.in_use && ! p.inbound && mod==p.to_mod && 0==strncmp(call, p.to_call, CALL_SIZE))
+			return table + i;
+	}
+	return nullptr;
+}
@@ -0,0 +1,79 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <ctime>
+#include <cstdint>
+#include <string>
+
+#include "SockAddress.h"
+
+#define CALL_SIZE 8
+// links we made plus dongles and repeaters linked to us
+#define MAX_PEERS 32
+
+enum class EPeerProto { xrf, ref, dcs };
+
+// the timers each peer can have running
+enum class EPeerTimer { heartbeat, timeout, resolve };
+#define PEER_TIMERS 3
+
+// a linked reflector or repeater, or a dongle or repeater that linked to us
+using SPEER = struct peer_tag {
+	bool in_use;
+	EPeerProto proto;
+	bool inbound;					// it linked to us
+	char to_call[CALL_SIZE + 1];	// the other end, an inbound peer's own callsign
+	CSockAddress addr;
+	char from_mod;					// our module
+	char to_mod;					// the module at the other end
+	uint64_t deadline;				// in ms, it times out if nothing is heard from it by then
+	uint64_t timers[PEER_TIMERS];	// when each EPeerTimer is armed, 0 if it isn't
+	bool is_connected;
+	unsigned short in_streamid;		// incoming from the peer
+	unsigned char in_ctrl;			// the last dcs frame counter from the peer
+	unsigned short out_streamid;	// the stream the peer was sent a header for
+	unsigned dcs_seq;				// dcs frames sent to the peer in this stream
+	// a link waiting on the resolver
+	std::string pending_address;
+	unsigned short pending_port;
+	time_t pending_time;
+};
+
+// Peers stay in the slot they were added to, so a slot index identifies a peer until it's removed.
+class CPeerTable
+{
+public:
+	CPeerTable();
+	void Clear();
+	// a cleared entry, or nullptr if the table is full
+	SPEER *Add(EPeerProto proto, bool inbound);
+	void Remove(SPEER *peer);
+	// nullptr if there is no peer at addr and port
+	SPEER *Find(const CSockAddress &addr);
+	// the link we made to call and mod, nullptr if there isn't one
+	SPEER *Find(const char *call, char mod);
+	unsigned Size() const { return count; }
+	// for walking the table, nullptr if slot i is empty
+	SPEER *At(unsigned i) { return table[i].in_use ? table + i : nullptr; }
+	int Index(const SPEER *peer) const { return int(peer - table); }
+
+private:
+	SPEER table[MAX_PEERS];
+	unsigned count;
+};
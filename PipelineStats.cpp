@@ -0,0 +1,169 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <time.h>
+#include <atomic>
+
+#include "PipelineStats.h"
+
+#define NSTAGES int(EStage::count)
+#define NCOUNTERS int(ECounter::count)
+#define NQUEUES int(EQueue::count)
+
+using SHISTOGRAM = struct histogram_tag {
+	std::atomic<uint64_t> count, sum, max;	// microseconds
+	std::atomic<uint64_t> bucket[STATS_BUCKETS];
+};
+
+static SHISTOGRAM histogram[NSTAGES];
+static std::atomic<uint64_t> counter[NCOUNTERS];
+static std::atomic<unsigned> depth[NQUEUES], maxdepth[NQUEUES];
+
+static const char *stage_name[NSTAGES] = { "capture", "encode", "packetize", "send", "tx_total", "receive", "decode", "playout", "rx_total" };
+static const char *counter_name[NCOUNTERS] = { "capture_overrun", "playout_underrun", "device_error", "frame_dropped", "pool_exhausted" };
+static const char *queue_name[NQUEUES] = { "audio", "ambe", "gateway", "link" };
+
+static void Record(EStage stage, uint64_t ns)
+{
+	const uint64_t us = ns / 1000U;
+	int b = us ? 64 - __builtin_clzll(us) : 0;
+	if (b >= STATS_BUCKETS)
+		b = STATS_BUCKETS - 1;
+	SHISTOGRAM &h = histogram[int(stage)];
+	h.count.fetch_add(1, std::memory_order_relaxed);
+	h.sum.fetch_add(us, std::memory_order_relaxed);
+	h.bucket[b].fetch_add(1, std::memory_order_relaxed);
+	uint64_t m = h.max.load(std::memory_order_relaxed);
+	while (us > m && ! h.max.compare_exchange_weak(m, us, std::memory_order_relaxed))
+		;
+}
+
+uint64_t CPipelineStats::Now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000U + ts.tv_nsec;
+}
+
+void CPipelineStats::Origin(STIMESTAMP &ts, uint64_t when)
+{
+	ts.origin = ts.last = when;
+}
+
+void CPipelineStats::Mark(EStage stage, STIMESTAMP &ts, uint64_t when)
+{
+	if (0 == ts.origin)
+		return;
+	if (0 == when)
+		when = Now();
+	Record(stage, (when > ts.last) ? when - ts.last : 0);
+	ts.last = when;
+}
+
+void CPipelineStats::Total(EStage stage, const STIMESTAMP &ts)
+{
+	if (ts.origin)
+		Record(stage, ts.last - ts.origin);
+}
+
+void CPipelineStats::Count(ECounter c)
+{
+	counter[int(c)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void CPipelineStats::Depth(EQueue queue, unsigned d)
+{
+	const int q = int(queue);
+	depth[q].store(d, std::memory_order_relaxed);
+	unsigned m = maxdepth[q].load(std::memory_order_relaxed);
+	while (d > m && ! maxdepth[q].compare_exchange_weak(m, d, std::memory_order_relaxed))
+		;
+}
+
+void CPipelineStats::Reset()
+{
+	for (int s=0; s<NSTAGES; s++) {
+		histogram[s].count = histogram[s].sum = histogram[s].max = 0;
+		for (int b=0; b<STATS_BUCKETS; b++)
+			histogram[s].bucket[b] = 0;
+	}
+	for (int c=0; c<NCOUNTERS; c++)
+		counter[c] = 0;
+	for (int q=0; q<NQUEUES; q++)
+		maxdepth[q] = depth[q].load();
+}
+
+// the upper bound of the bucket that holds the given fraction of the samples
+static uint64_t Percentile(const uint64_t *buckets, uint64_t count, double fraction)
+{
+	const uint64_t target = uint64_t(fraction * count + 0.5);
+	uint64_t sum = 0;
+	for (int b=0; b<STATS_BUCKETS; b++) {
+		sum += buckets[b];
+		if (sum >= target && sum)
+			return 1ULL << b;
+	}
+	return 1ULL << (STATS_BUCKETS - 1);
+}
+
+std::string CPipelineStats::JSON()
+{
+	std::string json("{\"stages\":{");
+	for (int s=0; s<NSTAGES; s++) {
+		const SHISTOGRAM &h = histogram[s];
+		uint64_t buckets[STATS_BUCKETS];
+		uint64_t count = 0;
+		for (int b=0; b<STATS_BUCKETS; b++) {
+			buckets[b] = h.bucket[b].load(std::memory_order_relaxed);
+			count += buckets[b];
+		}
+		if (s)
+			json.append(",");
+		json.append("\"").append(stage_name[s]).append("\":{\"count\":").append(std::to_string(count));
+		if (count) {
+			json.append(",\"mean_us\":").append(std::to_string(h.sum.load(std::memory_order_relaxed) / count));
+			json.append(",\"max_us\":").append(std::to_string(h.max.load(std::memory_order_relaxed)));
+			json.append(",\"p50_us\":").append(std::to_string(Percentile(buckets, count, 0.5)));
+			json.append(",\"p90_us\":").append(std::to_string(Percentile(buckets, count, 0.9)));
+			json.append(",\"p99_us\":").append(std::to_string(Percentile(buckets, count, 0.99)));
+			json.append(",\"buckets\":[");
+			for (int b=0; b<STATS_BUCKETS; b++) {
+				if (b)
+					json.append(",");
+				json.append(std::to_string(buckets[b]));
+			}
+			json.append("]");
+		}
+		json.append("}");
+	}
+	json.append("},\"counters\":{");
+	for (int c=0; c<NCOUNTERS; c++) {
+		if (c)
+			json.append(",");
+		json.append("\"").append(counter_name[c]).append("\":").append(std::to_string(counter[c].load(std::memory_order_relaxed)));
+	}
+	json.append("},\"queues\":{");
+	for (int q=0; q<NQUEUES; q++) {
+		if (q)
+			json.append(",");
+		json.append("\"").append(queue_name[q]).append("\":{\"depth\":").append(std::to_string(depth[q].load(std::memory_order_relaxed)));
+		json.append(",\"max\":").append(std::to_string(maxdepth[q].load(std::memory_order_relaxed))).append("}");
+	}
+	json.append("}}");
+	return json;
+}
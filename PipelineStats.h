@@ -0,0 +1,52 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cstdint>
+#include <string>
+
+// The voice pipeline stages, in the order a frame passes through them. Each stage records
+// the time since the frame left the previous stage. The totals record the time from the
+// first stage to the last.
+enum class EStage { capture, encode, packetize, send, tx_total, receive, decode, playout, rx_total, count };
+enum class ECounter { capture_overrun, playout_underrun, device_error, frame_dropped, pool_exhausted, count };
+enum class EQueue { audio, ambe, gateway, link, count };
+
+#define STATS_BUCKETS 24	// power of two microsecond buckets, the last one holds everything over 4 seconds
+
+// CLOCK_MONOTONIC nanoseconds, zero means the frame isn't being timed
+using STIMESTAMP = struct timestamp_tag {
+	uint64_t origin, last;
+};
+
+// Everything is a relaxed atomic, so it's cheap enough to leave on.
+class CPipelineStats
+{
+public:
+	static uint64_t Now();
+	static void Origin(STIMESTAMP &ts, uint64_t when);
+	static void Clear(STIMESTAMP &ts) { ts.origin = ts.last = 0; }
+	// record the time from ts.last to when (or now), then move ts.last there
+	static void Mark(EStage stage, STIMESTAMP &ts, uint64_t when = 0);
+	// record the time from ts.origin to ts.last
+	static void Total(EStage stage, const STIMESTAMP &ts);
+	static void Count(ECounter counter);
+	static void Depth(EQueue queue, unsigned depth);
+	static void Reset();
+	static std::string JSON();
+};
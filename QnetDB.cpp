@@ -17,16 +17,29 @@
  */
 
 #include <string>
+#include <cstring>
 #include <thread>
 
 #include "QnetDB.h"
 
+CQnetDB::~CQnetDB()
+{
+	if (gwstmt)
+		sqlite3_finalize(gwstmt);
+	if (gwdelstmt)
+		sqlite3_finalize(gwdelstmt);
+	if (db)
+		sqlite3_close(db);
+}
+
 bool CQnetDB::Open(const char *name)
 {
 	if (sqlite3_open_v2(name, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL)) {
 		fprintf(stderr, "CQnetDB::Open: can't open %s\n", name);
 		return true;
 	}
+	// the gateway, the link and the main thread each have a connection, a short write by another one is waited out
+	sqlite3_busy_timeout(db, 500);
 
 	return Init();
 }
@@ -63,10 +76,24 @@ bool CQnetDB::Init()
 		return true;
 	}
 
+	// a GATEWAYS table from an older version doesn't know who wrote its rows, it's reloaded at start up anyway
+	sqlite3_stmt *stmt;
+	if (SQLITE_OK == sqlite3_prepare_v2(db, "SELECT name FROM GATEWAYS;", -1, &stmt, 0)) {
+		sqlite3_finalize(stmt);
+		if (SQLITE_OK == sqlite3_prepare_v2(db, "SELECT source FROM GATEWAYS;", -1, &stmt, 0))
+			sqlite3_finalize(stmt);
+		else if (SQLITE_OK != sqlite3_exec(db, "DROP TABLE GATEWAYS;", NULL, 0, &eMsg)) {
+			fprintf(stderr, "CQnetDB::Open drop table GATEWAYS error: %s\n", eMsg);
+			sqlite3_free(eMsg);
+			return true;
+		}
+	}
+
 	sql.assign("CREATE TABLE IF NOT EXISTS GATEWAYS("
 					"name		TEXT PRIMARY KEY, "
 					"address	TEXT NOT NULL, "
-					"port		INT NOT NULL"
+					"port		INT NOT NULL, "
+					"source		INT NOT NULL"
 				") WITHOUT ROWID;");
 
 	if (SQLITE_OK != sqlite3_exec(db, sql.c_str(), NULL, 0, &eMsg)) {
@@ -128,49 +155,93 @@ bool CQnetDB::UpdateLS(const char *address, const char from_mod, const char *to_
 	return false;
 }
 
-bool CQnetDB::UpdateGW(const char *name, const char *address, unsigned short port)
+bool CQnetDB::BeginGW()
 {
 	if (NULL == db)
 		return true;
-	std::string n(name);
-	n.resize(6, ' ');
-	std::string sql = "INSERT OR REPLACE INTO GATEWAYS (name,address,port) VALUES ('";
-	sql.append(n);
-	sql.append("','");
-	sql.append(address);
-	sql.append("',");
-	sql.append(std::to_string(port));
-	sql.append(");");
 
 	char *eMsg;
-	if (SQLITE_OK != sqlite3_exec(db, sql.c_str(), NULL, 0, &eMsg)) {
-		fprintf(stderr, "CQnetDB::UpdateGW error: %s\n", eMsg);
+	if (SQLITE_OK != sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, 0, &eMsg)) {
+		fprintf(stderr, "CQnetDB::BeginGW BEGIN TRANSATION error: %s\n", eMsg);
 		sqlite3_free(eMsg);
 		return true;
 	}
 
+	// the statement is prepared once and reused for every row of every load
+	if (NULL == gwstmt) {
+		if (SQLITE_OK != sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO GATEWAYS (name,address,port,source) SELECT ?1,?2,?3,?4 WHERE NOT EXISTS (SELECT 1 FROM GATEWAYS WHERE name==?1 AND source>?4);", -1, &gwstmt, 0)) {
+			fprintf(stderr, "CQnetDB::BeginGW prepare_v2 error: %s\n", sqlite3_errmsg(db));
+			gwstmt = NULL;
+			sqlite3_exec(db, "ROLLBACK TRANSACTION;", NULL, 0, NULL);
+			return true;
+		}
+	}
 	return false;
 }
 
-bool CQnetDB::UpdateGW(CHostQueue &hqueue)
+bool CQnetDB::AddGW(EGWSource source, const char *name, const char *address, unsigned short port)
 {
-	if (NULL == db)
-		return false;
+	return AddGW(source, name, strlen(name), address, strlen(address), port);
+}
 
-	char *eMsg;
-	if (SQLITE_OK != sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, 0, &eMsg)) {
-		fprintf(stderr, "CQnetDB::UpdateGW BEGIN TRANSATION error: %s\n", eMsg);
-		sqlite3_free(eMsg);
+bool CQnetDB::AddGW(EGWSource source, const char *name, size_t nlen, const char *address, size_t alen, unsigned short port)
+// name and address don't need to be null terminated, the name is space padded to six characters
+{
+	if (NULL == gwstmt)
+		return true;
+
+	char n[7] = "      ";
+	memcpy(n, name, (nlen > 6) ? 6 : nlen);
+
+	sqlite3_bind_text(gwstmt, 1, n, 6, SQLITE_TRANSIENT);
+	sqlite3_bind_text(gwstmt, 2, address, int(alen), SQLITE_TRANSIENT);
+	sqlite3_bind_int(gwstmt, 3, port);
+	sqlite3_bind_int(gwstmt, 4, int(source));
+
+	int rval = sqlite3_step(gwstmt);
+	sqlite3_reset(gwstmt);
+	if (SQLITE_DONE != rval) {
+		fprintf(stderr, "CQnetDB::AddGW error: %s\n", sqlite3_errmsg(db));
+		return true;
+	}
+	return false;
+}
+
+bool CQnetDB::DelGW(EGWSource source, const char *name)
+{
+	if (NULL == db)
 		return true;
+
+	if (NULL == gwdelstmt) {
+		if (SQLITE_OK != sqlite3_prepare_v2(db, "DELETE FROM GATEWAYS WHERE name==?1 AND source==?2;", -1, &gwdelstmt, 0)) {
+			fprintf(stderr, "CQnetDB::DelGW prepare_v2 error: %s\n", sqlite3_errmsg(db));
+			gwdelstmt = NULL;
+			return true;
+		}
 	}
 
-	while (! hqueue.Empty()) {
-		auto h = hqueue.Pop();
-		UpdateGW(h.name.c_str(), h.addr.c_str(), h.port);
+	std::string n(name);
+	n.resize(6, ' ');
+	sqlite3_bind_text(gwdelstmt, 1, n.c_str(), 6, SQLITE_TRANSIENT);
+	sqlite3_bind_int(gwdelstmt, 2, int(source));
+
+	int rval = sqlite3_step(gwdelstmt);
+	sqlite3_reset(gwdelstmt);
+	if (SQLITE_DONE != rval) {
+		fprintf(stderr, "CQnetDB::DelGW error: %s\n", sqlite3_errmsg(db));
+		return true;
 	}
+	return false;
+}
+
+bool CQnetDB::EndGW()
+{
+	if (NULL == db)
+		return true;
 
+	char *eMsg;
 	if (SQLITE_OK != sqlite3_exec(db, "COMMIT TRANSACTION;", NULL, 0, &eMsg)) {
-		fprintf(stderr, "CQnetDB::UpdateGW COMMIT TRANSACTION error: %s\n", eMsg);
+		fprintf(stderr, "CQnetDB::EndGW COMMIT TRANSACTION error: %s\n", eMsg);
 		sqlite3_free(eMsg);
 		return true;
 	}
@@ -319,6 +390,23 @@ void CQnetDB::ClearGW()
 	}
 }
 
+void CQnetDB::ClearGW(EGWSource source)
+{
+	if (NULL == db)
+		return;
+
+	std::string sql("DELETE FROM GATEWAYS WHERE source==");
+	sql.append(std::to_string(int(source)));
+	sql.append(";");
+
+	char *eMsg;
+
+	if (SQLITE_OK != sqlite3_exec(db, sql.c_str(), NULL, 0, &eMsg)) {
+		fprintf(stderr, "CQnetDB::ClearGW error: %s\n", eMsg);
+		sqlite3_free(eMsg);
+	}
+}
+
 static int countcallback(void *count, int /*argc*/, char **argv, char **/*azColName*/) {
     auto c = (int *)count;
     *c = atoi(argv[0]);
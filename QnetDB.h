@@ -22,8 +22,6 @@
 #include <string>
 #include <list>
 
-#include "HostQueue.h"
-
 class CLink {
 public:
 	CLink(const std::string &call, const unsigned char *addr, time_t ltime) : callsign(call) , address((const char *)addr) , linked_time(ltime) {}
@@ -49,14 +47,22 @@ public:
 	time_t linked_time;
 };
 
+// who wrote a GATEWAYS row, a row from a later source isn't replaced or deleted by an earlier one
+enum class EGWSource { hostfile, dplus };
+
 class CQnetDB {
 public:
-	CQnetDB() : db(NULL) {}
-	~CQnetDB() { if (db) sqlite3_close(db); }
+	CQnetDB() : db(NULL), gwstmt(NULL), gwdelstmt(NULL) {}
+	~CQnetDB();
 	bool Open(const char *name);
 	bool UpdateLH(const char *callsign, const char *sfx, const char module, const char *reflector);
 	bool UpdateLS(const char *address, const char from_mod, const char *to_callsign, const char to_mod, time_t connect_time);
-	bool UpdateGW(CHostQueue &);
+	// bulk gateway loading: BeginGW(), any number of AddGW(), then EndGW()
+	bool BeginGW();
+	bool AddGW(EGWSource source, const char *name, const char *address, unsigned short port);
+	bool AddGW(EGWSource source, const char *name, size_t nlen, const char *address, size_t alen, unsigned short port);
+	bool DelGW(EGWSource source, const char *name);
+	bool EndGW();
 	bool DeleteLS(const char *address);
 	bool FindLS(const char mod, std::list<CLink> &linklist);
 	bool FindGW(const char *name, std::string &address, unsigned short &port);
@@ -64,10 +70,11 @@ public:
 	void ClearLH();
 	void ClearLS();
 	void ClearGW();
+	void ClearGW(EGWSource source);
 	int Count(const char *table);
 
 private:
 	bool Init();
-	bool UpdateGW(const char *name, const char *address, unsigned short port);
 	sqlite3 *db;
+	sqlite3_stmt *gwstmt, *gwdelstmt;
 };
@@ -46,6 +46,8 @@
 #include "IRCutils.h"
 #include "DStarDecode.h"
 #include "QnetGateway.h"
+#include "PipelineStats.h"
+#include "Capture.h"
 
 #ifndef CFG_DIR
 #define CFG_DIR "/tmp/"
@@ -91,20 +93,21 @@ void CQnetGateway::UnpackCallsigns(const std::string &str, std::set<std::string>
 
 void CQnetGateway::PrintCallsigns(const std::string &key, const std::set<std::string> &set)
 {
-	log.SendLog("%s = [", key.c_str());
+	// one message, so the list isn't broken up by timestamps
+	std::string line(key + " = [");
 	for (auto it=set.begin(); it!=set.end(); it++) {
 		if (it != set.begin())
-			log.SendLog(",");
-		log.SendLog("%s", (*it).c_str());
+			line.append(",");
+		line.append(*it);
 	}
-	log.SendLog("]\n");
+	log.SendLog("%s]\n", line.c_str());
 }
 
 
-void CQnetGateway::set_dest_rptr(std::string &call)
+void CQnetGateway::set_dest_rptr(char module, std::string &call)
 {
 	std::list<CLink> linklist;
-	if (qnDB.FindLS(pCFGData->cModule, linklist))
+	if (qnDB.FindLS(module, linklist))
 		return;
 
 	auto count = linklist.size();
@@ -286,13 +289,13 @@ int CQnetGateway::open_port(const SPORTIP *pip, int family)
 
 	int sock = socket(family, SOCK_DGRAM, 0);
 	if (0 > sock) {
-		log.SendLog("Failed to create socket on %s:%d, errno=%d, %s\n", pip->ip.c_str(), pip->port, errno, strerror(errno));
+		log.SendLog(ELogLevel::error, "Failed to create socket on %s:%d, errno=%d, %s\n", pip->ip.c_str(), pip->port, errno, strerror(errno));
 		return -1;
 	}
 	fcntl(sock, F_SETFL, O_NONBLOCK);
 
 	if (bind(sock, sin.GetPointer(), sizeof(struct sockaddr_storage)) != 0) {
-		log.SendLog("Failed to bind %s:%d, errno=%d, %s\n", pip->ip.c_str(), pip->port, errno, strerror(errno));
+		log.SendLog(ELogLevel::error, "Failed to bind %s:%d, errno=%d, %s\n", pip->ip.c_str(), pip->port, errno, strerror(errno));
 		close(sock);
 		return -1;
 	}
@@ -327,8 +330,8 @@ void CQnetGateway::GetIRCDataThread(const int i)
 			}
 			if (doFind) {
 				log.SendLog("Finding Routes for...\n");
+				// they are queued and sent a few at a time by the irc client
 				for (auto it=findRoute.begin(); it!=findRoute.end(); it++) {
-					std::this_thread::sleep_for(std::chrono::milliseconds(800));
 					log.SendLog("\t'%s'\n", it->c_str());
 					ii[i]->findUser(*it);
 				}
@@ -363,15 +366,20 @@ void CQnetGateway::GetIRCDataThread(const int i)
 					ii[i]->receivePing(rptr);
 					if (! rptr.empty()) {
 						ReplaceChar(rptr, '_', ' ');
-						ii[i]->cache.findRptrData(rptr, gate, addr);
+						int source;
+						cache.findRptrData(rptr, gate, addr, source);
 						if (addr.empty())
 							break;
+						// the address has the family of the connection it came from
+						const int sock = (g2_sock[source] < 0) ? g2_sock[0] : g2_sock[source];
+						if (sock < 0)
+							break;
 						CSockAddress to;
-						if (addr.npos == rptr.find(':'))
+						if (AF_INET == af_family[source])
 							to.Initialize(AF_INET, (unsigned short)g2_external.port, addr.c_str());
 						else
 							to.Initialize(AF_INET6, (unsigned short)g2_ipv6_external.port, addr.c_str());
-						sendto(g2_sock[i], "PONG", 4, 0, to.GetCPointer(), to.GetSize());
+						sendto(sock, "PONG", 4, 0, to.GetCPointer(), to.GetSize());
 						if (LOG_QSO)
 							printf("Sent 'PONG' to %s\n", addr.c_str());
 					}
@@ -388,11 +396,11 @@ void CQnetGateway::GetIRCDataThread(const int i)
 }
 
 /* return codes: 0=OK(found it), 1=TRY AGAIN, 2=FAILED(bad data) */
-int CQnetGateway::get_yrcall_rptr_from_cache(const int i, const std::string &call, std::string &rptr, std::string &gate, std::string &addr, char RoU)
+int CQnetGateway::get_yrcall_rptr_from_cache(const std::string &call, std::string &rptr, std::string &gate, std::string &addr, char RoU, int &source)
 {
 	switch (RoU) {
 		case 'U':
-			ii[i]->cache.findUserData(call, rptr, gate, addr);
+			cache.findUserData(call, rptr, gate, addr, source);
 			if (rptr.empty()) {
 				printf("Could not find last heard repeater for user '%s'\n", call.c_str());
 				return 1;
@@ -400,7 +408,7 @@ int CQnetGateway::get_yrcall_rptr_from_cache(const int i, const std::string &cal
 			break;
 		case 'R':
 			rptr.assign(call);
-			ii[i]->cache.findRptrData(call, gate, addr);
+			cache.findRptrData(call, gate, addr, source);
 			break;
 		default:
 			fprintf(stderr, "ERROR: Invalid Rou of '%c'\n", RoU);
@@ -423,32 +431,43 @@ int CQnetGateway::get_yrcall_rptr_from_cache(const int i, const std::string &cal
 int CQnetGateway::get_yrcall_rptr(const std::string &call, std::string &rptr, std::string &gate, std::string &addr, char RoU)
 // returns 0 if unsuccessful, otherwise returns ii index plus one
 {
-	int rval[2] = { 1, 1 };
-	for (int i=0; i<2; i++) {
-		if (ii[i]) {
-			rval[i] = get_yrcall_rptr_from_cache(i, call, rptr, gate, addr, RoU);
-			if (0 == rval[i])
-				return i + 1;
-		}
+	int source;
+	const int rval = get_yrcall_rptr_from_cache(call, rptr, gate, addr, RoU, source);
+	if (0 == rval) {
+		// the address is sent to on the socket of the connection that learned it,
+		// two connections of the same family share the first one's
+		if (g2_sock[source] < 0 && af_family[0] == af_family[source])
+			source = 0;
+		return source + 1;
 	}
+	if (1 != rval)
+		return 0;
 
 	/* at this point, the data is not in cache */
+	bool connected = false;
 	for (int i=0; i<2; i++) {
-		if (ii[i] && (1 == rval[i])) {
-			if (ii[i]->getConnectionState() > 5) {
-				// we can try a find
-				if (RoU == 'U') {
-					printf("User [%s] not in local cache, try again\n", call.c_str());
-					/*** YRCALL=KJ4NHFBL ***/
-					if (((call.at(6) == 'A') || (call.at(6) == 'B') || (call.at(6) == 'C')) && (call.at(7) == 'L'))
-						printf("If this was a gateway link request, that is ok\n");
-					if (!ii[i]->findUser(call))
-						printf("findUser(%s): Network error\n", call.c_str());
-				} else if (RoU == 'R') {
-					printf("Repeater [%s] not found\n", call.c_str());
-				}
-			}
+		if (ii[i] && ii[i]->getConnectionState() > 5)
+			connected = true;
+	}
+	if (! connected)
+		return 0;
+	// we can try a find
+	if (RoU == 'U') {
+		if (cache.isNotFound(call)) {
+			printf("User [%s] is not known to the irc server\n", call.c_str());
+			return 0;
 		}
+		printf("User [%s] not in local cache, try again\n", call.c_str());
+		/*** YRCALL=KJ4NHFBL ***/
+		if (((call.at(6) == 'A') || (call.at(6) == 'B') || (call.at(6) == 'C')) && (call.at(7) == 'L'))
+			printf("If this was a gateway link request, that is ok\n");
+		// both servers are asked, the first answer goes into the cache for both
+		for (int i=0; i<2; i++) {
+			if (ii[i] && ii[i]->getConnectionState() > 5 && ! ii[i]->findUser(call))
+				printf("findUser(%s): Network error\n", call.c_str());
+		}
+	} else if (RoU == 'R') {
+		printf("Repeater [%s] not found\n", call.c_str());
 	}
 	return 0;
 }
@@ -459,87 +478,138 @@ bool CQnetGateway::Flag_is_ok(unsigned char flag)
 	return 0x00U==flag || 0x08U==flag || 0x20U==flag || 0x28U==flag;
 }
 
-void CQnetGateway::ProcessTimeouts()
+void CQnetGateway::ModuleTimeouts(SMODULE &mod)
 {
-	{
-		time_t t_now;
-		// any stream going to local repeater timed out?
-		if (toRptr.last_time != 0) {
-			time(&t_now);
-			//   The stream can be from a cross-band, or from a remote system,
-			//   so we could use either FROM_LOCAL_RPTR_TIMEOUT or FROM_REMOTE_G2_TIMEOUT
-			//   but FROM_REMOTE_G2_TIMEOUT makes more sense, probably is a bigger number
-			if ((t_now - toRptr.last_time) > TIMING_TIMEOUT_REMOTE_G2) {
-				log.SendLog("Inactivity to local rptr module %c, removing stream id %04x\n", pCFGData->cModule, ntohs(toRptr.streamid));
-
-				// Send end_of_audio to local repeater.
-				// Let the repeater re-initialize
-				end_of_audio.streamid = toRptr.streamid;
-				end_of_audio.ctrl = toRptr.sequence | 0x40;
-				if (toRptr.sequence) {
-					const unsigned char silence[3] = { 0x70U, 0x4FU, 0x93U };
-					memcpy(end_of_audio.vasd.text, silence, 3U);
-				} else {
-					const unsigned char sync[3] = { 0x55U, 0x2DU, 0x16U };
-					memcpy(end_of_audio.vasd.text, sync, 12U);
-				}
-
-				Gate2AM.Write(end_of_audio.title, 27);
+	const uint64_t now = CTimerWheel::Now();
+	mod.timers.Expire(now, mod.due);
+	for (const auto key : mod.due) {
+		SSTREAM *stream = mod.streams.Find(key);
+		if (stream && CTimerWheel::Due(stream->timer, now))
+			StreamTimeout(mod, *stream, key, now);
+	}
+	mod.due.clear();
+	// something that was waiting can play now
+	if (nullptr == Playing(mod))
+		PlayNext(mod);
+}
 
+// The timer is armed when the stream starts, and every time it comes back early it's armed again for
+// when the stream would really time out, so nothing has to be done to the wheel when a frame arrives.
+void CQnetGateway::StreamTimeout(SMODULE &mod, SSTREAM &stream, uint64_t key, uint64_t now)
+{
+	// any stream going to local repeater timed out?
+	//   The stream can be from a cross-band, or from a remote system,
+	//   so we could use either FROM_LOCAL_RPTR_TIMEOUT or FROM_REMOTE_G2_TIMEOUT
+	//   but FROM_REMOTE_G2_TIMEOUT makes more sense, probably is a bigger number
+	if (EStreamState::expired != stream.state) {
+		const uint64_t timeout = stream.last_time + 1000U * TIMING_TIMEOUT_REMOTE_G2;
+		if (now < timeout) {
+			mod.timers.Arm(stream.timer, timeout, key);
+			return;
+		}
+		log.SendLog("Inactivity to local rptr module %c, removing stream id %04x\n", mod.module, ntohs(stream.streamid));
+		if (EStreamState::playing == stream.state)
+			EndPlay(mod, stream);
+		JournalEnd(stream.journal, EJournalEvent::rx_end);
+		// the header is kept a while in case the stream comes back
+		stream.state = EStreamState::expired;
+	}
+	const uint64_t keep = stream.last_time + 1000U * STREAM_EXPIRED_KEEP;
+	if (GATEWAY_HEADER_REGEN && now < keep)
+		mod.timers.Arm(stream.timer, keep, key);
+	else
+		mod.streams.Erase(&stream);
+}
 
-				toRptr.streamid = 0;
-				toRptr.addr.ClearAddress();
-				toRptr.last_time = 0;
-			}
+void CQnetGateway::ProcessTimeouts()
+{
+	ModuleTimeouts(*modules.front());
+
+	const uint64_t now = CTimerWheel::Now();
+	timers.Expire(now, due);
+	for (const auto key : due) {
+		if (TIMER_BAND_TXT == key) {
+			if (CTimerWheel::Due(band_txt.timer, now))
+				BandTimeout(now);
+		} else if (TIMER_TO_REMOTE_G2 == key) {
+			if (CTimerWheel::Due(to_remote_g2.timer, now))
+				RemoteTimeout(now);
+		} else {
+			// a route is kept as long as the worker could still resume its stream
+			SSTREAM *route = routes.Find(key);
+			if (nullptr==route || ! CTimerWheel::Due(route->timer, now))
+				continue;
+			const uint64_t timeout = route->last_time + 1000U * (TIMING_TIMEOUT_REMOTE_G2 + STREAM_EXPIRED_KEEP);
+			if (now < timeout)
+				timers.Arm(route->timer, timeout, key);
+			else
+				routes.Erase(route);
 		}
+	}
+	due.clear();
+}
 
-		/* any stream coming from local repeater timed out ? */
-		if (band_txt.last_time != 0) {
-			time(&t_now);
-			if ((t_now - band_txt.last_time) > TIMING_TIMEOUT_LOCAL_RPTR) {
-				/* This local stream never went to a remote system, so trace the timeout */
-				if (to_remote_g2.toDstar.AddressIsZero())
-					log.SendLog("Inactivity from local rptr module %c, removing stream id %04x\n", pCFGData->cModule, ntohs(band_txt.streamID));
+/* any stream coming from local repeater timed out ? */
+void CQnetGateway::BandTimeout(uint64_t now)
+{
+	if (0U == band_txt.last_time)
+		return;
+	const uint64_t timeout = band_txt.last_time + 1000U * TIMING_TIMEOUT_LOCAL_RPTR;
+	if (now < timeout) {
+		timers.Arm(band_txt.timer, timeout, TIMER_BAND_TXT);
+		return;
+	}
+	/* This local stream never went to a remote system, so trace the timeout */
+	if (to_remote_g2.toDstar.AddressIsZero())
+		log.SendLog("Inactivity from local rptr module %c, removing stream id %04x\n", pCFGData->cModule, ntohs(band_txt.streamID));
 
-				band_txt.streamID = 0;
-				band_txt.flags[0] = band_txt.flags[1] = band_txt.flags[2] = 0x0;
-				band_txt.lh_mycall[0] = '\0';
-				band_txt.lh_sfx[0] = '\0';
-				band_txt.lh_yrcall[0] = '\0';
-				band_txt.lh_rpt1[0] = '\0';
-				band_txt.lh_rpt2[0] = '\0';
+	txjournal.frames = band_txt.num_dv_frames;
+	txjournal.silent = band_txt.num_dv_silent_frames;
+	txjournal.bit_errors = band_txt.num_bit_errors;
+	JournalEnd(txjournal, EJournalEvent::tx_end);
 
-				band_txt.last_time = 0;
+	band_txt.streamID = 0;
+	band_txt.flags[0] = band_txt.flags[1] = band_txt.flags[2] = 0x0;
+	band_txt.lh_mycall[0] = '\0';
+	band_txt.lh_sfx[0] = '\0';
+	band_txt.lh_yrcall[0] = '\0';
+	band_txt.lh_rpt1[0] = '\0';
+	band_txt.lh_rpt2[0] = '\0';
 
-				band_txt.txt[0] = '\0';
-				band_txt.txt_cnt = 0;
+	band_txt.last_time = 0;
 
-				band_txt.dest_rptr[0] = '\0';
+	band_txt.txt[0] = '\0';
+	band_txt.txt_cnt = 0;
 
-				band_txt.num_dv_frames = 0;
-				band_txt.num_dv_silent_frames = 0;
-				band_txt.num_bit_errors = 0;
-			}
-		}
+	band_txt.dest_rptr[0] = '\0';
 
-		/* any stream from local repeater to a remote gateway timed out ? */
-		if (! to_remote_g2.toDstar.AddressIsZero()) {
-			time(&t_now);
-			if ((t_now - to_remote_g2.last_time) > TIMING_TIMEOUT_LOCAL_RPTR) {
-				log.SendLog("Inactivity from local rptr mod %c, removing stream id %04x\n", pCFGData->cModule, ntohs(to_remote_g2.streamid));
+	band_txt.num_dv_frames = 0;
+	band_txt.num_dv_silent_frames = 0;
+	band_txt.num_bit_errors = 0;
+}
 
-				to_remote_g2.toDstar.Clear();
-				to_remote_g2.streamid = 0;
-				to_remote_g2.last_time = 0;
-			}
-		}
+/* any stream from local repeater to a remote gateway timed out ? */
+void CQnetGateway::RemoteTimeout(uint64_t now)
+{
+	if (to_remote_g2.toDstar.AddressIsZero())
+		return;
+	const uint64_t timeout = to_remote_g2.last_time + 1000U * TIMING_TIMEOUT_LOCAL_RPTR;
+	if (now < timeout) {
+		timers.Arm(to_remote_g2.timer, timeout, TIMER_TO_REMOTE_G2);
+		return;
 	}
+	log.SendLog("Inactivity from local rptr mod %c, removing stream id %04x\n", pCFGData->cModule, ntohs(to_remote_g2.streamid));
+
+	to_remote_g2.toDstar.Clear();
+	to_remote_g2.streamid = 0;
+	to_remote_g2.last_time = 0;
 }
 
-bool CQnetGateway::ProcessG2Msg(const unsigned char *data, std::string &smrtgrp)
+bool CQnetGateway::ProcessG2Msg(const unsigned char *data, SSTREAM &stream, std::string &smrtgrp)
 {
-	static unsigned int part = 0;
-	static char txt[21];
+	// each stream has its own message in progress
+	unsigned int &part = stream.msgpart;
+	char *txt = stream.msgtxt;
 	if ((data[0] != 0x55u) || (data[1] != 0x2du) || (data[2] != 0x16u)) {
 		const unsigned char c[3] = {
 			static_cast<unsigned char>(data[0] ^ 0x70u),
@@ -583,188 +653,351 @@ bool CQnetGateway::ProcessG2Msg(const unsigned char *data, std::string &smrtgrp)
 	return false;
 }
 
-void CQnetGateway::ProcessG2(const ssize_t g2buflen, CDSVT &g2buf)
+// somebody is calling us, this is callsign routing
+bool CQnetGateway::CallingUs(const CDSVT &hdr) const
 {
-	static std::string lhcallsign, lhsfx;
-	static bool csroute = false;
-	static unsigned char nextctrl = 0U;
-	static std::string superframe;
-	if ( (g2buflen==56 || g2buflen==27) && 0==memcmp(g2buf.title, "DSVT", 4) && (g2buf.config==0x10 || g2buf.config==0x20) && g2buf.id==0x20) {
-		if (g2buflen == 56) {
-			/* valid repeater module? */
-			if (g2buf.hdr.rpt1[7]==pCFGData->cModule || true) {
-				// toRptr is active if a remote system is talking to it or
-				// toRptr is receiving data from a cross-band
-				if (0==toRptr.last_time && 0==band_txt.last_time && (Flag_is_ok(g2buf.hdr.flag[0]) || 0x01U==g2buf.hdr.flag[0] || 0x40U==g2buf.hdr.flag[0])) {
-					superframe.clear();
-					if (LOG_QSO) {
-						log.SendLog("id=%04x flags=%02x:%02x:%02x ur=%.8s r1=%.8s r2=%.8s my=%.8s/%.4s IP=[%s]:%u\n", ntohs(g2buf.streamid), g2buf.hdr.flag[0], g2buf.hdr.flag[1], g2buf.hdr.flag[2], g2buf.hdr.urcall, g2buf.hdr.rpt1, g2buf.hdr.rpt2, g2buf.hdr.mycall, g2buf.hdr.sfx, fromDstar.GetAddress(), fromDstar.GetPort());
-					}
+	return 0 == memcmp(hdr.hdr.urcall, pCFGData->sCallsign.c_str(), pCFGData->sCallsign.size());
+}
 
-					lhcallsign.assign((const char *)g2buf.hdr.mycall, 8);
-					if (memcmp(g2buf.hdr.sfx, "RPTR", 4) && std::regex_match(lhcallsign.c_str(), preg)) {
-						lhsfx.assign((const char *)g2buf.hdr.sfx, 4);
-						std::string  reflector((const char *)g2buf.hdr.urcall, 8);
-						if (0 == reflector.compare("CQCQCQ  "))
-							set_dest_rptr(reflector);
-						else if (0 == reflector.compare(OWNER))
-							reflector.assign("CSRoute");
-						qnDB.UpdateLH(lhcallsign.c_str(), lhsfx.c_str(), pCFGData->cModule, reflector.c_str());
-					}
+int CQnetGateway::StreamPriority(const CDSVT &hdr) const
+{
+	if (0x20U & hdr.hdr.flag[0])
+		return 2;	// emergency
+	if (CallingUs(hdr))
+		return 1;
+	return 0;
+}
 
-					Gate2AM.Write(g2buf.title, 56);
-					nextctrl = 0U;
+// only the primary module has a local transmitter
+bool CQnetGateway::Transmitting(const SMODULE &mod) const
+{
+	return mod.primary && band_txt.last_time;
+}
 
-					// save the header
-					memcpy(toRptr.saved_hdr.title, g2buf.title, 56);
-					toRptr.saved_addr = fromDstar;
+SSTREAM *CQnetGateway::Playing(SMODULE &mod)
+{
+	for (unsigned i=0; i<STREAM_TABLE_SIZE; i++) {
+		SSTREAM *stream = mod.streams.At(i);
+		if (stream && EStreamState::playing==stream->state)
+			return stream;
+	}
+	return nullptr;
+}
 
-					/* This is the active streamid */
-					toRptr.streamid = g2buf.streamid;
-					toRptr.addr = fromDstar;;
+void CQnetGateway::Output(SMODULE &mod, const void *buf, size_t size)
+{
+	// nothing plays the other modules unless something has their channel open
+	if (mod.primary || mod.writer.HasReader())
+		mod.out->Write(buf, size);
+}
 
-					/* time it, in case stream times out */
-					time(&toRptr.last_time);
+void CQnetGateway::Play(SMODULE &mod, SSTREAM &stream)
+{
+	stream.state = EStreamState::playing;
+	stream.superframe.clear();
+	Output(mod, stream.header.title, 56);
+}
 
-					toRptr.sequence = g2buf.ctrl;
-					csroute = (0 == memcmp(g2buf.hdr.urcall, pCFGData->sCallsign.c_str(), pCFGData->sCallsign.size()));
-				}
-			}
-		} else {	// g2buflen == 27
-			/* find out which repeater module to send the data to */
-			/* streamid match ? */
-			if (toRptr.streamid == g2buf.streamid && toRptr.addr == fromDstar) {
-				if (LOG_DEBUG) {
-					const unsigned int ctrl = g2buf.ctrl & 0x1FU;
-					if (VoicePacketIsSync(g2buf.vasd.text)) {
-						if (superframe.size() > 65U) {
-							log.SendLog("Frame[%c]: %s\n", pCFGData->cModule, superframe.c_str());
-							superframe.clear();
-						}
-						const char *ch = "#abcdefghijklmnopqrstuvwxyz";
-						superframe.append(1, (ctrl<27U) ? ch[ctrl] : '%' );
-					} else {
-						const char *ch = "!ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-						superframe.append(1, (ctrl<27U) ? ch[ctrl] : '*' );
-					}
-				}
+void CQnetGateway::PlayNext(SMODULE &mod)
+{
+	// nothing plays while we are transmitting
+	if (Transmitting(mod))
+		return;
+	SSTREAM *next = mod.streams.Best();
+	if (next) {
+		log.SendLog("Re-generating header for streamID=%04x\n", ntohs(next->streamid));
+		Play(mod, *next);
+	}
+}
 
-				int diff = int(0x1FU & g2buf.ctrl) - int(nextctrl);
-				if (diff) {
-					if (diff < 0)
-						diff += 21;
-					if (diff < 6) {	// fill up to 5 missing voice frames
-						if (LOG_DEBUG)
-							printf("Inserting %d missing voice frame(s)\n", diff - 1);
-						CDSVT dsvt;
-						memcpy(dsvt.title, g2buf.title, 14U);	// everything but the ctrl and voice data
-						const unsigned char silence[9] = { 0x9EU, 0x8DU, 0x32U, 0x88U, 0x26U, 0x1AU, 0x3FU, 0x61U, 0xE8U };
-						memcpy(dsvt.vasd.voice, silence, 9U);
-						while (diff-- > 0) {
-							dsvt.ctrl = nextctrl++;
-							nextctrl %= 21U;
-							if (dsvt.ctrl) {
-								const unsigned char text[3] = { 0x70U, 0x4FU, 0x93U };
-								memcpy(dsvt.vasd.text, text, 3U);
-							} else {
-								const unsigned char sync[3] = { 0x55U, 0x2DU, 0x16U };
-								memcpy(dsvt.vasd.text, sync, 3U);
-							}
-							Gate2AM.Write(dsvt.title, 27);
-						}
-					} else {
-					    if (LOG_DEBUG) {
-        					printf("Missing %d packets from the voice stream, resetting\n", diff);
-						}
-						nextctrl = g2buf.ctrl;
-					}
-				}
+void CQnetGateway::EndPlay(SMODULE &mod, SSTREAM &stream)
+{
+	// Send end_of_audio to local repeater.
+	// Let the repeater re-initialize
+	CDSVT &end_of_audio = mod.end_of_audio;
+	end_of_audio.streamid = stream.streamid;
+	end_of_audio.ctrl = (stream.sequence & 0x1FU) | 0x40U;
+	if (stream.sequence & 0x1FU) {
+		const unsigned char silence[3] = { 0x70U, 0x4FU, 0x93U };
+		memcpy(end_of_audio.vasd.text, silence, 3U);
+	} else {
+		const unsigned char sync[3] = { 0x55U, 0x2DU, 0x16U };
+		memcpy(end_of_audio.vasd.text, sync, 3U);
+	}
+	Output(mod, end_of_audio.title, 27);
+}
 
-				if ((nextctrl == (0x1FU & g2buf.ctrl)) || (0x40U & g2buf.ctrl)) {
-					// no matter what, we will send this on if it is the closing frame
-					if (0x40U & g2buf.ctrl) {
-						g2buf.ctrl = (nextctrl | 0x40U);
-					} else {
-						g2buf.ctrl = nextctrl;
-						nextctrl = (nextctrl + 1U) % 21U;
-					}
-					Gate2AM.Write(g2buf.title, 27);
-					std::string smartgroup;
-					if (ProcessG2Msg(g2buf.vasd.text, smartgroup))
-						qnDB.UpdateLH(lhcallsign.c_str(), lhsfx.c_str(), pCFGData->cModule, smartgroup.c_str());
-				} else {
-					if (LOG_DEBUG)
-						fprintf(stderr, "Ignoring packet because its ctrl=0x%02xU and nextctrl=0x%02xU\n", g2buf.ctrl, nextctrl);
-				}
+void CQnetGateway::StartStream(SMODULE &mod, const CDSVT &hdr, CSockAddress &from)
+{
+	SSTREAM *stream = mod.streams.Insert(hdr.streamid, from);
+	if (nullptr == stream) {
+		log.SendLog(ELogLevel::warning, "Too many streams on module %c, ignoring id=%04x from [%s]:%u\n", mod.module, ntohs(hdr.streamid), from.GetAddress(), from.GetPort());
+		return;
+	}
+	stream->module = mod.module;
+	mod.timers.Arm(stream->timer, stream->last_time + 1000U * TIMING_TIMEOUT_REMOTE_G2, CStreamTable::Key(*stream));
+	if (LOG_QSO) {
+		log.SendLog("id=%04x flags=%02x:%02x:%02x ur=%.8s r1=%.8s r2=%.8s my=%.8s/%.4s IP=[%s]:%u\n", ntohs(hdr.streamid), hdr.hdr.flag[0], hdr.hdr.flag[1], hdr.hdr.flag[2], hdr.hdr.urcall, hdr.hdr.rpt1, hdr.hdr.rpt2, hdr.hdr.mycall, hdr.hdr.sfx, from.GetAddress(), from.GetPort());
+	}
 
-				/* timeit */
-				time(&toRptr.last_time);
+	JournalStart(stream->journal, EJournalEvent::rx_start, hdr, mod.module);
+
+	memcpy(stream->lhcallsign, hdr.hdr.mycall, 8);
+	stream->lhcallsign[8] = '\0';
+	if (memcmp(hdr.hdr.sfx, "RPTR", 4) && std::regex_match(stream->lhcallsign, preg)) {
+		memcpy(stream->lhsfx, hdr.hdr.sfx, 4);
+		stream->lhsfx[4] = '\0';
+		std::string  reflector((const char *)hdr.hdr.urcall, 8);
+		if (0 == reflector.compare("CQCQCQ  "))
+			set_dest_rptr(mod.module, reflector);
+		else if (0 == reflector.compare(OWNER))
+			reflector.assign("CSRoute");
+		qnDB.UpdateLH(stream->lhcallsign, stream->lhsfx, mod.module, reflector.c_str());
+	}
 
-				toRptr.sequence = g2buf.ctrl;
+	// save the header
+	memcpy(stream->header.title, hdr.title, 56);
+	stream->sequence = hdr.ctrl;
+	stream->priority = StreamPriority(hdr);
+	stream->csroute = CallingUs(hdr);	// an emergency call to us is still callsign routed
 
-				/* End of stream ? */
-				if (g2buf.ctrl & 0x40U) {
-					/* clear the saved header */
-					memset(toRptr.saved_hdr.title, 0U, 56U);
-					toRptr.saved_addr.ClearAddress();
+	// only one stream plays, the others are followed until it's their turn
+	if (Transmitting(mod))
+		return;
+	SSTREAM *playing = Playing(mod);
+	if (nullptr == playing) {
+		Play(mod, *stream);
+	} else if (stream->priority > playing->priority) {
+		log.SendLog("id=%04x takes over from id=%04x\n", ntohs(stream->streamid), ntohs(playing->streamid));
+		EndPlay(mod, *playing);
+		playing->state = EStreamState::monitoring;
+		Play(mod, *stream);
+	}
+}
 
-					toRptr.last_time = 0;
-					toRptr.streamid = 0;
-					toRptr.addr.ClearAddress();
-					if (LOG_DEBUG && superframe.size()) {
-						log.SendLog("Final[%c]: %s\n", pCFGData->cModule, superframe.c_str());
-						superframe.clear();
-					}
-					if (LOG_QSO)
-						log.SendLog("id=%04x END\n", ntohs(g2buf.streamid));
-
-					if (csroute) {
-						char play[56];
-						snprintf(play, 56, "PLAY%c_ringing.dat_CALLSIGN_ROUTE", pCFGData->cModule);
-						Gate2AM.Write(play, strlen(play)+1);
-						csroute = false;
-					}
+void CQnetGateway::StreamVoice(SMODULE &mod, SSTREAM &stream, CDSVT &g2buf)
+{
+	const bool playing = (EStreamState::playing == stream.state);
+	if (LOG_DEBUG && playing) {
+		const unsigned int ctrl = g2buf.ctrl & 0x1FU;
+		if (VoicePacketIsSync(g2buf.vasd.text)) {
+			if (stream.superframe.size() > 65U) {
+				log.SendLog(ELogLevel::debug, "Frame[%c]: %s\n", mod.module, stream.superframe.c_str());
+				stream.superframe.clear();
+			}
+			const char *ch = "#abcdefghijklmnopqrstuvwxyz";
+			stream.superframe.append(1, (ctrl<27U) ? ch[ctrl] : '%' );
+		} else {
+			const char *ch = "!ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+			stream.superframe.append(1, (ctrl<27U) ? ch[ctrl] : '*' );
+		}
+	}
+
+	int diff = int(0x1FU & g2buf.ctrl) - int(stream.nextctrl);
+	if (diff) {
+		if (diff < 0)
+			diff += 21;
+		if (diff < 6) {	// fill up to 5 missing voice frames
+			if (LOG_DEBUG && playing)
+				printf("Inserting %d missing voice frame(s)\n", diff - 1);
+			stream.journal.lost += diff - 1;
+			CDSVT dsvt;
+			memcpy(dsvt.title, g2buf.title, 14U);	// everything but the ctrl and voice data
+			const unsigned char silence[9] = { 0x9EU, 0x8DU, 0x32U, 0x88U, 0x26U, 0x1AU, 0x3FU, 0x61U, 0xE8U };
+			memcpy(dsvt.vasd.voice, silence, 9U);
+			while (diff-- > 0) {
+				dsvt.ctrl = stream.nextctrl++;
+				stream.nextctrl %= 21U;
+				if (dsvt.ctrl) {
+					const unsigned char text[3] = { 0x70U, 0x4FU, 0x93U };
+					memcpy(dsvt.vasd.text, text, 3U);
+				} else {
+					const unsigned char sync[3] = { 0x55U, 0x2DU, 0x16U };
+					memcpy(dsvt.vasd.text, sync, 3U);
 				}
+				if (playing)
+					Output(mod, dsvt.title, 27);
+			}
+		} else {
+			if (LOG_DEBUG && playing) {
+				printf("Missing %d packets from the voice stream, resetting\n", diff);
 			}
+			stream.nextctrl = g2buf.ctrl;
+			stream.journal.lost += diff;
+		}
+	}
 
-			/* no match ? */
-			if (GATEWAY_HEADER_REGEN) {
-				/* check if this a continuation of audio that timed out */
+	if ((stream.nextctrl == (0x1FU & g2buf.ctrl)) || (0x40U & g2buf.ctrl)) {
+		// no matter what, we will send this on if it is the closing frame
+		if (0x40U & g2buf.ctrl) {
+			g2buf.ctrl = (stream.nextctrl | 0x40U);
+		} else {
+			g2buf.ctrl = stream.nextctrl;
+			stream.nextctrl = (stream.nextctrl + 1U) % 21U;
+		}
+		if (playing)
+			Output(mod, g2buf.title, 27);
+		stream.journal.frames++;
+		std::string smartgroup;
+		if (ProcessG2Msg(g2buf.vasd.text, stream, smartgroup))
+			qnDB.UpdateLH(stream.lhcallsign, stream.lhsfx, mod.module, smartgroup.c_str());
+	} else {
+		if (LOG_DEBUG && playing)
+			fprintf(stderr, "Ignoring packet because its ctrl=0x%02xU and nextctrl=0x%02xU\n", g2buf.ctrl, stream.nextctrl);
+	}
 
-				if (0U == (g2buf.ctrl & 0x40)) {	// only do this if it's not the last voice packet
-					/* for which repeater this stream has timed out ?  */
-					if (toRptr.saved_hdr.streamid == g2buf.streamid && toRptr.saved_addr == fromDstar) {
-						/* repeater module is inactive ?  */
-						if (toRptr.last_time==0 && band_txt.last_time==0) {
-							log.SendLog("Re-generating header for streamID=%04x\n", ntohs(g2buf.streamid));
+	/* timeit */
+	stream.last_time = CTimerWheel::Now();
 
-							/* re-generate/send the header */
-							Gate2AM.Write(toRptr.saved_hdr.title, 56);
+	stream.sequence = g2buf.ctrl;
 
-							/* send this audio packet to repeater */
-							Gate2AM.Write(g2buf.title, 27);
+	/* End of stream ? */
+	if (g2buf.ctrl & 0x40U) {
+		JournalEnd(stream.journal, EJournalEvent::rx_end);
+		if (LOG_DEBUG && stream.superframe.size()) {
+			log.SendLog(ELogLevel::debug, "Final[%c]: %s\n", mod.module, stream.superframe.c_str());
+			stream.superframe.clear();
+		}
+		if (LOG_QSO)
+			log.SendLog("id=%04x END\n", ntohs(g2buf.streamid));
 
-							/* make sure that any more audio arriving will be accepted */
-							toRptr.streamid = g2buf.streamid;
-							toRptr.addr = fromDstar;
+		if (playing && stream.csroute) {
+			char play[56];
+			snprintf(play, 56, "PLAY%c_ringing.dat_CALLSIGN_ROUTE", mod.module);
+			Output(mod, play, strlen(play)+1);
+		}
+		mod.streams.Erase(&stream);
+		if (playing)
+			PlayNext(mod);
+	}
+}
 
-							/* time it, in case stream times out */
-							time(&toRptr.last_time);
+void CQnetGateway::ProcessStream(SMODULE &mod, const ssize_t g2buflen, CDSVT &g2buf, CSockAddress &from)
+{
+	SSTREAM *stream = mod.streams.Find(g2buf.streamid, from);
+	if (g2buflen == 56) {
+		// the header is usually repeated, so only the first one starts a stream
+		if (nullptr==stream && (Flag_is_ok(g2buf.hdr.flag[0]) || 0x01U==g2buf.hdr.flag[0] || 0x40U==g2buf.hdr.flag[0]))
+			StartStream(mod, g2buf, from);
+	} else if (stream) {	// g2buflen == 27
+		if (EStreamState::expired == stream->state) {
+			/* check if this a continuation of audio that timed out */
+			if (0x40U & g2buf.ctrl)
+				return;	// only do this if it's not the last voice packet
+			JournalStart(stream->journal, EJournalEvent::rx_start, stream->header, mod.module);
+			stream->state = EStreamState::monitoring;
+			stream->nextctrl = 0x1FU & g2buf.ctrl;
+			// it was waiting to be forgotten, now it can time out again
+			mod.timers.Arm(stream->timer, CTimerWheel::Now() + 1000U * TIMING_TIMEOUT_REMOTE_G2, CStreamTable::Key(*stream));
+			/* repeater module is inactive ?  */
+			if (! Transmitting(mod) && nullptr==Playing(mod)) {
+				log.SendLog("Re-generating header for streamID=%04x\n", ntohs(g2buf.streamid));
+				Play(mod, *stream);
+			}
+		}
+		StreamVoice(mod, *stream, g2buf);
+	}
+}
 
-							toRptr.sequence = g2buf.ctrl;
+// the primary module is the default for anything addressed to a module we don't have
+SMODULE *CQnetGateway::FindModule(char module)
+{
+	for (auto &m : modules) {
+		if (module == m->module)
+			return m.get();
+	}
+	return modules.front().get();
+}
 
-						}
+void CQnetGateway::Queue(SMODULE &mod, const ssize_t g2buflen, const CDSVT &g2buf, const CSockAddress &from)
+{
+	std::lock_guard<std::mutex> lock(mod.mtx);
+	if (mod.queue.size() >= FRAME_POOL_SIZE) {
+		CPipelineStats::Count(ECounter::frame_dropped);
+		return;
+	}
+	mod.queue.emplace_back();
+	SINBOUND &in = mod.queue.back();
+	memcpy(in.dsvt.title, g2buf.title, g2buflen);
+	in.length = g2buflen;
+	in.from = from;
+	if (1U == mod.queue.size())
+		mod.cv.notify_one();
+}
+
+void CQnetGateway::ProcessG2(const ssize_t g2buflen, CDSVT &g2buf, CSockAddress &from)
+{
+	if ( (g2buflen==56 || g2buflen==27) && 0==memcmp(g2buf.title, "DSVT", 4) && (g2buf.config==0x10 || g2buf.config==0x20) && g2buf.id==0x20) {
+		SMODULE &primary = *modules.front();
+		if (modules.size() > 1U) {
+			// a stream for one of the other modules is passed to its worker
+			SSTREAM *route = routes.Find(g2buf.streamid, from);
+			if (nullptr==route && 56==g2buflen && nullptr==primary.streams.Find(g2buf.streamid, from)) {
+				SMODULE *mod = FindModule(g2buf.hdr.rpt1[7]);
+				if (! mod->primary) {
+					route = routes.Insert(g2buf.streamid, from);
+					if (nullptr == route) {
+						log.SendLog(ELogLevel::warning, "Too many streams, ignoring id=%04x from [%s]:%u\n", ntohs(g2buf.streamid), from.GetAddress(), from.GetPort());
+						return;
 					}
+					route->module = mod->module;
+					timers.Arm(route->timer, route->last_time + 1000U * (TIMING_TIMEOUT_REMOTE_G2 + STREAM_EXPIRED_KEEP), CStreamTable::Key(*route));
 				}
 			}
+			if (route) {
+				route->last_time = CTimerWheel::Now();
+				Queue(*FindModule(route->module), g2buflen, g2buf, from);
+				if (27==g2buflen && (0x40U & g2buf.ctrl))
+					routes.Erase(route);
+				return;
+			}
 		}
+		ProcessStream(primary, g2buflen, g2buf, from);
 	}
 }
 
-void CQnetGateway::ProcessAudio(const CDSVT *packet)
+void CQnetGateway::ModuleThread(SMODULE *mod, int cpu)
 {
-	CDSVT dsvt;
-	memcpy(dsvt.title, packet, (packet->config==0x10U) ? 56 : 27);
+	if (cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+		if (rc)
+			log.SendLog(ELogLevel::warning, "Could not pin module %c to cpu %d: %s\n", mod->module, cpu, strerror(rc));
+	}
+
+	std::deque<SINBOUND> batch;
+	while (keep_running) {
+		{
+			std::unique_lock<std::mutex> lock(mod->mtx);
+			if (mod->queue.empty())
+				mod->cv.wait_for(lock, std::chrono::milliseconds(20));
+			batch.swap(mod->queue);
+		}
+		for (auto &in : batch)
+			ProcessStream(*mod, in.length, in.dsvt, in.from);
+		batch.clear();
+		ModuleTimeouts(*mod);
+	}
+
+	// close the journal records of the streams that are still open
+	for (unsigned i=0; i<STREAM_TABLE_SIZE; i++) {
+		SSTREAM *stream = mod->streams.At(i);
+		if (stream)
+			JournalEnd(stream->journal, EJournalEvent::rx_end);
+	}
+}
+
+void CQnetGateway::ProcessAudio(CDSVT *packet)
+{
+	// the header is rewritten for routing, so a shared frame has to be copied first
+	CDSVT copy;
+	if (! CFramePool::IsUnique(packet)) {
+		memcpy(copy.title, packet->title, (packet->config==0x10U) ? 56 : 27);
+		packet = &copy;
+	}
+	CDSVT &dsvt = *packet;
 
 	if (0 == memcmp(dsvt.title, "DSVT", 4)) {
 		if (dsvt.id==0x20U && (dsvt.config==0x10U || dsvt.config==0x20U) ) {
@@ -799,7 +1032,8 @@ void CQnetGateway::ProcessAudio(const CDSVT *packet)
 						memcpy(band_txt.lh_rpt2, dsvt.hdr.rpt2, 8);
 						band_txt.lh_rpt2[8] = '\0';
 
-						time(&band_txt.last_time);
+						band_txt.last_time = CTimerWheel::Now();
+						timers.Arm(band_txt.timer, band_txt.last_time + 1000U * TIMING_TIMEOUT_LOCAL_RPTR, TIMER_BAND_TXT);
 
 						band_txt.txt[0] = '\0';
 						band_txt.txt_cnt = 0;
@@ -817,6 +1051,8 @@ void CQnetGateway::ProcessAudio(const CDSVT *packet)
 						band_txt.num_dv_frames = 0;
 						band_txt.num_dv_silent_frames = 0;
 						band_txt.num_bit_errors = 0;
+
+						JournalStart(txjournal, EJournalEvent::tx_start, dsvt, pCFGData->cModule);
 					}
 				}
 
@@ -853,7 +1089,7 @@ void CQnetGateway::ProcessAudio(const CDSVT *packet)
 
 									user.assign((char *)dsvt.hdr.urcall, 1, 6);
 									user.append(" ");
-									user.append(dsvt.hdr.urcall[7], 1);
+									user.append(1, dsvt.hdr.urcall[7]);
 									if (isspace(user.at(7)))
 										user[7] = 'A';
 
@@ -892,7 +1128,8 @@ void CQnetGateway::ProcessAudio(const CDSVT *packet)
 										ntohs(dsvt.streamid), to_remote_g2.toDstar.GetAddress(), to_remote_g2.toDstar.GetPort(),
 										dsvt.hdr.urcall, dsvt.hdr.rpt1, dsvt.hdr.rpt2, dsvt.hdr.mycall, dsvt.hdr.sfx);
 
-										time(&(to_remote_g2.last_time));
+										to_remote_g2.last_time = CTimerWheel::Now();
+										timers.Arm(to_remote_g2.timer, to_remote_g2.last_time + 1000U * TIMING_TIMEOUT_LOCAL_RPTR, TIMER_TO_REMOTE_G2);
 									}
 								}
 							}
@@ -944,7 +1181,8 @@ void CQnetGateway::ProcessAudio(const CDSVT *packet)
 
 										//printf("Callsign route to [%s]:%u id=%04x my=%.8s/%.4s ur=%.8s rpt1=%.8s rpt2=%.8s\n", to_remote_g2.toDstar.GetAddress(), to_remote_g2.toDstar.GetPort(), ntohs(dsvt.streamid), dsvt.hdr.mycall, dsvt.hdr.sfx, dsvt.hdr.urcall, dsvt.hdr.rpt1, dsvt.hdr.rpt2);
 
-										time(&(to_remote_g2.last_time));
+										to_remote_g2.last_time = CTimerWheel::Now();
+										timers.Arm(to_remote_g2.timer, to_remote_g2.last_time + 1000U * TIMING_TIMEOUT_LOCAL_RPTR, TIMER_TO_REMOTE_G2);
 									}
 								}
 							}
@@ -961,13 +1199,13 @@ void CQnetGateway::ProcessAudio(const CDSVT *packet)
 			{	// recvlen is 27
 				{
 					if (band_txt.streamID == dsvt.streamid) {
-						time(&band_txt.last_time);
+						band_txt.last_time = CTimerWheel::Now();
 
 						if (dsvt.ctrl & 0x40) {	// end of voice data
 							if (! band_txt.sent_key_on_msg) {
 								band_txt.txt[0] = '\0';
 								if (memcmp(band_txt.lh_yrcall, "CQCQCQ", 6) == 0) {
-									set_dest_rptr(band_txt.dest_rptr);
+									set_dest_rptr(pCFGData->cModule, band_txt.dest_rptr);
 								}
                                 int x = FindIndex();
 								if (x >= 0)
@@ -986,6 +1224,11 @@ void CQnetGateway::ProcessAudio(const CDSVT *packet)
 							if (index >= 0)
 								ii[index]->sendHeardWithTXStats(band_txt.lh_mycall, band_txt.lh_sfx, band_txt.lh_yrcall, band_txt.lh_rpt1, band_txt.lh_rpt2, band_txt.flags[0], band_txt.flags[1], band_txt.flags[2], band_txt.num_dv_frames, band_txt.num_dv_silent_frames, band_txt.num_bit_errors);
 
+							txjournal.frames = band_txt.num_dv_frames;
+							txjournal.silent = band_txt.num_dv_silent_frames;
+							txjournal.bit_errors = band_txt.num_bit_errors;
+							JournalEnd(txjournal, EJournalEvent::tx_end);
+
 							if (playNotInCache) {
 								// Not in cache, please try again!
 								char str[56];
@@ -1027,7 +1270,7 @@ void CQnetGateway::ProcessAudio(const CDSVT *packet)
 				if (to_remote_g2.streamid==dsvt.streamid && Index>=0) {
 					sendto(g2_sock[Index], dsvt.title, 27, 0, to_remote_g2.toDstar.GetPointer(), to_remote_g2.toDstar.GetSize());
 
-					time(&(to_remote_g2.last_time));
+					to_remote_g2.last_time = CTimerWheel::Now();
 
 					/* Is this the end-of-stream */
 					if (dsvt.ctrl & 0x40) {
@@ -1044,6 +1287,32 @@ void CQnetGateway::ProcessAudio(const CDSVT *packet)
 	}
 }
 
+void CQnetGateway::JournalStart(SJOURNAL &rec, EJournalEvent event, const CDSVT &dsvt, char module)
+{
+	memset(&rec, 0, sizeof(SJOURNAL));
+	rec.event = event;
+	rec.module = module;
+	rec.streamid = dsvt.streamid;
+	memcpy(rec.mycall, dsvt.hdr.mycall, 8);
+	memcpy(rec.sfx, dsvt.hdr.sfx, 4);
+	memcpy(rec.urcall, dsvt.hdr.urcall, 8);
+	memcpy(rec.rpt1, dsvt.hdr.rpt1, 8);
+	memcpy(rec.rpt2, dsvt.hdr.rpt2, 8);
+	journal.Append(rec);
+}
+
+void CQnetGateway::JournalEnd(SJOURNAL &rec, EJournalEvent event)
+{
+	if (EJournalEvent::none == rec.event)
+		return;	// no stream is open
+	SJOURNAL end(rec);
+	end.event = event;
+	end.time = CJournal::Now();
+	end.duration = uint32_t(end.time - rec.time);
+	journal.Append(end);
+	rec.event = EJournalEvent::none;
+}
+
 void CQnetGateway::AddFDSet(int &max, int newfd, fd_set *set)
 {
 	if (newfd > max)
@@ -1070,6 +1339,19 @@ void CQnetGateway::Process()
 		}
 	}
 
+	// the other modules each get a worker, spread over the cores
+	const unsigned cores = std::thread::hardware_concurrency();
+	for (unsigned m=1; keep_running && m<modules.size(); m++) {
+		SMODULE *mod = modules[m].get();
+		const int cpu = (cores > 1U) ? int(m % cores) : -1;
+		try {
+			mod->worker = std::async(std::launch::async, &CQnetGateway::ModuleThread, this, mod, cpu);
+		} catch (const std::exception &e) {
+			fprintf(stderr, "Failed to start the module %c thread. Exception: %s\n", mod->module, e.what());
+			keep_running = false;
+		}
+	}
+
 	while (keep_running) {
 		ProcessTimeouts();
 
@@ -1092,27 +1374,38 @@ void CQnetGateway::Process()
 			if (g2_sock[i] < 0)
 				continue;
 			if (keep_running && FD_ISSET(g2_sock[i], &fdset)) {
-				CDSVT dsvt;
+				// received straight into a pool slot, so it can be passed on without a copy
+				CFrameRef dsvt;
 				socklen_t fromlen = sizeof(struct sockaddr_storage);
-				ssize_t g2buflen = recvfrom(g2_sock[i], dsvt.title, 56, 0, fromDstar.GetPointer(), &fromlen);
-				if (LOG_QSO && 4==g2buflen && 0==memcmp(dsvt.title, "PONG", 4)) {
+				ssize_t g2buflen = recvfrom(g2_sock[i], dsvt->title, 56, 0, fromDstar.GetPointer(), &fromlen);
+				CFramePool::SetTime(dsvt.Get(), CPipelineStats::Now());
+				CCapture::Write(ECapture::g2, fromDstar, dsvt->title, g2buflen);
+				if (LOG_QSO && 4==g2buflen && 0==memcmp(dsvt->title, "PONG", 4)) {
 					log.SendLog("Got a pong from [%s]:%u\n", fromDstar.GetAddress(), fromDstar.GetPort());
 				} else {
-					ProcessG2(g2buflen, dsvt);
+					ProcessG2(g2buflen, *dsvt, fromDstar);
 				}
 				FD_CLR(g2_sock[i], &fdset);
 			}
 		}
 
 		// process packets coming from the audio module
-		while (keep_running && FD_ISSET(AM2Gate.GetFD(), &fdset)) {
-			CDSVT packet;
-			AM2Gate.Read(packet.title, 56);
-			ProcessAudio(&packet);
+		if (keep_running && FD_ISSET(AM2Gate.GetFD(), &fdset)) {
+			AM2Gate.Clear();
+			ssize_t length;
+			CDSVT *packet;
+			while (keep_running && nullptr != (packet = AM2Gate.Read(length))) {
+				ProcessAudio(packet);
+				AM2Gate.Release(packet);
+			}
 			FD_CLR(AM2Gate.GetFD(), &fdset);
 		}
 	}
 
+	for (auto &m : modules) {
+		if (m->worker.valid())
+			m->worker.get();
+	}
 	for (int i=0; i<2; i++) {
 		if (ii[i])
 			irc_data_future[i].get();
@@ -1121,35 +1414,67 @@ void CQnetGateway::Process()
 
 void CQnetGateway::qrgs_and_maps()
 {
-	std::string rptrcall = OWNER;
-	rptrcall.resize(CALL_SIZE-1);
-	rptrcall.append(1, pCFGData->cModule);
-	for (int j=0; j<2; j++) {
-		if (ii[j]) {
-			if (Rptr.mod.latitude || Rptr.mod.longitude || Rptr.mod.desc1.length() || Rptr.mod.url.length())
-				ii[j]->rptrQTH(rptrcall, Rptr.mod.latitude, Rptr.mod.longitude, Rptr.mod.desc1, Rptr.mod.desc2, Rptr.mod.url, Rptr.mod.package_version);
-			if (Rptr.mod.frequency)
-				ii[j]->rptrQRG(rptrcall, Rptr.mod.frequency, Rptr.mod.offset, Rptr.mod.range, Rptr.mod.agl);
+	for (const auto &m : modules) {
+		std::string rptrcall = OWNER;
+		rptrcall.resize(CALL_SIZE-1);
+		rptrcall.append(1, m->module);
+		for (int j=0; j<2; j++) {
+			if (ii[j]) {
+				if (Rptr.mod.latitude || Rptr.mod.longitude || Rptr.mod.desc1.length() || Rptr.mod.url.length())
+					ii[j]->rptrQTH(rptrcall, Rptr.mod.latitude, Rptr.mod.longitude, Rptr.mod.desc1, Rptr.mod.desc2, Rptr.mod.url, Rptr.mod.package_version);
+				if (Rptr.mod.frequency)
+					ii[j]->rptrQRG(rptrcall, Rptr.mod.frequency, Rptr.mod.offset, Rptr.mod.range, Rptr.mod.agl);
+			}
 		}
 	}
 }
 
-bool CQnetGateway::Init(CFGDATA *pData)
+// the primary module, and then one for each letter in Modules that isn't the primary
+void CQnetGateway::InitModules()
 {
-	pCFGData = pData;
-	keep_running = true;
-	// unix sockets
-	Gate2AM.SetUp("gate2am");
-	if (AM2Gate.Open("am2gate"))
-		return true;
-
-	//setvbuf(stdout, (char *)NULL, _IOLBF, 0);
+	modules.clear();
+	routes.Clear();
+	std::string letters(1, pCFGData->cModule);
+	for (auto c : pCFGData->sModules) {
+		c = toupper(c);
+		if (isalpha(c) && std::string::npos == letters.find(c))
+			letters.append(1, c);
+	}
+	for (auto c : letters) {
+		modules.emplace_back(new SMODULE);
+		SMODULE &mod = *modules.back();
+		mod.module = c;
+		mod.primary = (1U == modules.size());
+		if (mod.primary) {
+			mod.out = &Gate2AM;
+		} else {
+			std::string name("gate2am");
+			name.append(1, c);
+			mod.writer.SetUp(name.c_str());
+			mod.out = &mod.writer;
+		}
+		/*
+		   Initialize the end_of_audio that will be sent to the local repeater
+		   when audio from remote G2 has timed out
+		*/
+		memset(mod.end_of_audio.title, 0U, 27U);
+		memcpy(mod.end_of_audio.title, "DSVT", 4U);
+		mod.end_of_audio.id = mod.end_of_audio.config = 0x20U;
+		const unsigned char silence[9] = { 0x9EU, 0x8DU, 0x32U, 0x88U, 0x26U, 0x1AU, 0x3FU, 0x61U, 0xE8U };
+		memcpy(mod.end_of_audio.vasd.voice, silence, 9U);
+	}
+	if (modules.size() > 1U)
+		log.SendLog("Serving modules %s, %c is the primary\n", letters.c_str(), pCFGData->cModule);
+}
 
+// clear the state of the streams going to and from the repeater module, returns true on failure
+bool CQnetGateway::InitStreams()
+{
 	/* Used to validate MYCALL input */
 	try {
 		preg = std::regex("^(([1-9][A-Z])|([A-PR-Z][0-9])|([A-PR-Z][A-Z][0-9]))[0-9A-Z]*[A-Z][ ]*[ A-RT-Z]$", std::regex::extended);
 	} catch (std::regex_error &e) {
-		log.SendLog("Regular expression error: %s\n", e.what());
+		log.SendLog(ELogLevel::error, "Regular expression error: %s\n", e.what());
 		return true;
 	}
 
@@ -1161,6 +1486,7 @@ bool CQnetGateway::Init(CFGDATA *pData)
 	memset(band_txt.lh_rpt1, 0, 9);
 	memset(band_txt.lh_rpt2, 0, 9);
 	band_txt.last_time = 0;
+	band_txt.timer = 0;
 	memset(band_txt.txt, 0, 64);   // Only 20 are used
 	band_txt.txt_cnt = 0;
 	band_txt.sent_key_on_msg = false;
@@ -1174,9 +1500,37 @@ bool CQnetGateway::Init(CFGDATA *pData)
 	band_txt.num_dv_silent_frames = 0;
 	band_txt.num_bit_errors = 0;
 
+	// the streams from remote gateways
+	InitModules();
+
+	/* to remote systems */
+	to_remote_g2.toDstar.Clear();
+	to_remote_g2.streamid = 0;
+	to_remote_g2.last_time = 0;
+	to_remote_g2.timer = 0;
+
+	memset(&txjournal, 0, sizeof(SJOURNAL));
+	playNotInCache = false;
+	return false;
+}
+
+bool CQnetGateway::Init(const CFGDATA *pData)
+{
+	pCFGData = pData;
+	keep_running = true;
+	// unix sockets
+	Gate2AM.SetUp("gate2am");
+	if (AM2Gate.Open("am2gate"))
+		return true;
+
+	//setvbuf(stdout, (char *)NULL, _IOLBF, 0);
+
+	if (InitStreams())
+		return true;
+
 	/* process configuration file */
 	if ( Configure() ) {
-		log.SendLog("Failed to process the configuration\n");
+		log.SendLog(ELogLevel::error, "Failed to process the configuration\n");
 		return true;
 	}
 
@@ -1186,7 +1540,11 @@ bool CQnetGateway::Init(CFGDATA *pData)
 	if (qnDB.Open(fname.c_str()))
 		return true;
 
-	playNotInCache = false;
+	// the journal is nice to have, so the gateway runs without it
+	fname.assign(CFG_DIR);
+	fname.append("qso.jnl");
+	if (journal.Open(fname.c_str()))
+		log.SendLog(ELogLevel::warning, "Could not open the QSO journal %s\n", fname.c_str());
 
 	/* build the repeater callsigns for aprs */
 	Rptr.mod.call = OWNER;
@@ -1200,13 +1558,14 @@ bool CQnetGateway::Init(CFGDATA *pData)
 	Rptr.mod.band = "DV";
 	log.SendLog("Repeater callsign: [%s]\n", Rptr.mod.call.c_str());
 
+	SetCacheLimit(pCFGData->iCacheKB);
 	for (int j=0; j<2; j++) {
 		if (ircddb[j].ip.empty())
 			continue;
 		log.SendLog("connecting to %s at %u\n", ircddb[j].ip.c_str(), ircddb[j].port);
-		ii[j] = new CIRCDDB(ircddb[j].ip, ircddb[j].port, owner, IRCDDB_PASSWORD[j], GW_VERSION.c_str());
+		ii[j] = new CIRCDDB(ircddb[j].ip, ircddb[j].port, owner, IRCDDB_PASSWORD[j], GW_VERSION.c_str(), &cache, j);
 		if (! ii[j]->open()) {
-			log.SendLog("%s open failed\n", ircddb[j].ip.c_str());
+			log.SendLog(ELogLevel::error, "%s open failed\n", ircddb[j].ip.c_str());
 			return true;
 		}
 
@@ -1240,7 +1599,7 @@ bool CQnetGateway::Init(CFGDATA *pData)
 			af_family[j] = AF_INET6;
 			break;
 		default:
-			log.SendLog("%s server is using unknown protocol! Shutting down...\n", ircddb[j].ip.c_str());
+			log.SendLog(ELogLevel::error, "%s server is using unknown protocol! Shutting down...\n", ircddb[j].ip.c_str());
 			return true;
 		}
 	}
@@ -1249,14 +1608,14 @@ bool CQnetGateway::Init(CFGDATA *pData)
 		SPORTIP *pip = (AF_INET == af_family[0]) ? &g2_external : & g2_ipv6_external;
 		g2_sock[0] = open_port(pip, af_family[0]);
 		if (0 > g2_sock[0]) {
-			log.SendLog("Can't open %s:%d for %s\n", pip->ip.c_str(), pip->port, ircddb[0].ip.c_str());
+			log.SendLog(ELogLevel::error, "Can't open %s:%d for %s\n", pip->ip.c_str(), pip->port, ircddb[0].ip.c_str());
 			return true;
 		}
 		if (ii[1] && (af_family[0] != af_family[1])) {	// we only need to open a second port if the family for the irc servers are different!
 			SPORTIP *pip = (AF_INET == af_family[1]) ? &g2_external : & g2_ipv6_external;
 			g2_sock[1] = open_port(pip, af_family[1]);
 			if (0 > g2_sock[1]) {
-				log.SendLog("Can't open %s:%d for %s\n", pip->ip.c_str(), pip->port, ircddb[1].ip.c_str());
+				log.SendLog(ELogLevel::error, "Can't open %s:%d for %s\n", pip->ip.c_str(), pip->port, ircddb[1].ip.c_str());
 				return true;
 			}
 		}
@@ -1264,37 +1623,11 @@ bool CQnetGateway::Init(CFGDATA *pData)
 		SPORTIP *pip = (AF_INET == af_family[1]) ? &g2_external : & g2_ipv6_external;
 		g2_sock[1] = open_port(pip, af_family[1]);
 		if (0 > g2_sock[1]) {
-			log.SendLog("Can't open %s:%d for %s\n", pip->ip.c_str(), pip->port, ircddb[1].ip.c_str());
+			log.SendLog(ELogLevel::error, "Can't open %s:%d for %s\n", pip->ip.c_str(), pip->port, ircddb[1].ip.c_str());
 			return true;
 		}
 	}
 
-	// the repeater modules run on these ports
-	memset(toRptr.saved_hdr.title, 0, 56);
-	toRptr.saved_addr.Clear();
-
-	toRptr.streamid = 0;
-	toRptr.addr.Clear();
-
-	toRptr.last_time = 0;
-
-	toRptr.sequence = 0x0;
-
-	/*
-	   Initialize the end_of_audio that will be sent to the local repeater
-	   when audio from remote G2 has timed out
-	*/
-	memset(end_of_audio.title, 0U, 27U);
-	memcpy(end_of_audio.title, "DSVT", 4U);
-	end_of_audio.id = end_of_audio.config = 0x20U;
-	const unsigned char silence[9] = { 0x9EU, 0x8DU, 0x32U, 0x88U, 0x26U, 0x1AU, 0x3FU, 0x61U, 0xE8U };
-	memcpy(end_of_audio.vasd.voice, silence, 9U);
-
-	/* to remote systems */
-	to_remote_g2.toDstar.Clear();
-	to_remote_g2.streamid = 0;
-	to_remote_g2.last_time = 0;
-
 	log.SendLog("QnetGateway...entering processing loop\n");
 
 	if (GATEWAY_SEND_QRGS_MAP)
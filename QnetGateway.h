@@ -19,36 +19,67 @@
 #include <map>
 #include <set>
 #include <regex>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <future>
 
 #include "IRCDDB.h"
 #include "DSVT.h"
 #include "TypeDefs.h"
 #include "SockAddress.h"
-#include "UnixDgramSocket.h"
+#include "FrameRing.h"
 #include "Configure.h"
 #include "QnetDB.h"
 #include "DStarDecode.h"
 #include "QnetLog.h"
+#include "Journal.h"
+#include "StreamTable.h"
+#include "TimerWheel.h"
 
 #define MAXHOSTNAMELEN 64
 #define CALL_SIZE 8
 #define MAX_DTMF_BUF 32
-
-using STOREMOTEG2 = struct gate_to_remote_g2_tag {
-	unsigned short streamid;
-	CSockAddress toDstar;
-	time_t last_time;
+// how long a timed-out stream is remembered for header regeneration
+#define STREAM_EXPIRED_KEEP 60
+// the gateway's own timers, any other key in its wheel is a route's
+#define TIMER_BAND_TXT (uint64_t(1) << 63)
+#define TIMER_TO_REMOTE_G2 ((uint64_t(1) << 63) | 1U)
+
+// a packet from a remote gateway waiting for a module's worker
+using SINBOUND = struct inbound_tag {
+	CDSVT dsvt;
+	ssize_t length;
+	CSockAddress from;
 };
 
-using STOREPEATER = struct torepeater_tag {
-	// help with header re-generation
-	CDSVT saved_hdr; // repeater format
-	CSockAddress saved_addr;
+// Each module follows its own streams. The primary module, the one with the audio, is run on the
+// gateway thread and plays to gate2am. Every other module has a worker thread and plays to
+// gate2am plus its letter, if anything has that open.
+using SMODULE = struct module_tag {
+	char module;
+	bool primary;
+	CStreamTable streams;
+	// the streams' timeouts, run by whichever thread runs the module
+	CTimerWheel timers;
+	std::vector<uint64_t> due;
+	CFrameWriter *out;
+	CDSVT end_of_audio;
+	// only used by the other modules
+	CFrameWriter writer;
+	std::deque<SINBOUND> queue;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::future<void> worker;
+};
 
+using STOREMOTEG2 = struct gate_to_remote_g2_tag {
 	unsigned short streamid;
-	CSockAddress addr;
-	time_t last_time;
-	unsigned char sequence;
+	CSockAddress toDstar;
+	uint64_t last_time;	// in ms
+	uint64_t timer;		// when its timer is armed
 };
 
 class CQnetGateway {
@@ -56,10 +87,16 @@ public:
 	CQnetGateway();
 	~CQnetGateway();
 	void Process();
-	bool Init(CFGDATA *pData);
+	bool Init(const CFGDATA *pData);
+	// the route cache can be resized and read while the gateway runs
+	void SetCacheLimit(int kb) { cache.setLimit(kb > 0 ? 1024UL * kb : 0UL); }
+	void GetCacheStats(SCACHESTATS &stats) { cache.getStats(stats); }
 	std::atomic<bool> keep_running;
 
 private:
+	// qdvbench sets up a gateway without an irc connection
+	friend class CBench;
+
 	// configuration data
 	const CFGDATA *pCFGData;
     // link type
@@ -70,8 +107,8 @@ private:
 
 	CQnetDB qnDB;
 	CDStarDecode decode;
-	CUnixDgramReader AM2Gate;
-	CUnixDgramWriter Gate2AM;
+	CFrameReader AM2Gate;
+	CFrameWriter Gate2AM;
 
 	SPORTIP g2_external, g2_ipv6_external, ircddb[2];
 
@@ -101,19 +138,31 @@ private:
 
 	// Incoming data from remote systems
 	// must be fed into our local repeater modules.
-	STOREPEATER toRptr;
-
-	CDSVT end_of_audio;
+	// Every stream is followed, but only one plays on each module.
+	// The first module is the primary one.
+	std::vector<std::unique_ptr<SMODULE>> modules;
+	// which module each of the other modules' streams belongs to
+	CStreamTable routes;
+	// the routes' timeouts, and the local module's
+	CTimerWheel timers;
+	std::vector<uint64_t> due;
 
 	// send packets to g2_link
 	struct sockaddr_in plug;
 
-	// for talking with the irc server
+	// for talking with the irc servers, they both feed one cache
 	CIRCDDB *ii[2];
+	CCacheManager cache;
 
 	// logging
 	CQnetLog log;
 
+	// the stream history, txjournal and each stream's journal hold the start record of the open streams
+	CJournal journal;
+	SJOURNAL txjournal;
+	void JournalStart(SJOURNAL &rec, EJournalEvent event, const CDSVT &dsvt, char module);
+	void JournalEnd(SJOURNAL &rec, EJournalEvent event);
+
 	// text coming from local repeater bands
 	SBANDTXT band_txt;
 
@@ -127,12 +176,30 @@ private:
 	int open_port(const SPORTIP *pip, int family);
 	void calcPFCS(unsigned char *packet, int len);
 	void GetIRCDataThread(const int i);
-	int get_yrcall_rptr_from_cache(const int i, const std::string &call, std::string &rptr, std::string &gate, std::string &addr, char RoU);
+	int get_yrcall_rptr_from_cache(const std::string &call, std::string &rptr, std::string &gate, std::string &addr, char RoU, int &source);
 	int get_yrcall_rptr(const std::string &call, std::string &rptr, std::string &gate, std::string &addr, char RoU);
 	void ProcessTimeouts();
-	bool ProcessG2Msg(const unsigned char *data, std::string &smrtgrp);
-	void ProcessG2(const ssize_t g2buflen, CDSVT &g2buf);
-	void ProcessAudio(const CDSVT *packet);
+	void ModuleTimeouts(SMODULE &mod);
+	void StreamTimeout(SMODULE &mod, SSTREAM &stream, uint64_t key, uint64_t now);
+	void BandTimeout(uint64_t now);
+	void RemoteTimeout(uint64_t now);
+	bool ProcessG2Msg(const unsigned char *data, SSTREAM &stream, std::string &smrtgrp);
+	void ProcessG2(const ssize_t g2buflen, CDSVT &g2buf, CSockAddress &from);
+	void ProcessStream(SMODULE &mod, const ssize_t g2buflen, CDSVT &g2buf, CSockAddress &from);
+	void StartStream(SMODULE &mod, const CDSVT &hdr, CSockAddress &from);
+	void StreamVoice(SMODULE &mod, SSTREAM &stream, CDSVT &g2buf);
+	bool CallingUs(const CDSVT &hdr) const;
+	int StreamPriority(const CDSVT &hdr) const;
+	bool Transmitting(const SMODULE &mod) const;
+	SSTREAM *Playing(SMODULE &mod);
+	void Play(SMODULE &mod, SSTREAM &stream);
+	void PlayNext(SMODULE &mod);
+	void EndPlay(SMODULE &mod, SSTREAM &stream);
+	void Output(SMODULE &mod, const void *buf, size_t size);
+	SMODULE *FindModule(char module);
+	void Queue(SMODULE &mod, const ssize_t g2buflen, const CDSVT &g2buf, const CSockAddress &from);
+	void ModuleThread(SMODULE *mod, int cpu);
+	void ProcessAudio(CDSVT *packet);
 	bool Flag_is_ok(unsigned char flag);
 	void UnpackCallsigns(const std::string &str, std::set<std::string> &set, const std::string &delimiters = ",");
 	void PrintCallsigns(const std::string &key, const std::set<std::string> &set);
@@ -140,8 +207,10 @@ private:
 
 	// read configuration file
 	bool Configure();
+	bool InitStreams();
+	void InitModules();
 
 	void qrgs_and_maps();
 
-	void set_dest_rptr(std::string &call);
+	void set_dest_rptr(char module, std::string &call);
 };
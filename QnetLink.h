@@ -29,10 +29,17 @@
 #include "DSVT.h"
 #include "Random.h"
 #include "SockAddress.h"
-#include "UnixDgramSocket.h"
+#include "FrameRing.h"
 #include "Configure.h"
 #include "QnetDB.h"
 #include "QnetLog.h"
+#include "Resolver.h"
+#include "LinkState.h"
+#include "Journal.h"
+#include "PeerTable.h"
+#include "FanOut.h"
+#include "LinkProtocol.h"
+#include "TimerWheel.h"
 
 /*** version number must be x.xx ***/
 #define CALL_SIZE 8
@@ -40,17 +47,19 @@
 #define QUERY_SIZE 56
 #define MAXHOSTNAMELEN 64
 #define TIMEOUT 50
+// ms without a frame before the active stream is closed
+#define STREAM_TIMEOUT 3000
 #define LH_MAX_SIZE 39
 
-using STOREMOTE = struct link_to_remote_g2_tag {
-    char to_call[CALL_SIZE + 1];
-    CSockAddress addr;
-    char from_mod;
-    char to_mod;
-    short countdown;
-    bool is_connected;
-    unsigned short in_streamid;  // incoming from remote systems
-    unsigned short out_streamid; // outgoing to remote systems
+// the stream being played and passed on to the peers, there is only one at a time
+using SLINKSTREAM = struct link_stream_tag {
+	unsigned short streamid;	// 0 if there isn't one
+	int source;					// the peer's slot, or -1 for the local module
+	uint64_t deadline;			// in ms, it's closed if no frame comes by then
+	uint64_t timer;				// when its timer is armed
+	unsigned char ctrl;			// the frame counter expected next
+	CDSVT silent;				// fills in missing frames
+	CDSVT header;				// dcs puts its callsigns in every frame
 };
 
 using STRACING = struct tracing_tag {
@@ -63,36 +72,67 @@ public:
 	// functions
 	CQnetLink();
 	~CQnetLink();
-	bool Init(CFGDATA *pData);
+	bool Init(const CFGDATA *pData, CLinkState *pState = nullptr);
 	void Process();
 	void Shutdown();
 	std::atomic<bool> keep_running;
 private:
+	// qdvbench links to loopback reflectors without going through Link()
+	friend class CBench;
+
 	// functions
 	void ToUpper(std::string &s);
-	void calcPFCS(unsigned char *packet, int len);
 	bool Configure();
 	bool srv_open();
 	void srv_close();
-	bool resolve_rmt(const char *name, const unsigned short port, CSockAddress &addr);
 	void PlayAudioNotifyThread(char *msg);
 	void Link(const char *call, const char to_mod);
+	void PendingLink(SPEER &peer);
+	void SendLinkRequest(SPEER &peer);
+	void SendUnlink(SPEER &peer);
+	void Linked(SPEER &peer);
+	void Drop(SPEER &peer, ELinkEvent event);
+	SPEER *Accept(EPeerProto proto, const unsigned char *call, char mod);
+	void Notify(SPEER &peer, ELinkEvent event);
 	void Unlink();
+	void Heard(SPEER &peer);
+	uint64_t Key(const SPEER &peer, EPeerTimer timer) const;
+	void Arm(SPEER &peer);
+	void Timer(uint64_t key);
+	void Heartbeat(SPEER &peer);
+	void StartActive(unsigned short streamid, int source, const CDSVT &hdr);
+	void FromPeer(SPEER &peer, CDSVT &dsvt, int length);
+	void FromLocal(CDSVT &dsvt, int length);
+	void Play(CDSVT &dsvt, int length);
+	void Forward(const CDSVT &dsvt, int length, int source);
+	template <EPeerProto P> void ForwardTo(int sock, const CDSVT &dsvt, int length, int source);
+	void EndActive();
 
 	/* configuration data */
 	const CFGDATA *pCFGData;
+	CLinkState *pLinkState;
+	CJournal journal;
 	std::string owner, to_g2_external_ip, my_g2_link_ip, qnvoice_file, announce_dir;
-	bool only_admin_login, only_link_unlink, qso_details, log_debug, announce;
+	bool only_admin_login, only_link_unlink, qso_details, log_debug, announce, accept_links;
 	unsigned short rmt_xrf_port, rmt_ref_port, rmt_dcs_port, my_g2_link_port, to_g2_external_port;
     int delay_before;
 	std::string link_at_startup;
 	const unsigned char REF_ACK[3] = { 3, 96, 0 };
-	const unsigned char endbytes[6] = { 0x55U, 0x55U, 0x55U, 0x55U, 0xC8U, 0x7AU };
 
 
 	char notify_msg[64];
 
-	STOREMOTE to_remote_g2;
+	// the links we made and the ones made to us
+	CPeerTable peers;
+	CFanOut fanout;
+	SLINKSTREAM active;
+
+	// the peers' heartbeats and timeouts, and the active stream's timeout
+	CTimerWheel timers;
+	std::vector<uint64_t> due;
+	uint64_t now_ms;
+
+	CResolver resolver;
 
 	STRACING tracing;
 
@@ -103,8 +143,8 @@ private:
 	CSockAddress fromDst4;
 
 	// unix socket to the audio unit
-	CUnixDgramReader AM2Link;
-	CUnixDgramWriter Link2AM, LogInput;
+	CFrameReader AM2Link;
+	CFrameWriter Link2AM;
 
 	fd_set fdset;
 	struct timeval tv;
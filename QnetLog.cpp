@@ -18,31 +18,37 @@
 
 #include <ctime>
 #include <cstdio>
-#include <cstdarg>
+#include <cstring>
 
 #include "QnetLog.h"
 
-CQnetLog::CQnetLog()
+void CQnetLog::SendLog(const char *fmt, ...)
 {
-	LogInput.SetUp("log_input");
+	va_list args;
+	va_start(args, fmt);
+	VSendLog(ELogLevel::info, fmt, args);
+	va_end(args);
 }
 
-void CQnetLog::SendLog(const char *fmt, ...)
+void CQnetLog::SendLog(ELogLevel level, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	VSendLog(level, fmt, args);
+	va_end(args);
+}
+
+void CQnetLog::VSendLog(ELogLevel level, const char *fmt, va_list args)
 {
 	time_t ltime;
 	struct tm tm;
-	char buf[256];
+	char buf[LOG_LINE_SIZE];
 
 	time(&ltime);
 	localtime_r(&ltime, &tm);
 
-	std::snprintf(buf ,255,"%d:%02d:%02d: ", tm.tm_hour, tm.tm_min, tm.tm_sec);
-
-	va_list args;
-	va_start(args,fmt);
-	vsnprintf(buf + strlen(buf), 256 - strlen(buf) -1, fmt, args);
-	va_end(args);
+	int len = std::snprintf(buf, LOG_LINE_SIZE, "%d:%02d:%02d: ", tm.tm_hour, tm.tm_min, tm.tm_sec);
+	vsnprintf(buf + len, LOG_LINE_SIZE - len, fmt, args);
 
-	LogInput.Write(buf, strlen(buf)+1);
-	return;
+	CLogRing::Push(level, buf);
 }
@@ -17,15 +17,18 @@
  *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
-#include "UnixDgramSocket.h"
+#include <cstdarg>
+
+#include "LogRing.h"
 
 class CQnetLog
 {
 public:
-	CQnetLog();
+	CQnetLog() {}
 	~CQnetLog() {}
-	void SendLog(const char *fmt, ...);
+	void SendLog(const char *fmt, ...);	// at the info level
+	void SendLog(ELogLevel level, const char *fmt, ...);
 
 private:
-	CUnixDgramWriter LogInput;
+	void VSendLog(ELogLevel level, const char *fmt, va_list args);
 };
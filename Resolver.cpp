@@ -0,0 +1,197 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+
+#include "Resolver.h"
+
+// getaddrinfo() doesn't report the record TTL, so these are deliberately short
+#define RESOLVER_TTL 600
+#define RESOLVER_FAILED_TTL 30
+#define RESOLVER_REFRESH 60
+
+CResolver::CResolver() : keep_running(false)
+{
+}
+
+CResolver::~CResolver()
+{
+	Stop();
+}
+
+void CResolver::Start()
+{
+	if (keep_running)
+		return;
+	keep_running = true;
+	worker = std::async(std::launch::async, &CResolver::Worker, this);
+}
+
+void CResolver::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (! keep_running)
+			return;
+		keep_running = false;
+	}
+	cv.notify_one();
+	worker.get();
+}
+
+void CResolver::Request(const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	const auto it = cache.find(name);
+	if (cache.end()!=it && it->second.expires>time(nullptr))
+		return;
+	if (inprogress.end() == inprogress.find(name)) {
+		inprogress.insert(name);
+		requests.push_back(name);
+		cv.notify_one();
+	}
+}
+
+void CResolver::AddFavorite(const std::string &name)
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		favorites.insert(name);
+	}
+	Request(name);
+}
+
+EResolveState CResolver::Find(const std::string &name, const unsigned short port, CSockAddress &addr)
+{
+	// a numeric address doesn't need a lookup
+	unsigned char buf[sizeof(struct in6_addr)];
+	if (1 == inet_pton(AF_INET, name.c_str(), buf)) {
+		addr.Initialize(AF_INET, port, name.c_str());
+		return EResolveState::found;
+	}
+	if (1 == inet_pton(AF_INET6, name.c_str(), buf)) {
+		addr.Initialize(AF_INET6, port, name.c_str());
+		return EResolveState::found;
+	}
+
+	std::unique_lock<std::mutex> lock(mtx);
+	const auto it = cache.find(name);
+	if (cache.end() != it) {
+		bool stale = (it->second.expires <= time(nullptr));
+		if (! it->second.address.empty()) {
+			// a stale address is still used while it is being refreshed
+			addr.Initialize(it->second.family, port, it->second.address.c_str());
+			lock.unlock();
+			if (stale)
+				Request(name);
+			return EResolveState::found;
+		}
+		if (! stale)
+			return EResolveState::failed;
+	}
+	lock.unlock();
+	Request(name);
+	return EResolveState::pending;
+}
+
+void CResolver::Worker()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	while (keep_running) {
+		if (requests.empty()) {
+			cv.wait_for(lock, std::chrono::seconds(10));
+			// keep the favorites fresh
+			time_t now = time(nullptr);
+			for (const auto &f : favorites) {
+				const auto it = cache.find(f);
+				if (inprogress.end() != inprogress.find(f))
+					continue;
+				// a good address is refreshed before it expires, a failed lookup waits out RESOLVER_FAILED_TTL
+				if (cache.end()==it || (it->second.failed ? it->second.expires<=now : it->second.expires-now<RESOLVER_REFRESH)) {
+					inprogress.insert(f);
+					requests.push_back(f);
+				}
+			}
+			continue;
+		}
+
+		std::string name(requests.front());
+		requests.pop_front();
+		lock.unlock();
+
+		SRESOLVED r;
+		r.failed = Resolve(name, r.family, r.address);
+		r.expires = time(nullptr) + (r.failed ? RESOLVER_FAILED_TTL : RESOLVER_TTL);
+
+		lock.lock();
+		auto it = cache.find(name);
+		if (r.failed && cache.end()!=it && ! it->second.address.empty()) {
+			// keep the last good address, but try again soon
+			it->second.failed = true;
+			it->second.expires = r.expires;
+		} else
+			cache[name] = r;
+		inprogress.erase(name);
+	}
+}
+
+bool CResolver::Resolve(const std::string &name, int &family, std::string &address)
+// returns true on failure
+{
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	struct addrinfo *res;
+	int rc = getaddrinfo(name.c_str(), NULL, &hints, &res);
+	if (rc) {
+		fprintf(stderr, "getaddrinfo of %s failed: %s\n", name.c_str(), gai_strerror(rc));
+		return true;
+	}
+
+	bool failed = true;
+	for (struct addrinfo *rp=res; rp!=NULL; rp=rp->ai_next) {
+		char saddr[INET6_ADDRSTRLEN];
+		if (AF_INET == rp->ai_family) {
+			if (inet_ntop(AF_INET, &((struct sockaddr_in *)rp->ai_addr)->sin_addr, saddr, INET6_ADDRSTRLEN)) {
+				failed = false;
+			}
+		} else if (AF_INET6 == rp->ai_family) {
+			if (inet_ntop(AF_INET6, &((struct sockaddr_in6 *)rp->ai_addr)->sin6_addr, saddr, INET6_ADDRSTRLEN)) {
+				failed = false;
+			}
+		}
+		if (! failed) {
+			family = rp->ai_family;
+			address.assign(saddr);
+			break;
+		}
+	}
+	freeaddrinfo(res);
+
+	if (! failed)
+		printf("Node address %s resolved to %s\n", name.c_str(), address.c_str());
+	return failed;
+}
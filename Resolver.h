@@ -0,0 +1,67 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <string>
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <ctime>
+
+#include "SockAddress.h"
+
+enum class EResolveState { pending, found, failed };
+
+// host name lookups are done on a worker thread so that the caller never waits on DNS
+class CResolver {
+public:
+	CResolver();
+	~CResolver();
+
+	void Start();
+	void Stop();
+
+	// start a lookup if the name isn't cached, or the cached entry is stale
+	void Request(const std::string &name);
+	// same as Request, but the entry is refreshed before it expires
+	void AddFavorite(const std::string &name);
+	// never blocks, on found, addr is initialized with the resolved address and the port
+	EResolveState Find(const std::string &name, const unsigned short port, CSockAddress &addr);
+
+private:
+	using SRESOLVED = struct resolved_tag {
+		int family;
+		std::string address;
+		time_t expires;
+		bool failed;	// the last lookup failed, address is still the last good one, if there was one
+	};
+
+	void Worker();
+	bool Resolve(const std::string &name, int &family, std::string &address);
+
+	std::unordered_map<std::string, SRESOLVED> cache;
+	std::set<std::string> favorites, inprogress;
+	std::deque<std::string> requests;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::future<void> worker;
+	bool keep_running;
+};
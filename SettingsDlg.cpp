@@ -47,7 +47,7 @@ CFGDATA *CSettingsDlg::Show()
 	on_AudioRescanButton_clicked();	// re-read the audio PCM devices
 
 	if (Gtk::RESPONSE_OK == pDlg->run()) {
-		CFGDATA newstate;						// the user clicked okay, time to look at what's changed
+		CFGDATA newstate(data);					// the user clicked okay, time to look at what's changed, anything not in the dialog is kept
 		SaveWidgetStates(newstate);				// newstate is now the current contents of the Settings Dialog
 		pMainWindow->cfg.CopyFrom(newstate);	// and it is now in the global cfg object
 		pMainWindow->cfg.WriteData();			// and it's saved in ~/.config/qdv/qdv.cfg
@@ -70,6 +70,9 @@ void CSettingsDlg::SaveWidgetStates(CFGDATA &d)
 	// modes
 	d.bRouteEnable = pRoutingCheckbutton->get_active();
 	d.bLinkEnable = pLinkingCheckButton->get_active();
+	d.sModules.assign(pModulesEntry->get_text());
+	if (pCacheKBEntry->get_text().size())
+		d.iCacheKB = std::stoi(pCacheKBEntry->get_text());
 	// station
 	d.sCallsign.assign(pMyCallsignEntry->get_text());
 	d.sName.assign(pMyNameEntry->get_text());
@@ -95,6 +98,14 @@ void CSettingsDlg::SaveWidgetStates(CFGDATA &d)
 	//link
 	d.sLinkAtStart.assign(pLinkAtStartEntry->get_text());
 	d.bDPlusEnable = pDPlusEnableCheckButton->get_active();
+	d.bAcceptLinks = pAcceptLinksCheckButton->get_active();
+	// dashboard and capture, an empty entry keeps what was there
+	d.bStatusEnable = pStatusEnableCheckButton->get_active();
+	if (pStatusPortEntry->get_text().size())
+		d.usStatusPort = std::stoul(pStatusPortEntry->get_text());
+	d.bCaptureEnable = pCaptureEnableCheckButton->get_active();
+	if (pCaptureMBEntry->get_text().size())
+		d.iCaptureMB = std::stoi(pCaptureMBEntry->get_text());
 	// quadnet
 	if (pIPv6OnlyRadioButton->get_active())
 		d.eNetType = EQuadNetType::ipv6only;
@@ -120,6 +131,8 @@ void CSettingsDlg::SetWidgetStates(const CFGDATA &d)
 	// mode
 	pLinkingCheckButton->set_active(d.bLinkEnable);
 	pRoutingCheckbutton->set_active(d.bRouteEnable);
+	pModulesEntry->set_text(d.sModules);
+	pCacheKBEntry->set_text(std::to_string(d.iCacheKB));
 	// station
 	pMyCallsignEntry->set_text(d.sCallsign);
 	pMyNameEntry->set_text(d.sName);
@@ -145,6 +158,14 @@ void CSettingsDlg::SetWidgetStates(const CFGDATA &d)
 	pLinkAtStartEntry->set_text(d.sLinkAtStart);
 	if (d.bDPlusEnable != pDPlusEnableCheckButton->get_active())
 		pDPlusEnableCheckButton->set_active(d.bDPlusEnable);	// only do this if we need to
+	pAcceptLinksCheckButton->set_active(d.bAcceptLinks);
+	// dashboard and capture
+	pStatusEnableCheckButton->set_active(d.bStatusEnable);
+	pStatusPortEntry->set_text(std::to_string(d.usStatusPort));
+	pCaptureEnableCheckButton->set_active(d.bCaptureEnable);
+	pCaptureMBEntry->set_text(std::to_string(d.iCaptureMB));
+	on_StatusEnableCheckButton_toggled();
+	on_CaptureEnableCheckButton_toggled();
 	//quadnet
 	switch (d.eNetType) {
 		case EQuadNetType::ipv6only:
@@ -181,6 +202,8 @@ bool CSettingsDlg::Init(const Glib::RefPtr<Gtk::Builder> builder, const Glib::us
 	// modes
 	builder->get_widget("LinkingCheckButton", pLinkingCheckButton);
 	builder->get_widget("RoutingCheckButton", pRoutingCheckbutton);
+	builder->get_widget("ModulesEntry", pModulesEntry);
+	builder->get_widget("CacheKBEntry", pCacheKBEntry);
 
 	// station
 	builder->get_widget("MyCallsignEntry", pMyCallsignEntry);
@@ -211,6 +234,7 @@ bool CSettingsDlg::Init(const Glib::RefPtr<Gtk::Builder> builder, const Glib::us
 	// linking
 	builder->get_widget("LinkAtStartEntry", pLinkAtStartEntry);
 	builder->get_widget("LegacyCheckButton", pDPlusEnableCheckButton);
+	builder->get_widget("AcceptLinksCheckButton", pAcceptLinksCheckButton);
 	// QuadNet
 	builder->get_widget("IPV4_RadioButton", pIPv4OnlyRadioButton);
 	builder->get_widget("IPV6_RadioButton", pIPv6OnlyRadioButton);
@@ -238,6 +262,11 @@ bool CSettingsDlg::Init(const Glib::RefPtr<Gtk::Builder> builder, const Glib::us
 	builder->get_widget("GPSDEnableCheckButton", pGPSDEnableCheckButton);
 	builder->get_widget("GPSDServerEntry", pGPSDServerEntry);
 	builder->get_widget("GPSDPortEntry", pGPSDPortEntry);
+	// dashboard and capture
+	builder->get_widget("StatusEnableCheckButton", pStatusEnableCheckButton);
+	builder->get_widget("StatusPortEntry", pStatusPortEntry);
+	builder->get_widget("CaptureEnableCheckButton", pCaptureEnableCheckButton);
+	builder->get_widget("CaptureMBEntry", pCaptureMBEntry);
 
 	pMyCallsignEntry->signal_changed().connect(sigc::mem_fun(*this, &CSettingsDlg::on_MyCallsignEntry_changed));
 	pMyNameEntry->signal_changed().connect(sigc::mem_fun(*this, &CSettingsDlg::on_MyNameEntry_changed));
@@ -259,6 +288,12 @@ bool CSettingsDlg::Init(const Glib::RefPtr<Gtk::Builder> builder, const Glib::us
 	pAudioOutputComboBox->signal_changed().connect(sigc::mem_fun(*this, &CSettingsDlg::on_AudioOutputComboBox_changed));
 	pAPRSEnableCheckButton->signal_toggled().connect(sigc::mem_fun(*this, &CSettingsDlg::on_APRSEnableCheckButton_toggled));
 	pGPSDEnableCheckButton->signal_toggled().connect(sigc::mem_fun(*this, &CSettingsDlg::on_GPSDEnableCheckButton_toggled));
+	pModulesEntry->signal_changed().connect(sigc::mem_fun(*this, &CSettingsDlg::on_ModulesEntry_changed));
+	pCacheKBEntry->signal_changed().connect(sigc::mem_fun(*this, &CSettingsDlg::on_CacheKBEntry_changed));
+	pStatusPortEntry->signal_changed().connect(sigc::mem_fun(*this, &CSettingsDlg::on_StatusPortEntry_changed));
+	pCaptureMBEntry->signal_changed().connect(sigc::mem_fun(*this, &CSettingsDlg::on_CaptureMBEntry_changed));
+	pStatusEnableCheckButton->signal_toggled().connect(sigc::mem_fun(*this, &CSettingsDlg::on_StatusEnableCheckButton_toggled));
+	pCaptureEnableCheckButton->signal_toggled().connect(sigc::mem_fun(*this, &CSettingsDlg::on_CaptureEnableCheckButton_toggled));
 
 	return false;
 }
@@ -302,6 +337,16 @@ void CSettingsDlg::on_GPSDEnableCheckButton_toggled()
 	pGPSDPortEntry->set_sensitive(checked);
 }
 
+void CSettingsDlg::on_StatusEnableCheckButton_toggled()
+{
+	pStatusPortEntry->set_sensitive(pStatusEnableCheckButton->get_active());
+}
+
+void CSettingsDlg::on_CaptureEnableCheckButton_toggled()
+{
+	pCaptureMBEntry->set_sensitive(pCaptureEnableCheckButton->get_active());
+}
+
 void CSettingsDlg::on_UseMyCallsignCheckButton_toggled()
 {
 	if (pUseMyCallCheckButton->get_active()) {
@@ -390,6 +435,37 @@ void CSettingsDlg::on_GPSDPortEntry_changed()
 	OnIntegerChanged(pGPSDPortEntry);
 }
 
+void CSettingsDlg::on_CacheKBEntry_changed()
+{
+	OnIntegerChanged(pCacheKBEntry);
+}
+
+void CSettingsDlg::on_StatusPortEntry_changed()
+{
+	OnIntegerChanged(pStatusPortEntry);
+}
+
+void CSettingsDlg::on_CaptureMBEntry_changed()
+{
+	OnIntegerChanged(pCaptureMBEntry);
+}
+
+// the other module letters, the gateway skips the primary module and any repeats
+void CSettingsDlg::on_ModulesEntry_changed()
+{
+	int pos = pModulesEntry->get_position();
+	Glib::ustring s = pModulesEntry->get_text().uppercase();
+	const Glib::ustring good("ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+	Glib::ustring n;
+	for (auto it=s.begin(); it!=s.end(); it++) {
+		if (Glib::ustring::npos != good.find(*it)) {
+			n.append(1, *it);
+		}
+	}
+	pModulesEntry->set_text(n);
+	pModulesEntry->set_position(pos);
+}
+
 void CSettingsDlg::On20CharMsgChanged(Gtk::Entry *pEntry)
 {
 	int pos = pEntry->get_position();
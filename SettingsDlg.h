@@ -60,8 +60,8 @@ private:
 	// widgets
 	Gtk::Button *pAMBERescanButton, *pOkayButton, *pAudioRescanButton;
 	Gtk::ComboBox *pAudioInputComboBox, *pAudioOutputComboBox;
-	Gtk::CheckButton *pUseMyCallCheckButton, *pDPlusEnableCheckButton, *pAPRSEnableCheckButton, *pGPSDEnableCheckButton, *pLinkingCheckButton, *pRoutingCheckbutton;
-	Gtk::Entry *pStationCallsignEntry, *pMyCallsignEntry, *pMyNameEntry, *pMessageEntry, *pLocationEntry[2], *pURLEntry, *pLatitudeEntry, *pLongitudeEntry, *pLinkAtStartEntry, *pAPRSServerEntry, *pAPRSPortEntry, *pAPRSIntervalEntry, *pGPSDServerEntry, *pGPSDPortEntry;
+	Gtk::CheckButton *pUseMyCallCheckButton, *pDPlusEnableCheckButton, *pAPRSEnableCheckButton, *pGPSDEnableCheckButton, *pLinkingCheckButton, *pRoutingCheckbutton, *pAcceptLinksCheckButton, *pStatusEnableCheckButton, *pCaptureEnableCheckButton;
+	Gtk::Entry *pStationCallsignEntry, *pMyCallsignEntry, *pMyNameEntry, *pMessageEntry, *pLocationEntry[2], *pURLEntry, *pLatitudeEntry, *pLongitudeEntry, *pLinkAtStartEntry, *pAPRSServerEntry, *pAPRSPortEntry, *pAPRSIntervalEntry, *pGPSDServerEntry, *pGPSDPortEntry, *pModulesEntry, *pCacheKBEntry, *pStatusPortEntry, *pCaptureMBEntry;
 	Gtk::RadioButton *p230kRadioButton, *p460kRadioButton, *pIPv4OnlyRadioButton, *pIPv6OnlyRadioButton, *pDualStackRadioButton;
 	Gtk::Label *pDevicePathLabel, *pProductIDLabel, *pVersionLabel, *pInputDescLabel, *pOutputDescLabel;
 	// events
@@ -94,6 +94,12 @@ private:
 	void on_GPSDPortEntry_changed();
 	void on_APRSEnableCheckButton_toggled();
 	void on_GPSDEnableCheckButton_toggled();
+	void on_ModulesEntry_changed();
+	void on_CacheKBEntry_changed();
+	void on_StatusPortEntry_changed();
+	void on_CaptureMBEntry_changed();
+	void on_StatusEnableCheckButton_toggled();
+	void on_CaptureEnableCheckButton_toggled();
 	// state changed
 	void BaudrateChanged(int newBaudrate);
 };
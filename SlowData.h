@@ -0,0 +1,46 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cstring>
+#include <string>
+
+#include "DSVT.h"
+#include "Configure.h"
+
+// The header and the slow data of a transmission only depend on the configuration and
+// the urcall, so they're built once and each voice frame copies its three bytes out of
+// a table. The message is sent in every 70th superframe, the header in all the others.
+class CSlowData
+{
+public:
+	CSlowData(const CFGDATA &cfg, const std::string &urcall);
+	// true if this was built from the same configuration and urcall
+	bool Matches(const CFGDATA &cfg, const std::string &urcall) const;
+	// everything but the streamid
+	const CDSVT &Header() const { return header; }
+	// count is the number of voice frames already sent in this transmission
+	void Fill(const unsigned count, CDSVT &v) const { memcpy(v.vasd.text, text[(count / 21) % 70 ? 0 : 1][v.ctrl & 0x1FU], 3); }
+	static void CalcPFCS(const unsigned char *packet, unsigned char *pfcs);
+
+private:
+	unsigned version;
+	std::string urcall;
+	CDSVT header;
+	unsigned char text[2][32][3];	// [header or message][frame counter][slow data]
+};
@@ -0,0 +1,459 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <vector>
+
+#include "StatusServer.h"
+#include "FrameRing.h"
+#include "PipelineStats.h"
+
+#ifndef CFG_DIR
+#define CFG_DIR "/tmp/"
+#endif
+
+#define STATUS_POLL_MS 250
+#define STATUS_KEEPALIVE 15	// seconds between SSE comments, so proxies don't drop the stream
+#define STATUS_IDLE 10		// seconds a client has to send its request
+#define STATUS_MAX_REQUEST 4096
+#define STATUS_MAX_BACKLOG 65536	// an SSE client that falls this far behind is dropped
+
+static const char *status_page = R"(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>DigitalVoice</title>
+<style>body{font-family:sans-serif}table{border-collapse:collapse}td,th{padding:2px 8px;border-bottom:1px solid #ccc;text-align:left}</style>
+</head><body>
+<h2 id="station">DigitalVoice</h2>
+<p id="link"></p>
+<p id="stats"></p>
+<table><thead><tr><th>Callsign</th><th>Suffix</th><th>Your</th><th>Module</th><th>Last Heard</th><th>Duration</th><th>BER</th></tr></thead><tbody id="lh"></tbody></table>
+<script>
+function field(s) { return s.replace(/[&<>]/g, c => ({'&':'&amp;','<':'&lt;','>':'&gt;'})[c]); }
+function show(s) {
+	document.getElementById('station').textContent = s.station + ' module ' + s.module;
+	document.getElementById('link').textContent = s.links.length ? s.links.map(l => 'Linked to ' + l.callsign + ' since ' + new Date(1000 * l.time).toLocaleString()).join(', ') : 'Not linked';
+	document.getElementById('stats').textContent = s.gateways + ' gateways, ' + s.frames_in_use + ' of ' + s.frame_pool + ' frame slots in use, up ' + s.uptime + ' seconds';
+	let rows = '';
+	for (const h of s.lastheard) {
+		const ber = h.frames ? (100 * h.bit_errors / (24 * h.frames)).toFixed(2) + '%' : '';
+		const dur = h.duration ? (h.duration / 1000).toFixed(1) + ' s' : (h.event.endsWith('start') ? 'on the air' : '');
+		rows += '<tr><td>' + field(h.mycall) + '</td><td>' + field(h.sfx) + '</td><td>' + field(h.urcall) + '</td><td>' + h.module + '</td><td>' + new Date(h.time).toLocaleString() + '</td><td>' + dur + '</td><td>' + ber + '</td></tr>';
+	}
+	document.getElementById('lh').innerHTML = rows;
+}
+function refresh() { fetch('/status').then(r => r.json()).then(show); }
+const es = new EventSource('/events');
+es.addEventListener('journal', refresh);
+es.addEventListener('link', refresh);
+refresh();
+</script></body></html>
+)";
+
+CStatusServer::CStatusServer() : listenfd(-1), wakefd(-1), subscription(-1), module(' '), pLinkState(nullptr), gateways(0), keep_running(false), journal_open(false), started(0)
+{
+}
+
+CStatusServer::~CStatusServer()
+{
+	Stop();
+}
+
+bool CStatusServer::Start(unsigned short port, const std::string &call, char mod, CLinkState *pState)
+{
+	Stop();
+	station.assign(call);
+	module = mod;
+	pLinkState = pState;
+
+	// try dual stack first
+	listenfd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenfd >= 0) {
+		int off = 0;
+		setsockopt(listenfd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+		int on = 1;
+		setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		struct sockaddr_in6 addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin6_family = AF_INET6;
+		addr.sin6_addr = in6addr_any;
+		addr.sin6_port = htons(port);
+		if (bind(listenfd, (struct sockaddr *)&addr, sizeof(addr))) {
+			close(listenfd);
+			listenfd = -1;
+		}
+	}
+	if (listenfd < 0) {
+		listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (listenfd < 0) {
+			fprintf(stderr, "CStatusServer::Start socket error: %s\n", strerror(errno));
+			return true;
+		}
+		int on = 1;
+		setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons(port);
+		if (bind(listenfd, (struct sockaddr *)&addr, sizeof(addr))) {
+			fprintf(stderr, "CStatusServer::Start can't bind port %u: %s\n", port, strerror(errno));
+			close(listenfd);
+			listenfd = -1;
+			return true;
+		}
+	}
+	if (listen(listenfd, STATUS_MAX_CLIENTS)) {
+		fprintf(stderr, "CStatusServer::Start listen error: %s\n", strerror(errno));
+		close(listenfd);
+		listenfd = -1;
+		return true;
+	}
+
+	wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakefd < 0) {
+		fprintf(stderr, "CStatusServer::Start eventfd error: %s\n", strerror(errno));
+		close(listenfd);
+		listenfd = -1;
+		return true;
+	}
+	if (pLinkState) {
+		subscription = pLinkState->Subscribe([this](const SLINKEVENT &ev) {
+			std::lock_guard<std::mutex> lock(link_mtx);
+			link_events.push_back(ev);
+			eventfd_write(wakefd, 1);
+		});
+	}
+
+	time(&started);
+	keep_running = true;
+	worker = std::async(std::launch::async, &CStatusServer::Run, this);
+	printf("Status server listening on port %u\n", port);
+	return false;
+}
+
+void CStatusServer::Stop()
+{
+	if (pLinkState && subscription >= 0) {
+		pLinkState->Unsubscribe(subscription);
+		subscription = -1;
+	}
+	if (keep_running) {
+		keep_running = false;
+		eventfd_write(wakefd, 1);
+		worker.get();
+	}
+	for (auto &c : clients)
+		close(c.fd);
+	clients.clear();
+	if (listenfd >= 0) {
+		close(listenfd);
+		listenfd = -1;
+	}
+	if (wakefd >= 0) {
+		close(wakefd);
+		wakefd = -1;
+	}
+	journal.Close();
+	journal_open = false;
+}
+
+void CStatusServer::Run()
+{
+	time_t last_keepalive = time(nullptr), last_journal_try = 0;
+	std::vector<struct pollfd> fds;
+	while (keep_running) {
+		fds.clear();
+		fds.push_back({ listenfd, POLLIN, 0 });
+		fds.push_back({ wakefd, POLLIN, 0 });
+		for (const auto &c : clients) {
+			short events = c.closing ? 0 : POLLIN;
+			if (c.out.size())
+				events |= POLLOUT;
+			fds.push_back({ c.fd, events, 0 });
+		}
+
+		if (poll(fds.data(), fds.size(), STATUS_POLL_MS) < 0) {
+			if (EINTR == errno)
+				continue;
+			fprintf(stderr, "CStatusServer::Run poll error: %s\n", strerror(errno));
+			break;
+		}
+		if (! keep_running)
+			break;
+
+		// the clients are in the same order as their pollfds
+		auto it = clients.begin();
+		for (size_t i=2; i<fds.size() && it!=clients.end(); i++, it++) {
+			if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				it->closing = true;
+				it->out.clear();
+				continue;
+			}
+			if (fds[i].revents & POLLIN)
+				ReadClient(*it);
+			if (fds[i].revents & POLLOUT)
+				WriteClient(*it);
+		}
+		if (fds[0].revents & POLLIN)
+			Accept();
+		if (fds[1].revents & POLLIN) {
+			eventfd_t value;
+			eventfd_read(wakefd, &value);
+		}
+
+		// pick up link changes
+		std::deque<SLINKEVENT> events;
+		{
+			std::lock_guard<std::mutex> lock(link_mtx);
+			events.swap(link_events);
+		}
+		for (const auto &ev : events)
+			Broadcast("link", LinkJSON(ev));
+
+		// and the journal, which is cheap to look at
+		time_t now = time(nullptr);
+		if (! journal_open && now - last_journal_try > 5) {
+			last_journal_try = now;
+			const std::string path(CFG_DIR "qso.jnl");
+			if (0 == access(path.c_str(), R_OK) && ! journal.Open(path.c_str())) {
+				journal_open = true;
+				ReadJournal(false);
+			}
+		}
+		if (journal_open)
+			ReadJournal(true);
+
+		if (now - last_keepalive >= STATUS_KEEPALIVE) {
+			last_keepalive = now;
+			for (auto &c : clients) {
+				if (c.streaming)
+					c.out.append(": keepalive\n\n");
+			}
+		}
+
+		// send what's waiting and clean up
+		for (auto c=clients.begin(); c!=clients.end(); ) {
+			if (c->out.size() && ! c->closing)
+				WriteClient(*c);
+			const bool idle = (! c->streaming && now - c->last > STATUS_IDLE);
+			const bool behind = (c->out.size() > STATUS_MAX_BACKLOG);
+			if ((c->closing && c->out.empty()) || idle || behind) {
+				close(c->fd);
+				c = clients.erase(c);
+			} else
+				c++;
+		}
+	}
+}
+
+void CStatusServer::Accept()
+{
+	while (true) {
+		int fd = accept4(listenfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+			return;
+		if (clients.size() >= STATUS_MAX_CLIENTS) {
+			close(fd);
+			continue;
+		}
+		SCLIENT c;
+		c.fd = fd;
+		c.streaming = c.closing = false;
+		c.last = time(nullptr);
+		clients.push_back(c);
+	}
+}
+
+void CStatusServer::ReadClient(SCLIENT &client)
+{
+	char buf[1024];
+	ssize_t len = recv(client.fd, buf, sizeof(buf), MSG_DONTWAIT);
+	if (len <= 0) {
+		if (0 == len || (EAGAIN != errno && EWOULDBLOCK != errno)) {
+			client.closing = true;
+			if (client.streaming)
+				client.out.clear();
+		}
+		return;
+	}
+	if (client.streaming)
+		return;	// nothing more is expected
+	client.in.append(buf, len);
+	if (client.in.size() > STATUS_MAX_REQUEST) {
+		client.out.assign("HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+		client.closing = true;
+		return;
+	}
+	if (std::string::npos == client.in.find("\r\n\r\n"))
+		return;
+
+	// only the request line matters
+	const auto eol = client.in.find("\r\n");
+	const std::string line(client.in.substr(0, eol));
+	const auto sp1 = line.find(' ');
+	const auto sp2 = line.find(' ', sp1 + 1);
+	if (std::string::npos==sp1 || std::string::npos==sp2 || 0!=line.compare(0, sp1, "GET")) {
+		client.out.assign("HTTP/1.1 405 Method Not Allowed\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+		client.closing = true;
+		return;
+	}
+	std::string path(line.substr(sp1 + 1, sp2 - sp1 - 1));
+	const auto q = path.find('?');
+	if (std::string::npos != q)
+		path.resize(q);
+	Respond(client, path);
+}
+
+void CStatusServer::Respond(SCLIENT &client, const std::string &path)
+{
+	std::string type, body;
+	if (0 == path.compare("/")) {
+		type.assign("text/html; charset=utf-8");
+		body.assign(status_page);
+	} else if (0 == path.compare("/status")) {
+		type.assign("application/json");
+		body.assign(StatusJSON());
+	} else if (0 == path.compare("/stats")) {
+		type.assign("application/json");
+		body.assign(CPipelineStats::JSON());
+	} else if (0 == path.compare("/events")) {
+		client.out.assign("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nConnection: keep-alive\r\nAccess-Control-Allow-Origin: *\r\n\r\n");
+		client.out.append("retry: 5000\nevent: status\ndata: " + StatusJSON() + "\n\n");
+		client.streaming = true;
+		client.in.clear();
+		return;
+	} else {
+		client.out.assign("HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+		client.closing = true;
+		return;
+	}
+	client.out.assign("HTTP/1.1 200 OK\r\nContent-Type: " + type + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nCache-Control: no-cache\r\nAccess-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n");
+	client.out.append(body);
+	client.closing = true;
+}
+
+void CStatusServer::WriteClient(SCLIENT &client)
+{
+	while (client.out.size()) {
+		ssize_t len = send(client.fd, client.out.data(), client.out.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (len < 0) {
+			if (EAGAIN != errno && EWOULDBLOCK != errno) {
+				client.out.clear();
+				client.closing = true;
+			}
+			return;
+		}
+		client.out.erase(0, len);
+	}
+}
+
+void CStatusServer::Broadcast(const std::string &event, const std::string &json)
+{
+	for (auto &c : clients) {
+		if (c.streaming && ! c.closing)
+			c.out.append("event: " + event + "\ndata: " + json + "\n\n");
+	}
+}
+
+void CStatusServer::ReadJournal(bool broadcast)
+{
+	SJOURNAL rec;
+	while (! journal.Read(rec)) {
+		switch (rec.event) {
+			case EJournalEvent::rx_start:
+			case EJournalEvent::tx_start:
+				// one entry per callsign, the most recent first
+				for (auto it=lastheard.begin(); it!=lastheard.end(); it++) {
+					if (0 == memcmp(it->mycall, rec.mycall, 8)) {
+						lastheard.erase(it);
+						break;
+					}
+				}
+				lastheard.push_front(rec);
+				if (lastheard.size() > STATUS_LAST_HEARD)
+					lastheard.pop_back();
+				break;
+			case EJournalEvent::rx_end:
+			case EJournalEvent::tx_end:
+				for (auto &h : lastheard) {
+					if (h.streamid==rec.streamid && 0==memcmp(h.mycall, rec.mycall, 8)) {
+						const int64_t start = h.time;
+						h = rec;
+						h.time = start;
+						break;
+					}
+				}
+				break;
+			default:
+				break;
+		}
+		if (broadcast)
+			Broadcast("journal", JournalJSON(rec));
+	}
+}
+
+std::string CStatusServer::LinkJSON(const SLINKEVENT &ev)
+{
+	const char *state;
+	switch (ev.event) {
+		case ELinkEvent::linked:  state = "linked";   break;
+		case ELinkEvent::timeout: state = "timeout";  break;
+		case ELinkEvent::failed:  state = "failed";   break;
+		default:                  state = "unlinked"; break;
+	}
+	return std::string("{\"state\":\"") + state + "\",\"callsign\":\"" + JournalField(ev.callsign.c_str(), ev.callsign.size()) + "\",\"time\":" + std::to_string(ev.time) + "}";
+}
+
+std::string CStatusServer::StatusJSON()
+{
+	std::vector<SLINKEVENT> links;
+	if (pLinkState)
+		links = pLinkState->Linked();
+
+	std::string json("{\"station\":\"");
+	json.append(JournalField(station.c_str(), station.size()));
+	json.append("\",\"module\":\"").append(1, isalpha(module) ? module : ' ');
+	json.append("\",\"uptime\":").append(std::to_string(time(nullptr) - started));
+	json.append(",\"links\":[");
+	for (auto it=links.begin(); it!=links.end(); it++) {
+		if (it != links.begin())
+			json.append(",");
+		json.append(LinkJSON(*it));
+	}
+	json.append("]");
+	json.append(",\"gateways\":").append(std::to_string(gateways));
+	json.append(",\"frames_in_use\":").append(std::to_string(CFramePool::InUse()));
+	json.append(",\"frame_pool\":").append(std::to_string(FRAME_POOL_SIZE));
+	json.append(",\"lastheard\":[");
+	for (auto it=lastheard.begin(); it!=lastheard.end(); it++) {
+		if (it != lastheard.begin())
+			json.append(",");
+		json.append(JournalJSON(*it));
+	}
+	json.append("]}");
+	return json;
+}
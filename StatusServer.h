@@ -0,0 +1,84 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <string>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <ctime>
+
+#include "LinkState.h"
+#include "Journal.h"
+
+#define STATUS_MAX_CLIENTS 16
+#define STATUS_LAST_HEARD 20
+
+// A small HTTP server for the dashboard. Everything it serves comes from memory or from the
+// QSO journal, so it never touches the database:
+//   GET /        a self-contained status page
+//   GET /status  the current state as a JSON object
+//   GET /events  server-sent events, one for each journal record or link change
+class CStatusServer
+{
+public:
+	CStatusServer();
+	~CStatusServer();
+
+	// returns true on error
+	bool Start(unsigned short port, const std::string &station, char module, CLinkState *pState);
+	void Stop();
+	void SetGateways(int count) { gateways = count; }
+
+private:
+	using SCLIENT = struct client_tag {
+		int fd;
+		std::string in, out;
+		bool streaming;	// an SSE client, the connection stays open
+		bool closing;	// close as soon as out is sent
+		time_t last;
+	};
+
+	void Run();
+	void Accept();
+	void ReadClient(SCLIENT &client);
+	void WriteClient(SCLIENT &client);
+	void Respond(SCLIENT &client, const std::string &path);
+	void Broadcast(const std::string &event, const std::string &json);
+	void ReadJournal(bool broadcast);
+	std::string StatusJSON();
+	std::string LinkJSON(const SLINKEVENT &ev);
+
+	int listenfd, wakefd, subscription;
+	std::string station;
+	char module;
+	CLinkState *pLinkState;
+	std::atomic<int> gateways;
+	std::atomic<bool> keep_running;
+	std::future<void> worker;
+	std::list<SCLIENT> clients;
+	CJournalReader journal;
+	bool journal_open;
+	std::deque<SJOURNAL> lastheard;
+	// link events arrive on the link thread, the server thread picks them up
+	std::mutex link_mtx;
+	std::deque<SLINKEVENT> link_events;
+	time_t started;
+};
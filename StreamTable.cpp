@@ -0,0 +1,153 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cstring>
+
+#include "StreamTable.h"
+#include "TimerWheel.h"
+
+#define STREAM_TABLE_MASK (STREAM_TABLE_SIZE - 1)
+
+static_assert(0 == (STREAM_TABLE_SIZE & STREAM_TABLE_MASK), "STREAM_TABLE_SIZE must be a power of two");
+
+CStreamTable::CStreamTable() : serials(0)
+{
+	Clear();
+}
+
+void CStreamTable::Clear()
+{
+	for (unsigned i=0; i<STREAM_TABLE_SIZE; i++) {
+		table[i].streamid = 0;
+		table[i].superframe.clear();
+	}
+	count = 0;
+}
+
+unsigned CStreamTable::Hash(unsigned short streamid, const CSockAddress &addr)
+{
+	uint32_t h = streamid;
+	const struct sockaddr *sa = addr.GetCPointer();
+	if (AF_INET == sa->sa_family) {
+		h ^= ((const struct sockaddr_in *)sa)->sin_addr.s_addr;
+	} else if (AF_INET6 == sa->sa_family) {
+		uint32_t w[4];
+		memcpy(w, &((const struct sockaddr_in6 *)sa)->sin6_addr, 16);
+		h ^= w[0] ^ w[1] ^ w[2] ^ w[3];
+	}
+	h *= 0x9E3779B1U;	// Fibonacci hashing, the top bits are the best mixed
+	return h >> 26;
+}
+
+static_assert(STREAM_TABLE_SIZE == (1U << (32 - 26)), "Hash() has to match STREAM_TABLE_SIZE");
+
+SSTREAM *CStreamTable::Find(unsigned short streamid, const CSockAddress &addr)
+{
+	if (0 == streamid)
+		return nullptr;
+	for (unsigned i=Hash(streamid, addr), n=0; n<STREAM_TABLE_SIZE; i=(i+1)&STREAM_TABLE_MASK, n++) {
+		SSTREAM &s = table[i];
+		if (0 == s.streamid)
+			return nullptr;
+		if (streamid==s.streamid && addr==s.addr)
+			return &s;
+	}
+	return nullptr;
+}
+
+SSTREAM *CStreamTable::Insert(unsigned short streamid, const CSockAddress &addr)
+{
+	if (0==streamid || count >= STREAM_TABLE_SIZE - 1)
+		return nullptr;	// keep one slot empty so that a search always ends
+	unsigned i = Hash(streamid, addr);
+	while (table[i].streamid)
+		i = (i + 1) & STREAM_TABLE_MASK;
+	SSTREAM &s = table[i];
+	s.streamid = streamid;
+	s.addr = addr;
+	s.module = '\0';
+	s.state = EStreamState::monitoring;
+	s.priority = 0;
+	memset(s.header.title, 0, 56);
+	s.nextctrl = s.sequence = 0U;
+	s.last_time = CTimerWheel::Now();
+	if (0 == ++serials)
+		serials++;
+	s.serial = serials;
+	s.timer = 0U;
+	memset(&s.journal, 0, sizeof(SJOURNAL));
+	s.lhcallsign[0] = s.lhsfx[0] = '\0';
+	s.csroute = false;
+	s.msgpart = 0;
+	s.superframe.clear();
+	count++;
+	return &s;
+}
+
+void CStreamTable::Erase(SSTREAM *stream)
+{
+	unsigned i = unsigned(stream - table);
+	table[i].streamid = 0;
+	count--;
+	// move back anything that would no longer be found past the hole
+	unsigned j = i;
+	while (true) {
+		j = (j + 1) & STREAM_TABLE_MASK;
+		if (0 == table[j].streamid)
+			return;
+		const unsigned home = Hash(table[j].streamid, table[j].addr);
+		// the entry at j can fill the hole at i if its home isn't cyclically in (i, j]
+		if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+			table[i] = table[j];
+			table[j].streamid = 0;
+			i = j;
+		}
+	}
+}
+
+SSTREAM *CStreamTable::Best()
+{
+	SSTREAM *best = nullptr;
+	for (unsigned i=0; i<STREAM_TABLE_SIZE; i++) {
+		SSTREAM *s = At(i);
+		if (nullptr==s || EStreamState::monitoring!=s->state)
+			continue;
+		if (nullptr==best || s->priority>best->priority || (s->priority==best->priority && s->last_time>best->last_time))
+			best = s;
+	}
+	return best;
+}
+
+uint64_t CStreamTable::Key(const SSTREAM &stream)
+{
+	return (uint64_t(stream.serial) << 8) | Hash(stream.streamid, stream.addr);
+}
+
+SSTREAM *CStreamTable::Find(uint64_t key)
+{
+	// a stream is never moved past an empty slot from its home
+	const uint32_t serial = uint32_t(key >> 8);
+	for (unsigned i=unsigned(key & STREAM_TABLE_MASK), n=0; n<STREAM_TABLE_SIZE; i=(i+1)&STREAM_TABLE_MASK, n++) {
+		SSTREAM &s = table[i];
+		if (0 == s.streamid)
+			return nullptr;
+		if (serial == s.serial)
+			return &s;
+	}
+	return nullptr;
+}
@@ -0,0 +1,81 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <ctime>
+#include <cstdint>
+#include <string>
+
+#include "DSVT.h"
+#include "SockAddress.h"
+#include "Journal.h"
+
+// a power of two, far more streams than a gateway will ever see at once
+#define STREAM_TABLE_SIZE 64
+
+enum class EStreamState { playing, monitoring, expired };
+
+// one inbound stream from a remote gateway
+using SSTREAM = struct stream_tag {
+	unsigned short streamid;	// 0 marks an empty slot
+	CSockAddress addr;
+	char module;				// the one of our modules it's for
+	EStreamState state;
+	int priority;				// the higher one plays
+	CDSVT header;				// saved for header regeneration
+	unsigned char nextctrl;		// the frame counter we expect next
+	unsigned char sequence;		// the last frame counter we saw
+	uint64_t last_time;			// in ms, when it was last heard
+	uint32_t serial;			// tells it apart from whatever had its slot before
+	uint64_t timer;				// when its timer is armed
+	SJOURNAL journal;
+	char lhcallsign[9], lhsfx[5];
+	bool csroute;
+	unsigned msgpart;			// where we are in the slow data message
+	char msgtxt[21];
+	std::string superframe;		// for debugging
+};
+
+// An open-addressed table of streams, keyed by streamid and source address. Lookups are a
+// hash and usually one compare, and removal shifts entries back so there are no tombstones.
+class CStreamTable
+{
+public:
+	CStreamTable();
+	void Clear();
+	// nullptr if it isn't in the table
+	SSTREAM *Find(unsigned short streamid, const CSockAddress &addr);
+	// a cleared entry, or nullptr if the table is full
+	SSTREAM *Insert(unsigned short streamid, const CSockAddress &addr);
+	void Erase(SSTREAM *stream);
+	unsigned Size() const { return count; }
+	// for walking the table, nullptr if slot i is empty
+	SSTREAM *At(unsigned i) { return table[i].streamid ? table + i : nullptr; }
+	// the stream that should play next, nullptr if none are waiting
+	SSTREAM *Best();
+	// Erase() can move a stream, so a timer finds it again by its key
+	static uint64_t Key(const SSTREAM &stream);
+	// nullptr if it's gone
+	SSTREAM *Find(uint64_t key);
+
+private:
+	static unsigned Hash(unsigned short streamid, const CSockAddress &addr);
+	SSTREAM table[STREAM_TABLE_SIZE];
+	unsigned count;
+	uint32_t serials;
+};
@@ -73,24 +73,14 @@ bool CTCPReaderWriterClient::Open()
 	//hints.ai_flags = AI_PASSIVE;
 	hints.ai_protocol = IPPROTO_TCP;
 
+	// one try, the callers have their own retry loops and this shouldn't hold up their threads
 	struct addrinfo *res;
-	int s = EAI_AGAIN;
-	int count = 0;
-	while (EAI_AGAIN==s and count++<20) {
-		// connecting to a server, so we can wait until it's ready
-		s = getaddrinfo(m_address.c_str(), m_port.c_str(), &hints, &res);
-		if (s && s != EAI_AGAIN) {
-			fprintf(stderr, "ERROR: getaddrinfo of %s: %s\n", m_address.c_str(), gai_strerror(s));
-			return true;
-		}
-		std::this_thread::sleep_for(std::chrono::seconds(3));
+	int s = getaddrinfo(m_address.c_str(), m_port.c_str(), &hints, &res);
+	if (s) {
+		fprintf(stderr, "ERROR: getaddrinfo of %s: %s\n", m_address.c_str(), gai_strerror(s));
+		return true;
 	}
 
-    if (EAI_AGAIN == s) {
-        fprintf(stderr, "ERROR getaddrinfo of %s failed 20 times\n", m_address.c_str());
-        return true;
-    }
-
 	struct addrinfo *rp;
 	for (rp = res; rp != NULL; rp = rp->ai_next) {
 		m_fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
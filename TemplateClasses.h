@@ -22,6 +22,7 @@
 #include <string>
 
 #include "HostQueue.h"
+#include "PipelineStats.h"
 
 template <class T, int N> class CTFrame
 {
@@ -30,24 +31,28 @@ public:
 	{
 		memset(data, 0, N * sizeof(T));
 		sequence = 0U;
+		CPipelineStats::Clear(stamp);
 	}
 
 	CTFrame(const T *from)
 	{
 		memcpy(data, from, N * sizeof(T));
 		sequence = 0U;
+		CPipelineStats::Clear(stamp);
 	}
 
 	CTFrame(const CTFrame<T, N> &from)
 	{
 		memcpy(data, from.GetData(), N *sizeof(T));
 		sequence = from.GetSequence();
+		stamp = from.stamp;
 	}
 
 	CTFrame<T, N> &operator=(const CTFrame<T, N> &from)
 	{
 		memcpy(data, from.GetData(), N * sizeof(T));
 		sequence = from.GetSequence();
+		stamp = from.stamp;
 		return *this;
 	}
 
@@ -67,6 +72,8 @@ public:
 	}
 
 	~CTFrame() {}
+
+	STIMESTAMP stamp;	// where the frame is in the pipeline
 private:
 	T data[N];
 	unsigned char sequence;
@@ -76,4 +83,9 @@ using CAMBEFrame = CTFrame<unsigned char, 9>;
 using CAMBEQueue = CTQueue<CAMBEFrame>;
 using CAudioFrame = CTFrame<short int, 160>;
 using CAudioQueue = CTQueue<CAudioFrame>;
-using CSequenceQueue = CTQueue<unsigned char>;
+// the ambe device only gives back data, so the sequence and timing follow along in a queue
+using SSEQUENCE = struct sequence_tag {
+	unsigned char sequence;
+	STIMESTAMP stamp;
+};
+using CSequenceQueue = CTQueue<SSEQUENCE>;
@@ -0,0 +1,137 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <ctime>
+
+#include "TimerWheel.h"
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1U)
+#define WHEEL_RANGE (uint64_t(1) << (WHEEL_BITS * WHEEL_LEVELS))
+
+CTimerWheel::CTimerWheel() : freelist(-1), count(0)
+{
+	for (unsigned l=0; l<WHEEL_LEVELS; l++) {
+		for (unsigned s=0; s<WHEEL_SLOTS; s++)
+			slots[l][s] = -1;
+		level_count[l] = 0;
+	}
+	tick = Now();
+}
+
+uint64_t CTimerWheel::Now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000U + ts.tv_nsec / 1000000U;
+}
+
+void CTimerWheel::Add(uint64_t when, uint64_t key)
+{
+	int n = freelist;
+	if (n < 0) {
+		n = int(nodes.size());
+		nodes.emplace_back();
+	} else
+		freelist = nodes[n].next;
+	nodes[n].when = when;
+	nodes[n].key = key;
+	Insert(n);
+	count++;
+}
+
+void CTimerWheel::Arm(uint64_t &armed, uint64_t when, uint64_t key)
+{
+	if (0==armed || when<armed) {
+		armed = when;
+		Add(when, key);
+	}
+}
+
+bool CTimerWheel::Due(uint64_t &armed, uint64_t now)
+{
+	if (0==armed || armed>now)
+		return false;	// disarmed, or armed again for later and another key will come back then
+	armed = 0;
+	return true;
+}
+
+// a timer goes in the lowest level whose span covers it, in the slot its own time falls in
+void CTimerWheel::Insert(int n)
+{
+	uint64_t when = (nodes[n].when < tick) ? tick : nodes[n].when;
+	if (when - tick >= WHEEL_RANGE)
+		when = tick + WHEEL_RANGE - 1U;	// it goes round again when it reaches the bottom
+	unsigned level = 0;
+	while (level<WHEEL_LEVELS-1U && when-tick >= (uint64_t(1) << (WHEEL_BITS * (level + 1U))))
+		level++;
+	int &head = slots[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	nodes[n].next = head;
+	head = n;
+	level_count[level]++;
+}
+
+// the timers in the level's current slot move down, now that they are close enough
+void CTimerWheel::Cascade(unsigned level)
+{
+	int &head = slots[level][(tick >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	int n = head;
+	head = -1;
+	while (n >= 0) {
+		const int next = nodes[n].next;
+		level_count[level]--;
+		Insert(n);
+		n = next;
+	}
+}
+
+void CTimerWheel::Expire(uint64_t now, std::vector<uint64_t> &due)
+{
+	while (tick <= now) {
+		if (0 == count) {
+			tick = now + 1U;
+			return;
+		}
+		if (0 == (tick & WHEEL_MASK)) {
+			for (unsigned level=1; level<WHEEL_LEVELS; level++) {
+				Cascade(level);
+				if ((tick >> (WHEEL_BITS * level)) & WHEEL_MASK)
+					break;
+			}
+		}
+		int &head = slots[0][tick & WHEEL_MASK];
+		int n = head;
+		head = -1;
+		while (n >= 0) {
+			const int next = nodes[n].next;
+			level_count[0]--;
+			if (nodes[n].when > tick)
+				Insert(n);	// it was held at the top of the wheel
+			else {
+				due.push_back(nodes[n].key);
+				nodes[n].next = freelist;
+				freelist = n;
+				count--;
+			}
+			n = next;
+		}
+		tick++;
+		// skip ahead to the next cascade if there's nothing left on the bottom level
+		if (0==level_count[0] && (tick & WHEEL_MASK))
+			tick = (now < (tick | WHEEL_MASK)) ? now + 1U : (tick | WHEEL_MASK) + 1U;
+	}
+}
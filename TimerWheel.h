@@ -0,0 +1,65 @@
+#pragma once
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <cstdint>
+#include <vector>
+
+// four levels of 64 slots with a 1 ms tick cover about 4.6 hours, anything later is held at the top
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1U << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+// A hierarchical timing wheel. A timer is a 64-bit key that comes back from Expire() when it's due,
+// and the owner decides what the key means. Timers are never cancelled: the owner keeps the time a
+// key is armed for and ignores it if it comes back at any other time, so a timer only costs
+// something when it expires. It isn't locked, each thread has its own.
+class CTimerWheel
+{
+public:
+	CTimerWheel();
+	// CLOCK_MONOTONIC in milliseconds
+	static uint64_t Now();
+	// key will be returned by Expire() at or after when
+	void Add(uint64_t when, uint64_t key);
+	// armed is the owner's copy of when key is due, 0 if it isn't armed,
+	// the key is only added if it isn't already armed to come back sooner
+	void Arm(uint64_t &armed, uint64_t when, uint64_t key);
+	// true if a key returned by Expire() is the one the owner armed, and then it's disarmed
+	static bool Due(uint64_t &armed, uint64_t now);
+	// appends the keys that are due by now
+	void Expire(uint64_t now, std::vector<uint64_t> &due);
+	unsigned Size() const { return count; }
+
+private:
+	using STIMER = struct timer_tag {
+		uint64_t when;
+		uint64_t key;
+		int next;
+	};
+
+	void Insert(int n);
+	void Cascade(unsigned level);
+
+	std::vector<STIMER> nodes;
+	int freelist;
+	int slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	unsigned level_count[WHEEL_LEVELS];
+	uint64_t tick;	// the next millisecond to expire
+	unsigned count;
+};
@@ -17,6 +17,7 @@
  *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#include <cstdint>
 #include <string>
 
 #define CALL_SIZE 8
@@ -50,7 +51,8 @@ using SBANDTXT = struct band_txt_tag {
 	char lh_yrcall[CALL_SIZE + 1];
 	char lh_rpt1[CALL_SIZE + 1];
 	char lh_rpt2[CALL_SIZE + 1];
-	time_t last_time;
+	uint64_t last_time;	// in ms, 0 if nothing is coming from the local module
+	uint64_t timer;		// when its timer is armed
 	char txt[64];   // Only 20 are used
 	unsigned short txt_cnt;
 	bool sent_key_on_msg;
@@ -33,48 +33,135 @@
 #include "aprs.h"
 #include "Utilities.h"
 
-CAPRS::CAPRS() : keep_running(true) {}
+// a fix older than this isn't used
+#define GPS_MAXAGE 10
+// smart beaconing: below the slow speed the APRS interval is used, above the fast speed it's
+// the fast rate, and in between the rate goes up with the speed. Turning more than the turn
+// angle plus slope / speed also sends a beacon, but not more often than the turn time.
+#define SB_SLOW_SPEED 5.0	// mph
+#define SB_FAST_SPEED 60.0	// mph
+#define SB_FAST_RATE 180	// seconds
+#define SB_TURN_ANGLE 28.0	// degrees
+#define SB_TURN_SLOPE 255.0	// degrees * mph
+#define SB_TURN_TIME 30		// seconds
+
+static bool SmartBeacon(const SGPSFIX &fix, time_t elapsed, double last_track, int slow_rate)
+{
+	const double mph = fix.speed * 2.23694;
+	if (mph < SB_SLOW_SPEED)
+		return elapsed > slow_rate;
+	const int rate = (mph > SB_FAST_SPEED) ? SB_FAST_RATE : int(SB_FAST_RATE * SB_FAST_SPEED / mph);
+	if (elapsed > rate)
+		return true;
+	if (elapsed < SB_TURN_TIME || fix.track < 0.0 || last_track < 0.0)
+		return false;
+	double turn = fabs(fix.track - last_track);
+	if (turn > 180.0)
+		turn = 360.0 - turn;
+	return turn > SB_TURN_ANGLE + SB_TURN_SLOPE / mph;
+}
+
+// APRS wants degrees and decimal minutes, ddmm.mmN and dddmm.mmE
+static std::string APRSLatitude(double lat)
+{
+	double ipart;
+	const double fpart = modf(fabs(lat), &ipart);
+	char s[16];
+	snprintf(s, 16, "%07.2f%c", 100.0 * ipart + 60.0 * fpart, (lat < 0.0) ? 'S' : 'N');
+	return s;
+}
+
+static std::string APRSLongitude(double lon)
+{
+	double ipart;
+	const double fpart = modf(fabs(lon), &ipart);
+	char s[16];
+	snprintf(s, 16, "%08.2f%c", 100.0 * ipart + 60.0 * fpart, (lon < 0.0) ? 'W' : 'E');
+	return s;
+}
+
+// the course/speed data extension, empty if we aren't moving
+static std::string APRSCourseSpeed(const SGPSFIX &fix, bool hasfix)
+{
+	const double knots = fix.speed * 1.94384;
+	if (! hasfix || knots < 1.0 || fix.track < 0.0)
+		return std::string();
+	char s[16];
+	snprintf(s, 16, "%03d/%03d", (0 == int(fix.track + 0.5) % 360) ? 360 : int(fix.track + 0.5) % 360, int(knots + 0.5) % 1000);
+	return s;
+}
+
+CAPRS::CAPRS() : keep_running(false), reconnect(false), beacon_now(false), subscription(-1) {}
 
 CAPRS::~CAPRS()
 {
-    CloseSock();
+	Close();
 }
 
 void CAPRS::Init()
 {
-	cfg.CopyTo(cfgdata);
 	last_time = 0;
+	if (subscription < 0)
+		subscription = CConfigure::Subscribe(CFG_APRS | CFG_STATION | CFG_LOCATION | CFG_GPSD, [this](const CFGDATA &old, const CFGDATA &now) { ConfigChanged(old, now); });
+	if (CConfigure::Current()->bAPRSEnable)
+		Start();
+}
 
-	if (cfgdata.bAPRSEnable) {	// start the beacon thread
-		try {
-			aprs_future = std::async(std::launch::async, &CAPRS::APRSBeaconThread, this);
-		} catch (const std::exception &e) {
-			log.SendLog("Failed to start the APRSBeaconThread. Exception: %s\n", e.what());
-		}
-		if (aprs_future.valid())
-			log.SendLog("APRS beacon thread started\n");
+void CAPRS::Start()
+{
+	if (aprs_future.valid())
+		return;
+	keep_running = true;
+	try {
+		aprs_future = std::async(std::launch::async, &CAPRS::APRSBeaconThread, this);
+	} catch (const std::exception &e) {
+		log.SendLog(ELogLevel::error, "Failed to start the APRSBeaconThread. Exception: %s\n", e.what());
 	}
+	if (aprs_future.valid())
+		log.SendLog("APRS beacon thread started\n");
 }
 
-void CAPRS::Close()
+void CAPRS::Stop()
 {
 	keep_running = false;
 	FinishThread();
 	CloseSock();
 }
 
+void CAPRS::Close()
+{
+	if (subscription >= 0) {
+		CConfigure::Unsubscribe(subscription);
+		subscription = -1;
+	}
+	Stop();
+}
+
+void CAPRS::ConfigChanged(const CFGDATA &old, const CFGDATA &now)
+{
+	if (! now.bAPRSEnable) {
+		Stop();
+	} else if (! aprs_future.valid()) {
+		Start();
+	} else {
+		// the thread picks up everything else from the new snapshot
+		if (old.sAPRSServer.compare(now.sAPRSServer) || old.usAPRSPort!=now.usAPRSPort || old.sStation.compare(now.sStation) || old.cModule!=now.cModule)
+			reconnect = true;
+		beacon_now = true;
+	}
+}
+
 void CAPRS::FinishThread()
 {
 	// thread clean-up
-	if (cfgdata.bAPRSEnable) {
-		if (aprs_future.valid())
-			aprs_future.get();
-	}
+	if (aprs_future.valid())
+		aprs_future.get();
 }
 
 void CAPRS::UpdateUser()
 {
-	if (! cfgdata.bAPRSEnable || -1==aprs_sock.GetFD())
+	const CFGDATA *cfg = CConfigure::Current();
+	if (! cfg->bAPRSEnable || -1==aprs_sock.GetFD())
 		return;
 
 	char aprs_buf[1024];
@@ -83,18 +170,13 @@ void CAPRS::UpdateUser()
 	if ((tnow - last_time) < 30)
 		return;	// it hasn't even been 30 seconds
 
-	if (0.0==cfgdata.dLatitude && 0.0==cfgdata.dLongitude)
+	double lat, lon;
+	SGPSFIX fix;
+	const bool hasfix = GetPosition(cfg, lat, lon, fix);
+	if (0.0==lat && 0.0==lon)
 		return;	// nothing to report!
 
-	double fracp, intp;
-	fracp = modf(fabs(cfgdata.dLatitude), &intp);
-	const double lat = intp * 100.0 + fracp * 60.0;
-	const char latc = (cfgdata.dLatitude >= 0.0) ? 'N' : 'S';
-	fracp = modf(fabs(cfgdata.dLongitude), &intp);
-	const double lon = intp * 100.0 + fracp * 60.0;
-	const char lonc = (cfgdata.dLongitude >= 0.0) ? 'E' : 'W';
-
-	sprintf(aprs_buf, "%s>API51,qAR,%s-%c:!%.2f%c/%.2f%c[/\r\n", trim_copy(cfgdata.sCallsign).c_str(), trim_copy(cfgdata.sStation).c_str(), cfgdata.cModule, lat, latc, lon, lonc);
+	sprintf(aprs_buf, "%s>API51,qAR,%s-%c:!%s/%s[%s\r\n", trim_copy(cfg->sCallsign).c_str(), trim_copy(cfg->sStation).c_str(), cfg->cModule, APRSLatitude(lat).c_str(), APRSLongitude(lon).c_str(), APRSCourseSpeed(fix, hasfix).c_str());
 	log.SendLog("GPS-A=%s", aprs_buf);
     int rc = aprs_sock.Write((unsigned char *)aprs_buf, strlen(aprs_buf));
 	if (rc == -1) {
@@ -108,18 +190,36 @@ void CAPRS::UpdateUser()
 	last_time = tnow;
 }
 
+bool CAPRS::GetPosition(const CFGDATA *cfg, double &lat, double &lon, SGPSFIX &fix)
+// returns true if the position came from gpsd
+{
+	if (cfg->bGPSDEnable && gpsd.GetFix(fix, GPS_MAXAGE)) {
+		lat = fix.latitude;
+		lon = fix.longitude;
+		return true;
+	}
+	lat = cfg->dLatitude;
+	lon = cfg->dLongitude;
+	return false;
+}
+
 void CAPRS::Open()
 {
+	const CFGDATA *cfg = CConfigure::Current();
 	char snd_buf[512];
 	char rcv_buf[512];
-    while (aprs_sock.Open(cfgdata.sAPRSServer, AF_UNSPEC, std::to_string(cfgdata.usAPRSPort))) {
-        log.SendLog("Failed to open %s, retry in 10 seconds...\n", cfgdata.sAPRSServer.c_str());
-        std::this_thread::sleep_for(std::chrono::seconds(10));
+    while (aprs_sock.Open(cfg->sAPRSServer, AF_UNSPEC, std::to_string(cfg->usAPRSPort))) {
+        log.SendLog(ELogLevel::error, "Failed to open %s, retry in 10 seconds...\n", cfg->sAPRSServer.c_str());
+		// don't hold up Close() for the whole retry interval
+		for (int i=0; i<10 && keep_running; i++)
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+		if (! keep_running)
+			return;
     }
 
 	/* login to aprs */
 	//sprintf(snd_buf, "user %s pass %d vers QnetGateway 9 UDP 5 ", OWNER.c_str(), m_rptr->aprs_hash);
-	sprintf(snd_buf, "user %s pass %d vers QnetGateway-9 ", trim_copy(cfgdata.sStation).c_str(), compute_aprs_hash());
+	sprintf(snd_buf, "user %s pass %d vers QnetGateway-9 ", trim_copy(cfg->sStation).c_str(), compute_aprs_hash());
 
 	//log.SendLog("APRS Login command:[%s]\n", snd_buf);
 	strcat(snd_buf, "\r\n");
@@ -146,11 +246,9 @@ void CAPRS::Open()
 
 void CAPRS::CloseSock()
 {
-	if (cfgdata.bAPRSEnable) {
-		if (aprs_sock.GetFD() != -1) {
-			aprs_sock.Close();
-			log.SendLog("Closed APRS\n");
-		}
+	if (aprs_sock.GetFD() != -1) {
+		aprs_sock.Close();
+		log.SendLog("Closed APRS\n");
 	}
 }
 
@@ -177,8 +275,22 @@ void CAPRS::APRSBeaconThread()
 	time(&last_keepalive_time);
 
 	time_t last_beacon_time = 0;
+	double last_track = -1.0;
 	/* This thread is also saying to the APRS_HOST that we are ALIVE */
 	while (keep_running) {
+		// a new snapshot is picked up on every pass
+		const CFGDATA *cfg = CConfigure::Current();
+		if (reconnect.exchange(false))
+			aprs_sock.Close();
+		if (beacon_now.exchange(false))
+			last_beacon_time = 0;
+		// gpsd is polled here, the beacon thread never waits on it
+		if (cfg->bGPSDEnable) {
+			gpsd.Open(cfg->sGPSDServer, cfg->usGPSDPort);
+			gpsd.Poll();
+		} else
+			gpsd.Close();
+
 		if (aprs_sock.GetFD() == -1) {
 			Open();
 			if (aprs_sock.GetFD() == -1)
@@ -188,20 +300,22 @@ void CAPRS::APRSBeaconThread()
 		}
 
 		time(&tnow);
-		if ((tnow - last_beacon_time) > (cfgdata.iAPRSInterval * 60)) {
-			if (cfgdata.dLongitude || cfgdata.dLatitude) {
-				double fpart, ipart;
-				fpart = modf(fabs(cfgdata.dLatitude), &ipart);
-				const double lat = 100.0 * ipart + 60.0 * fpart;
-				fpart = modf(fabs(cfgdata.dLongitude), &ipart);
-				const double lon = 100.0 * ipart + 0.0 * fpart;
+		double latitude, longitude;
+		SGPSFIX fix;
+		const bool hasfix = GetPosition(cfg, latitude, longitude, fix);
+		// a moving station beacons by speed and heading, otherwise every APRS interval
+		if (hasfix ? SmartBeacon(fix, tnow - last_beacon_time, last_track, cfg->iAPRSInterval * 60) : (tnow - last_beacon_time) > (cfg->iAPRSInterval * 60)) {
+			if (longitude || latitude) {
+				std::string ext(APRSCourseSpeed(fix, hasfix));
+				if (ext.empty())
+					ext.assign("RNG0000");
 
 				/* send to aprs */
-				std::string modcall(cfgdata.sStation);
+				std::string modcall(cfg->sStation);
 				trim(modcall);
 				modcall.append(1, '-');
-				modcall.append(1, cfgdata.cModule);
-				sprintf(snd_buf, "%s>APJI23,TCPIP*,qAC,%sS:!%08.2f%cD%08.2f%c&RNG0000 DigitalVoice by_N7TAE",modcall.c_str(),  modcall.c_str(), lat, (cfgdata.dLatitude < 0.0)  ? 'S' : 'N', lon, (cfgdata.dLongitude < 0.0) ? 'W' : 'E');
+				modcall.append(1, cfg->cModule);
+				sprintf(snd_buf, "%s>APJI23,TCPIP*,qAC,%sS:!%sD%s&%s DigitalVoice by_N7TAE", modcall.c_str(), modcall.c_str(), APRSLatitude(latitude).c_str(), APRSLongitude(longitude).c_str(), ext.c_str());
 
 				// log.SendLog("APRS Beacon =[%s]\n", snd_buf);
 				strcat(snd_buf, "\r\n");
@@ -240,6 +354,7 @@ void CAPRS::APRSBeaconThread()
 			if (rc > 0)
 				THRESHOLD_COUNTDOWN = 15;
 			time(&last_beacon_time);
+			last_track = hasfix ? fix.track : -1.0;
 		}
 		/*
 		   Are we still receiving from APRS host ?
@@ -267,7 +382,7 @@ void CAPRS::APRSBeaconThread()
 					THRESHOLD_COUNTDOWN--;
 
 				if (THRESHOLD_COUNTDOWN == 0) {
-					log.SendLog("APRS host keepalive timeout\n");
+					log.SendLog(ELogLevel::warning, "APRS host keepalive timeout\n");
 					aprs_sock.Close();
 				}
 			}
@@ -275,6 +390,7 @@ void CAPRS::APRSBeaconThread()
 			time(&last_keepalive_time);
 		}
 	}
+	gpsd.Close();
 	log.SendLog("APRS beacon thread exiting...\n");
 }
 
@@ -283,7 +399,7 @@ int CAPRS::compute_aprs_hash()
 	int hash = 0x73e2;
 	char rptr_sign[9];
 
-	strcpy(rptr_sign, trim_copy(cfgdata.sStation).c_str());
+	strcpy(rptr_sign, trim_copy(CConfigure::Current()->sStation).c_str());
 	char *p = rptr_sign;
 	short int len = strlen(rptr_sign);
 
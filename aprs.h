@@ -26,6 +26,7 @@
 #include "TCPReaderWriterClient.h"
 #include "QnetLog.h"
 #include "Configure.h"
+#include "GPSD.h"
 
 class CAPRS {
 public:
@@ -33,26 +34,31 @@ public:
 	CAPRS();
 	~CAPRS();
 	void UpdateUser();
+	// starts the beacon thread if APRS is enabled, and follows the configuration from then on
 	void Init();
 	void Close();
 
 private:
 	// data
-	CFGDATA cfgdata;
  	std::future<void> aprs_future;
 	time_t last_time;
 	std::string station;
-	std::atomic<bool> keep_running;
+	std::atomic<bool> keep_running, reconnect, beacon_now;
+	int subscription;
 
 	// classes
 	CQnetLog log;
-	CConfigure cfg;
 	CTCPReaderWriterClient aprs_sock;
+	CGPSD gpsd;
 
 	// functions
 	int compute_aprs_hash();
+	bool GetPosition(const CFGDATA *cfg, double &lat, double &lon, SGPSFIX &fix);
 	void APRSBeaconThread();
 	void Open();
 	void CloseSock();
 	void FinishThread();
+	void Start();
+	void Stop();
+	void ConfigChanged(const CFGDATA &old, const CFGDATA &now);
 };
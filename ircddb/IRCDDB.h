@@ -21,7 +21,8 @@ class IRCClient;
 class CIRCDDB
 {
 public:
-	CIRCDDB(const std::string &hostName, unsigned int port, const std::string &callsign, const std::string &password, const std::string &versionInfo);
+	// the connections share cache, source is this one's index in it, less than CACHE_SOURCES
+	CIRCDDB(const std::string &hostName, unsigned int port, const std::string &callsign, const std::string &password, const std::string &versionInfo, CCacheManager *cache, int source);
 	~CIRCDDB();
 
 	// returns the socket family type
@@ -106,8 +107,6 @@ public:
 
 	void close();		// Implictely kills any threads in the IRC code
 
-	CCacheManager cache;
-
 private:
 	IRCDDBApp *app;
 	IRCClient *client;
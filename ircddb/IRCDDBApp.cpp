@@ -7,16 +7,18 @@
 #include "IRCDDBApp.h"
 #include "IRCutils.h"
 
-IRCDDBApp::IRCDDBApp(const std::string &u_chan, CCacheManager *cache) : numberOfTables(2)
+IRCDDBApp::IRCDDBApp(const std::string &u_chan, CCacheManager *cache, int source) : numberOfTables(2)
 {
 	updateChannel = u_chan;
 	this->cache = cache;
+	this->source = source;
 	maxTime = 950000000;	// Feb 2000
 	wdTimer = -1;
 	sendQ = NULL;
 	initReady = false;
 	state = 0;
 	timer = 0;
+	findTokens = FIND_RATE;
 	myNick = "none";
 
 
@@ -188,8 +190,8 @@ void IRCDDBApp::userJoin(const std::string &nick, const std::string &name, const
 	ToUpper(gate);
 	gate.resize(7, ' ');
 	gate.push_back('G');
-	cache->updateName(name, nick);
-	cache->updateGate(gate, addr);
+	cache->updateName(source, name, nick);
+	cache->updateGate(source, gate, addr);
 }
 
 void IRCDDBApp::userLeave(const std::string &nick)
@@ -205,17 +207,17 @@ void IRCDDBApp::userLeave(const std::string &nick)
 	name.pop_back();
 	if ('-' == name.back()) {
 		name.pop_back();
-		cache->eraseName(name);
+		cache->eraseName(source, name);
 		ToUpper(name);
 		name.resize(7, ' ');
 		name.push_back('G');
-		cache->eraseGate(name);
+		cache->eraseGate(source, name);
 	}
 }
 
 void IRCDDBApp::userListReset()
 {
-	cache->clearGate();	// clears the NameNick as well
+	cache->clearGate(source);	// clears our NameNick as well
 }
 
 void IRCDDBApp::setCurrentNick(const std::string &nick)
@@ -232,7 +234,7 @@ void IRCDDBApp::setBestServer(const std::string &ircUser)
 
 bool IRCDDBApp::findServerUser()
 {
-	std::string suser(cache->findServerUser());
+	std::string suser(cache->findServerUser(source));
 	if (suser.empty())
 		return false;
 	currentServer.assign(suser);
@@ -250,7 +252,7 @@ void IRCDDBApp::sendPing(const std::string &to, const std::string &from)
 		name.pop_back();
 	ToLower(name);
 
-	auto nick = cache->findNameNick(name);
+	auto nick = cache->findNameNick(source, name);
 
 	if (! nick.empty()) {
 		std::string rptr(from);
@@ -341,21 +343,40 @@ bool IRCDDBApp::sendHeard(const std::string &myCall, const std::string &myCallEx
 }
 
 bool IRCDDBApp::findUser(const std::string &usrCall)
+{
+	// only one FIND at a time for a user, and none for a user the server doesn't know
+	findMutex.lock();
+	if (findQueued.end()==findQueued.find(usrCall) && findQueue.size()<FIND_QUEUE_MAX && ! cache->findPending(source, usrCall)) {
+		findQueue.push_back(usrCall);
+		findQueued.insert(usrCall);
+		sendFinds();
+	}
+	findMutex.unlock();
+
+	return true;
+}
+
+// sends as many of the waiting FINDs as the rate allows, the caller locks findMutex
+void IRCDDBApp::sendFinds()
 {
 	std::string srv = currentServer;
 	IRCMessageQueue *q = getSendQ();
 
-	if ((srv.length() > 0) && (state >= 6) && (q != NULL)) {
-		std::string usr = usrCall;
+	if ((srv.length() == 0) || (state < 6) || (q == NULL))
+		return;
+
+	while ((findTokens > 0) && ! findQueue.empty()) {
+		std::string usr = findQueue.front();
+		findQueue.pop_front();
+		findQueued.erase(usr);
 
 		ReplaceChar(usr, ' ', '_');
 
 		IRCMessage *m = new IRCMessage(srv, std::string("FIND ") + usr );
 
 		q->putMessage(m);
+		findTokens--;
 	}
-
-	return true;
 }
 
 void IRCDDBApp::msgChannel(IRCMessage *m)
@@ -470,7 +491,7 @@ void IRCDDBApp::doUpdate(std::string &msg)
 					ReplaceChar(rptr, '_', ' ');
 					ReplaceChar(gate, '_', ' ');
 					gate[7] = 'G';
-					cache->updateRptr(rptr, gate, "");
+					cache->updateRptr(rptr, gate, tstr);
 					if (rtime > maxTime)
 						maxTime = rtime;
 				}
@@ -481,7 +502,7 @@ void IRCDDBApp::doUpdate(std::string &msg)
 				ReplaceChar(user, '_', ' ');
 				ReplaceChar(rptr, '_', ' ');
 
-				cache->updateUser(user, rptr, "", "", tstr);
+				cache->updateUser(user, rptr, tstr);
 
 			}
 		}
@@ -546,14 +567,7 @@ void IRCDDBApp::msgQuery(IRCMessage *m)
 
 			if (callsign.length() > 0) {
 				ReplaceChar(callsign, '_', ' ');
-
-				IRCMessage *m2 = new IRCMessage("IDRT_USER");
-				m2->addParam(callsign);
-				m2->addParam("");
-				m2->addParam("");
-				m2->addParam("");
-				m2->addParam("");
-				replyQ.putMessage(m2);
+				cache->updateNotFound(callsign);
 			}
 		}
 	}
@@ -769,10 +783,22 @@ void IRCDDBApp::Entry()
 			state = 0;
 			timer = 0;
 			initReady = false;
+			// the FINDs will be asked again if they are still needed
+			findMutex.lock();
+			findQueue.clear();
+			findQueued.clear();
+			findMutex.unlock();
+			cache->clearPending(source);
 			break;
 
 		}
 
+		// a new second, the waiting FINDs can go
+		findMutex.lock();
+		findTokens = FIND_RATE;
+		sendFinds();
+		findMutex.unlock();
+
 		sleep(1);
 
 	} // while
@@ -1,18 +1,26 @@
 #pragma once
 
 #include <string>
+#include <deque>
 #include <future>
 #include <map>
 #include <mutex>
 #include <regex>
+#include <set>
 
 #include "IRCDDB.h"
 #include "IRCMessageQueue.h"
 
+// FIND queries sent to the server each second, the rest wait their turn
+#define FIND_RATE 4
+// a FIND that would wait longer than FIND_TIMEOUT isn't queued, it can be asked again by then
+#define FIND_QUEUE_MAX (FIND_RATE * FIND_TIMEOUT)
+
 class IRCDDBApp
 {
 public:
-	IRCDDBApp(const std::string &update_channel, CCacheManager *cache);
+	// source is this connection's index in the shared cache
+	IRCDDBApp(const std::string &update_channel, CCacheManager *cache, int source);
 	~IRCDDBApp();
 
 	void userJoin(const std::string &nick, const std::string &name, const std::string &host);
@@ -61,12 +69,14 @@ private:
 	void doUpdate(std::string &msg);
 	void doNotFound(std::string &msg, std::string &retval);
 	bool findServerUser();
+	void sendFinds();
 	std::string getTableIDString(int tableID, bool spaceBeforeNumber);
 	std::string getLastEntryTime(int tableID);
 	std::future<void> worker_thread;
 	IRCMessageQueue *sendQ;
 	IRCMessageQueue replyQ;
 	CCacheManager *cache;
+	int source;
 
 	std::map<std::string, std::string> moduleMap;
 	std::mutex moduleMapMutex;
@@ -76,6 +86,10 @@ private:
 	std::mutex urlMapMutex;
 	std::map<std::string, std::string> swMap;
 	std::mutex swMapMutex;
+	std::deque<std::string> findQueue;
+	std::set<std::string> findQueued;	// the users in findQueue
+	std::mutex findMutex;
+	int findTokens;
 
 	std::string currentServer;
 	std::string myNick;
@@ -0,0 +1,525 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// drive the gateway and link packet paths with synthetic streams over loopback, no radio or GUI needed
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "QnetGateway.h"
+#include "QnetLink.h"
+#include "PipelineStats.h"
+
+#define BENCH_STATION "N0BNCH"
+#define BENCH_REMOTE "N1BNCH"	// the repeater the audio path is zone routed to
+#define BENCH_MODULE 'A'
+#define BENCH_PEER "127.0.0.2"	// the link knows a reflector by its address and port, so they need their own address
+
+enum class EPath { g2, audio, xrf, ref, dcs };
+static const char *path_name[] = { "g2", "audio", "xrf", "ref", "dcs" };
+
+using SRESULT = struct result_tag {
+	EPath path;
+	unsigned long sent, forwarded, streams;	// streams is how many had at least one frame forwarded
+	double seconds, cpu;			// cpu is the time used by the thread doing the processing
+	std::vector<uint32_t> latency;	// microseconds
+};
+
+static double ThreadCPU()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+// bind a udp socket on address, with the given port, or any port if it's zero, returns the port or 0 on failure
+static unsigned short Bind(int &sock, const char *address, unsigned short port)
+{
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		perror("socket");
+		return 0;
+	}
+	CSockAddress addr(AF_INET, port, address);
+	if (bind(sock, addr.GetPointer(), sizeof(struct sockaddr_in))) {
+		fprintf(stderr, "Could not bind %s:%u: %s\n", address, port, strerror(errno));
+		close(sock);
+		sock = -1;
+		return 0;
+	}
+	socklen_t len = sizeof(struct sockaddr_storage);
+	getsockname(sock, addr.GetPointer(), &len);
+	return addr.GetPort();
+}
+
+class CBench
+{
+public:
+	CBench(unsigned s, unsigned f, unsigned i);
+	~CBench();
+	bool Open();
+	bool Run(EPath path, SRESULT &result);
+
+private:
+	void Header(CDSVT &dsvt, unsigned short sid, const char *urcall, const char *rpt1, const char *rpt2);
+	void Voice(CDSVT &dsvt, unsigned short sid, unsigned f, uint32_t index);
+	void Send(EPath path, unsigned s, unsigned f);
+	void Consume(EPath path, SRESULT &result);
+	void Record(const CDSVT &dsvt, SRESULT &result);
+	void LinkTo(EPath path);
+
+	const unsigned streams, frames, interval;
+	CFGDATA cfg;
+	std::unique_ptr<CQnetGateway> gw;
+	std::unique_ptr<CQnetLink> link;
+	CFrameReader FromGate, FromLink;
+	CFrameWriter ToGate;
+	int source, sink, peer[3];
+	unsigned short g2_port, peer_port[3];
+	CSockAddress g2_addr, link_addr[3];
+
+	std::vector<unsigned short> sids;
+	unsigned short next_sid;
+	std::unique_ptr<std::atomic<uint64_t>[]> stamps;	// when each voice frame was sent, indexed by the number in its voice data
+	std::vector<bool> heard;	// streams with a forwarded frame, only the consumer writes it
+	std::atomic<unsigned long> forwarded;
+	std::atomic<uint64_t> last_forward;
+	std::atomic<bool> consuming;
+};
+
+CBench::CBench(unsigned s, unsigned f, unsigned i) : streams(s), frames(f), interval(i), cfg(), source(-1), sink(-1), next_sid(1)
+{
+	peer[0] = peer[1] = peer[2] = -1;
+	sids.resize(streams);
+	heard.resize(streams);
+	stamps.reset(new std::atomic<uint64_t>[streams * frames]);
+	cfg.sStation.assign(BENCH_STATION);
+	cfg.sCallsign.assign(BENCH_STATION);
+	cfg.cModule = BENCH_MODULE;
+	cfg.eNetType = EQuadNetType::ipv4only;
+}
+
+CBench::~CBench()
+{
+	if (gw) {
+		// it was never opened, so it can't be closed
+		delete gw->ii[0];
+		gw->ii[0] = nullptr;
+	}
+	if (link)
+		link->Shutdown();
+	for (int s : { source, sink, peer[0], peer[1], peer[2] }) {
+		if (s >= 0)
+			close(s);
+	}
+}
+
+// returns true on failure
+bool CBench::Open()
+{
+	if (FromGate.Open("gate2am") || FromLink.Open("link2am"))
+		return true;
+	ToGate.SetUp("am2gate");
+	if (0 == Bind(source, "127.0.0.1", 0) || 0 == Bind(sink, "127.0.0.1", 0))
+		return true;
+	for (int i=0; i<3; i++) {
+		peer_port[i] = Bind(peer[i], BENCH_PEER, 0);
+		if (0 == peer_port[i])
+			return true;
+	}
+
+	// a gateway without an irc connection, the route to BENCH_REMOTE is put straight into the cache
+	gw.reset(new CQnetGateway);
+	gw->pCFGData = &cfg;
+	if (gw->Configure() || gw->InitStreams())
+		return true;
+	gw->LOG_QSO = false;
+	gw->Gate2AM.SetUp("gate2am");
+	if (gw->AM2Gate.Open("am2gate") || gw->qnDB.Open(":memory:"))
+		return true;
+	gw->ii[0] = new CIRCDDB("localhost", 9007U, gw->owner, "", "qdvbench", &gw->cache, 0);
+	gw->cache.updateRptr(BENCH_REMOTE " A", BENCH_REMOTE " G", "");
+	gw->cache.updateGate(0, BENCH_REMOTE " G", "127.0.0.1");
+	gw->af_family[0] = AF_INET;
+	gw->g2_external.ip.assign("127.0.0.1");
+	gw->g2_external.port = 0U;
+	gw->g2_sock[0] = gw->open_port(&gw->g2_external, AF_INET);
+	if (gw->g2_sock[0] < 0)
+		return true;
+	CSockAddress addr;
+	socklen_t len = sizeof(struct sockaddr_storage);
+	getsockname(gw->g2_sock[0], addr.GetPointer(), &len);
+	g2_addr.Initialize(AF_INET, addr.GetPort(), "127.0.0.1");
+	len = sizeof(struct sockaddr_storage);
+	getsockname(sink, addr.GetPointer(), &len);
+	gw->g2_external.port = addr.GetPort();	// where routed streams are sent
+
+	// a link on 127.0.0.1 using the same port numbers as the loopback reflectors
+	link.reset(new CQnetLink);
+	link->pCFGData = &cfg;
+	if (link->Configure())
+		return true;
+	link->qso_details = false;
+	link->announce = false;
+	link->qnvoice_file.clear();
+	link->notify_msg[0] = '\0';
+	link->my_g2_link_ip.assign("127.0.0.1");
+	link->rmt_xrf_port = peer_port[0];
+	link->rmt_ref_port = peer_port[1];
+	link->rmt_dcs_port = peer_port[2];
+	if (link->qnDB.Open(":memory:") || ! link->srv_open())
+		return true;
+	// srv_open() leaves the dcs socket for sendto() to bind
+	CSockAddress dcs(AF_INET, peer_port[2], "127.0.0.1");
+	if (bind(link->dcs_g2_sock, dcs.GetPointer(), sizeof(struct sockaddr_in))) {
+		fprintf(stderr, "Could not bind the link dcs port: %s\n", strerror(errno));
+		return true;
+	}
+	for (int i=0; i<3; i++)
+		link_addr[i].Initialize(AF_INET, peer_port[i], "127.0.0.1");
+	return false;
+}
+
+void CBench::LinkTo(EPath path)
+{
+	const int i = int(path) - int(EPath::xrf);
+	const char *call[3] = { "XRF757  ", "REF001  ", "DCS001  " };
+	const EPeerProto proto[3] = { EPeerProto::xrf, EPeerProto::ref, EPeerProto::dcs };
+	link->peers.Clear();
+	SPEER &to = *link->peers.Add(proto[i], false);
+	strcpy(to.to_call, call[i]);
+	to.addr.Initialize(AF_INET, peer_port[i], BENCH_PEER);
+	to.from_mod = BENCH_MODULE;
+	to.to_mod = 'A';
+	to.is_connected = true;
+	link->now_ms = CTimerWheel::Now();
+	link->Arm(to);
+	link->old_sid = 0U;
+	memset(&link->active, 0, sizeof(SLINKSTREAM));
+}
+
+void CBench::Header(CDSVT &dsvt, unsigned short sid, const char *urcall, const char *rpt1, const char *rpt2)
+{
+	memset(dsvt.title, 0, 56);
+	memcpy(dsvt.title, "DSVT", 4);
+	dsvt.config = 0x10U;
+	dsvt.id = 0x20U;
+	dsvt.flagb[1] = 0x1U;
+	dsvt.flagb[2] = 0x3U;
+	dsvt.streamid = sid;
+	dsvt.ctrl = 0x80U;
+	memcpy(dsvt.hdr.rpt1, rpt1, 8);
+	memcpy(dsvt.hdr.rpt2, rpt2, 8);
+	memcpy(dsvt.hdr.urcall, urcall, 8);
+	memcpy(dsvt.hdr.mycall, BENCH_STATION "  ", 8);
+	memcpy(dsvt.hdr.sfx, "BNCH", 4);
+}
+
+void CBench::Voice(CDSVT &dsvt, unsigned short sid, unsigned f, uint32_t index)
+{
+	memset(dsvt.title, 0, 27);
+	memcpy(dsvt.title, "DSVT", 4);
+	dsvt.config = 0x20U;
+	dsvt.id = 0x20U;
+	dsvt.flagb[1] = 0x1U;
+	dsvt.flagb[2] = 0x3U;
+	dsvt.streamid = sid;
+	dsvt.ctrl = f % 21U;
+	if (f + 1U == frames)
+		dsvt.ctrl |= 0x40U;
+	// every path passes the voice data through untouched, so it carries the frame number
+	memcpy(dsvt.vasd.voice, &index, sizeof(uint32_t));
+	const unsigned char sync[3] = { 0x55U, 0x2DU, 0x16U }, filler[3] = { 0x70U, 0x4FU, 0x93U };
+	memcpy(dsvt.vasd.text, (f % 21U) ? filler : sync, 3);
+}
+
+void CBench::Send(EPath path, unsigned s, unsigned f)
+{
+	const unsigned short sid = sids[s];
+	const uint32_t index = s * frames + f;
+	CDSVT hdr, dsvt;
+	const int i = int(path) - int(EPath::xrf);
+	switch (path) {
+		case EPath::g2:
+			if (0U == f) {
+				Header(hdr, sid, "CQCQCQ  ", BENCH_STATION " A", BENCH_STATION " G");
+				sendto(source, hdr.title, 56, 0, g2_addr.GetCPointer(), g2_addr.GetSize());
+			}
+			Voice(dsvt, sid, f, index);
+			stamps[index] = CPipelineStats::Now();
+			sendto(source, dsvt.title, 27, 0, g2_addr.GetCPointer(), g2_addr.GetSize());
+			break;
+		case EPath::audio:
+			if (0U == f) {
+				Header(hdr, sid, "/" BENCH_REMOTE "A", BENCH_STATION " A", BENCH_STATION " G");
+				ToGate.Write(hdr.title, 56);
+			}
+			Voice(dsvt, sid, f, index);
+			stamps[index] = CPipelineStats::Now();
+			ToGate.Write(dsvt.title, 27);
+			break;
+		case EPath::xrf:
+			if (0U == f) {
+				Header(hdr, sid, "CQCQCQ  ", "XRF757 A", "XRF757 G");
+				sendto(peer[i], hdr.title, 56, 0, link_addr[i].GetCPointer(), link_addr[i].GetSize());
+			}
+			Voice(dsvt, sid, f, index);
+			stamps[index] = CPipelineStats::Now();
+			sendto(peer[i], dsvt.title, 27, 0, link_addr[i].GetCPointer(), link_addr[i].GetSize());
+			break;
+		case EPath::ref: {
+				CREFDSVT rdsvt;
+				if (0U == f) {
+					rdsvt.head[0] = 58U;
+					rdsvt.head[1] = 0x80U;
+					Header(rdsvt.dsvt, sid, "CQCQCQ  ", "REF001 A", "REF001 G");
+					sendto(peer[i], rdsvt.head, 58, 0, link_addr[i].GetCPointer(), link_addr[i].GetSize());
+				}
+				Voice(rdsvt.dsvt, sid, f, index);
+				rdsvt.head[0] = (rdsvt.dsvt.ctrl & 0x40U) ? 32U : 29U;
+				rdsvt.head[1] = 0x80U;
+				if (32U == rdsvt.head[0]) {
+					const unsigned char endbytes[6] = { 0x55U, 0x55U, 0x55U, 0x55U, 0xC8U, 0x7AU };
+					memcpy(rdsvt.dsvt.vend.end, endbytes, 6);
+				}
+				stamps[index] = CPipelineStats::Now();
+				sendto(peer[i], rdsvt.head, rdsvt.head[0], 0, link_addr[i].GetCPointer(), link_addr[i].GetSize());
+			}
+			break;
+		case EPath::dcs: {
+				// dcs has no header packet, every voice packet carries the callsigns
+				unsigned char buf[100];
+				memset(buf, 0, 100);
+				memcpy(buf, "0001", 4);
+				memcpy(buf + 7, "DCS001 A", 8);
+				memcpy(buf + 15, "DCS001 G", 8);
+				memcpy(buf + 23, "CQCQCQ  ", 8);
+				memcpy(buf + 31, BENCH_STATION "  ", 8);
+				memcpy(buf + 39, "BNCH", 4);
+				Voice(dsvt, sid, f, index);
+				memcpy(buf + 43, &dsvt.streamid, 2);
+				buf[45] = dsvt.ctrl;
+				memcpy(buf + 46, dsvt.vasd.voice, 12);
+				buf[61] = 0x1U;
+				stamps[index] = CPipelineStats::Now();
+				sendto(peer[i], buf, 100, 0, link_addr[i].GetCPointer(), link_addr[i].GetSize());
+			}
+			break;
+	}
+}
+
+void CBench::Record(const CDSVT &dsvt, SRESULT &result)
+{
+	if (0x20U != dsvt.config)
+		return;
+	uint32_t index;
+	memcpy(&index, dsvt.vasd.voice, sizeof(uint32_t));
+	if (index >= streams * frames)
+		return;	// a silent frame the gateway or link filled in
+	const uint64_t sent = stamps[index].exchange(0);
+	if (0 == sent)
+		return;	// a repeat
+	const uint64_t now = CPipelineStats::Now();
+	result.latency.push_back(uint32_t((now - sent) / 1000U));
+	heard[index / frames] = true;
+	last_forward = now;
+	forwarded++;
+}
+
+void CBench::Consume(EPath path, SRESULT &result)
+{
+	CFrameReader &reader = (EPath::g2 == path) ? FromGate : FromLink;
+	struct pollfd pfd;
+	pfd.fd = (EPath::audio == path) ? sink : reader.GetFD();
+	pfd.events = POLLIN;
+	while (consuming) {
+		if (poll(&pfd, 1, 20) <= 0)
+			continue;
+		if (EPath::audio == path) {
+			CDSVT dsvt;
+			while (recv(sink, dsvt.title, 56, MSG_DONTWAIT) > 0)
+				Record(dsvt, result);
+		} else {
+			reader.Clear();
+			ssize_t length;
+			CDSVT *frame;
+			while (nullptr != (frame = reader.Read(length))) {
+				Record(*frame, result);
+				reader.Release(frame);
+			}
+		}
+	}
+}
+
+// returns true on failure
+bool CBench::Run(EPath path, SRESULT &result)
+{
+	result.path = path;
+	result.latency.clear();
+	result.latency.reserve(streams * frames);
+	for (unsigned i=0; i<streams*frames; i++)
+		stamps[i] = 0;
+	std::fill(heard.begin(), heard.end(), false);
+	for (auto &sid : sids) {
+		if (0U == next_sid)
+			next_sid++;
+		sid = htons(next_sid++);
+	}
+	forwarded = 0;
+	last_forward = 0;
+
+	std::future<double> worker;
+	const bool gateway = (EPath::g2==path || EPath::audio==path);
+	if (gateway) {
+		if (gw->InitStreams())
+			return true;
+		gw->keep_running = true;
+		worker = std::async(std::launch::async, [this]() { const double start = ThreadCPU(); gw->Process(); return ThreadCPU() - start; });
+	} else {
+		LinkTo(path);
+		link->keep_running = true;
+		worker = std::async(std::launch::async, [this]() { const double start = ThreadCPU(); link->Process(); return ThreadCPU() - start; });
+	}
+	consuming = true;
+	auto consumer = std::async(std::launch::async, &CBench::Consume, this, path, std::ref(result));
+
+	// a module plays one stream at a time and drops any other that shows up, so the streams go one after another
+	const uint64_t start = CPipelineStats::Now();
+	uint64_t next = start;
+	for (unsigned s=0; s<streams; s++) {
+		for (unsigned f=0; f<frames; f++) {
+			Send(path, s, f);
+			next += 1000U * interval;
+			const uint64_t now = CPipelineStats::Now();
+			if (next > now)
+				std::this_thread::sleep_for(std::chrono::nanoseconds(next - now));
+		}
+	}
+	result.sent = (unsigned long)streams * frames;
+	const uint64_t sent = CPipelineStats::Now();
+
+	// wait until it's been quiet for 200 ms
+	unsigned long count = forwarded;
+	for (int quiet=0, wait=0; quiet<4 && wait<60; wait++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		if (count == forwarded) {
+			quiet++;
+		} else {
+			count = forwarded;
+			quiet = 0;
+		}
+	}
+
+	consuming = false;
+	consumer.get();
+	if (gateway)
+		gw->keep_running = false;
+	else
+		link->keep_running = false;
+	result.cpu = worker.get();
+	result.forwarded = forwarded;
+	result.streams = std::count(heard.begin(), heard.end(), true);
+	result.seconds = 1.0e-9 * (std::max(sent, uint64_t(last_forward)) - start);
+	return false;
+}
+
+static uint32_t Percentile(const std::vector<uint32_t> &sorted, double p)
+{
+	if (sorted.empty())
+		return 0U;
+	return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned streams = 10U, frames = 100U, interval = 20000U;
+	std::string paths("g2,audio,xrf,ref,dcs");
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "s:f:i:p:"))) {
+		switch (opt) {
+			case 's':
+				streams = unsigned(strtoul(optarg, nullptr, 10));
+				break;
+			case 'f':
+				frames = unsigned(strtoul(optarg, nullptr, 10));
+				break;
+			case 'i':
+				interval = unsigned(strtoul(optarg, nullptr, 10));
+				break;
+			case 'p':
+				paths.assign(optarg);
+				break;
+			default:
+				streams = 0U;
+				break;
+		}
+	}
+	if (0U==streams || 0U==frames || streams>30000U) {
+		fprintf(stderr, "usage: %s [-s streams] [-f frames] [-i interval] [-p paths]\n", argv[0]);
+		fprintf(stderr, "  -s streams, sent one after another, 1 to 30000, default 10\n");
+		fprintf(stderr, "  -f voice frames per stream, default 100\n");
+		fprintf(stderr, "  -i microseconds between frames, default 20000, 0 sends as fast as possible\n");
+		fprintf(stderr, "  -p comma separated paths to run, default g2,audio,xrf,ref,dcs\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<SRESULT> results;
+	{
+		CBench bench(streams, frames, interval);
+		if (bench.Open()) {
+			fprintf(stderr, "Could not set up the gateway and link\n");
+			return EXIT_FAILURE;
+		}
+		for (int p=0; p<5; p++) {
+			const std::string name(path_name[p]);
+			if (std::string::npos == (',' + paths + ',').find(',' + name + ','))
+				continue;
+			results.emplace_back();
+			if (bench.Run(EPath(p), results.back())) {
+				fprintf(stderr, "The %s path failed\n", path_name[p]);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	printf("\n%u streams of %u frames, %u us apart\n", streams, frames, interval);
+	printf("path        sent  forwarded      %%  streams    pkts/s   p50 us   p99 us  cpu ms/stream  cpu us/pkt\n");
+	for (auto &r : results) {
+		std::sort(r.latency.begin(), r.latency.end());
+		// the rates and the cpu are for what was forwarded, a dropped frame costs next to nothing
+		printf("%-5s %10lu %10lu %6.1f %8lu %9.0f %8u %8u %14.3f %11.3f\n", path_name[int(r.path)], r.sent, r.forwarded, 100.0 * r.forwarded / r.sent, r.streams,
+			r.seconds > 0.0 ? r.forwarded / r.seconds : 0.0, Percentile(r.latency, 0.5), Percentile(r.latency, 0.99),
+			r.streams ? 1.0e3 * r.cpu / r.streams : 0.0, r.forwarded ? 1.0e6 * r.cpu / r.forwarded : 0.0);
+	}
+	return EXIT_SUCCESS;
+}
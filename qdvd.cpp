@@ -0,0 +1,580 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// the gateway, the link, the audio manager and APRS without the GUI, controlled over a unix socket
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <ctime>
+#include <string>
+#include <sstream>
+#include <future>
+#include <atomic>
+
+#include "Configure.h"
+#include "QnetGateway.h"
+#include "QnetLink.h"
+#include "LinkState.h"
+#include "LogRing.h"
+#include "StatusServer.h"
+#include "PipelineStats.h"
+#include "QnetDB.h"
+#include "HostFile.h"
+#include "DPlusAuthenticator.h"
+#include "AudioManager.h"
+#include "aprs.h"
+#include "Capture.h"
+
+#ifndef CFG_DIR
+#define CFG_DIR "/tmp/"
+#endif
+
+#define LOG_DRAIN_MS 250	// how often the log ring is written to stdout
+#define HOSTFILE_CHECK 2	// seconds between host file checks
+#define CONTROL_LINE 256	// the longest command
+
+static const char *ControlPath()
+{
+	static const std::string path(std::string(CFG_DIR) + "qdvd.sock");
+	return path.c_str();
+}
+
+static std::string CapturePath()
+{
+	return std::string(CFG_DIR) + "qdv.cap";
+}
+
+class CDaemon
+{
+public:
+	CDaemon();
+	~CDaemon();
+
+	bool Init();
+	void Run();
+
+private:
+	CConfigure cfg;
+	CFGDATA cfgdata;
+	CAudioManager AudioManager;
+	CQnetDB qnDB;
+	CHostFile hostfile;
+	CDPlusAuthenticator dplus;
+	CLinkState linkstate;
+	CStatusServer status;
+	CAPRS aprs;
+
+	CQnetGateway *pGate;
+	CQnetLink *pLink;
+	std::future<void> futGate, futLink;
+	std::atomic<bool> is_receiving;
+	bool is_transmitting, is_echoing;
+	int ctlfd, sigfd, cfg_subscription;
+
+	void StartGate();
+	void StartLink();
+	void StopGate();
+	void StopLink();
+	void RebuildGateways();
+	void StoreDPlus();
+	void Reload();
+	void ConfigChanged(const CFGDATA &old, const CFGDATA &now);
+	void DrainLog();
+	void Control();
+	std::string Command(const std::string &line, bool &quit);
+	std::string Status();
+};
+
+CDaemon::CDaemon() : pGate(nullptr), pLink(nullptr), is_receiving(false), is_transmitting(false), is_echoing(false), ctlfd(-1), sigfd(-1), cfg_subscription(-1)
+{
+	cfg.CopyTo(cfgdata);
+	hostfile.SetPath(std::string(CFG_DIR) + "gwys.txt");
+}
+
+CDaemon::~CDaemon()
+{
+	if (cfg_subscription >= 0)
+		CConfigure::Unsubscribe(cfg_subscription);
+	aprs.Close();
+	AudioManager.Close();
+	status.Stop();
+	StopLink();
+	StopGate();
+	CCapture::Close();
+	if (ctlfd >= 0) {
+		close(ctlfd);
+		unlink(ControlPath());
+	}
+	if (sigfd >= 0)
+		close(sigfd);
+	DrainLog();
+}
+
+// the objects are created and destroyed here, so pGate and pLink are only ever touched by the control loop
+void CDaemon::StartGate()
+{
+	if (pGate)
+		return;
+	pGate = new CQnetGateway;
+	CQnetGateway *p = pGate;
+	futGate = std::async(std::launch::async, [p]() { if (! p->Init(CConfigure::Current())) p->Process(); });
+}
+
+void CDaemon::StartLink()
+{
+	if (pLink)
+		return;
+	pLink = new CQnetLink;
+	CQnetLink *p = pLink;
+	futLink = std::async(std::launch::async, [p, this]() { if (! p->Init(CConfigure::Current(), &linkstate)) p->Process(); });
+}
+
+void CDaemon::StopGate()
+{
+	if (nullptr != pGate) {
+		pGate->keep_running = false;
+		futGate.get();
+		delete pGate;
+		pGate = nullptr;
+	}
+}
+
+void CDaemon::StopLink()
+{
+	if (nullptr != pLink) {
+		pLink->keep_running = false;
+		futLink.get();
+		pLink->Shutdown();	// unlink and release the ports so the link can be started again
+		delete pLink;
+		pLink = nullptr;
+	}
+}
+
+void CDaemon::Reload()
+{
+	// a new qdv.cfg is published to everything that subscribed to it, ConfigChanged does the rest
+	printf("Reloading qdv.cfg and %s\n", hostfile.GetPath().c_str());
+	cfg.ReadData();
+	hostfile.Load(qnDB);
+	status.SetGateways(qnDB.Count("GATEWAYS"));
+}
+
+void CDaemon::ConfigChanged(const CFGDATA &old, const CFGDATA &now)
+{
+	const unsigned changed = CConfigure::Compare(old, now);
+	cfgdata = now;
+	if (changed & CFG_STATION) {
+		StopGate();
+		StopLink();
+	} else if ((changed & (CFG_NETWORK | CFG_LOCATION)) || old.sCallsign.compare(now.sCallsign))
+		StopGate();	// the gateway reads these once when it starts
+	if (old.bAcceptLinks != now.bAcceptLinks)
+		StopLink();	// and the link reads this
+	if (! now.bRouteEnable)
+		StopGate();
+	if (! now.bLinkEnable)
+		StopLink();
+	if (now.bRouteEnable)
+		StartGate();
+	if (now.bLinkEnable)
+		StartLink();
+	if (pGate && old.iCacheKB!=now.iCacheKB)
+		pGate->SetCacheLimit(now.iCacheKB);
+	if (old.bDPlusEnable!=now.bDPlusEnable || (now.bDPlusEnable && old.sStation.compare(now.sStation))) {
+		// a DPlus row may have replaced a host file row with the same name, so the host file is written again
+		dplus.Stop();
+		qnDB.ClearGW(EGWSource::dplus);
+		hostfile.Forget();
+		RebuildGateways();
+	}
+
+	if (changed & (CFG_STATION | CFG_STATUS)) {
+		status.Stop();
+		if (now.bStatusEnable)
+			status.Start(now.usStatusPort, now.sStation, now.cModule, &linkstate);
+	}
+	if (old.bCaptureEnable!=now.bCaptureEnable || old.iCaptureMB!=now.iCaptureMB) {
+		if (now.bCaptureEnable)
+			CCapture::Open(CapturePath(), 1024UL * 1024UL * now.iCaptureMB);
+		else
+			CCapture::Close();
+	}
+}
+
+void CDaemon::RebuildGateways()
+{
+	int count = hostfile.Load(qnDB);
+	if (count < 0)
+		count = 0;
+	const std::string &filename = hostfile.GetPath();
+
+	if (cfgdata.bDPlusEnable && ! cfgdata.sStation.empty()) {
+		// the list is stored by StoreDPlus() when it arrives
+		dplus.Start(cfgdata.sStation, DPLUS_AUTH_SERVER, true, false);
+		printf("# of Gateways: %s=%d, downloading the DPlus list from %s\n", filename.c_str(), count, DPLUS_AUTH_SERVER);
+	} else {
+		printf("#Gateways: %s=%d\n", filename.c_str(), count);
+	}
+	status.SetGateways(qnDB.Count("GATEWAYS"));
+}
+
+void CDaemon::StoreDPlus()
+{
+	int count = dplus.Store(qnDB);
+	if (count < 0)
+		return;
+	fprintf(stderr, "DPlus Authorization completed!\n");
+	printf("# of Gateways %s=%d Total=%d\n", DPLUS_AUTH_SERVER, count, qnDB.Count("GATEWAYS"));
+	status.SetGateways(qnDB.Count("GATEWAYS"));
+}
+
+bool CDaemon::Init()
+// returns true on error
+{
+	if (! cfg.IsOkay()) {
+		fprintf(stderr, "The configuration in %sqdv.cfg is not complete, run qdv to set it up\n", CFG_DIR);
+		return true;
+	}
+
+	// the signals are handled in the event loop, so every thread started from here must block them
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGHUP);
+	sigprocmask(SIG_BLOCK, &mask, nullptr);
+	sigfd = signalfd(-1, &mask, SFD_CLOEXEC);
+	if (sigfd < 0) {
+		perror("signalfd");
+		return true;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	std::string dbname(CFG_DIR);
+	dbname.append("qn.db");
+	if (qnDB.Open(dbname.c_str()))
+		return true;
+	qnDB.ClearLH();
+	qnDB.ClearLS();
+	qnDB.ClearGW();
+	RebuildGateways();
+
+	if (! AudioManager.AMBEDevice.IsOpen())
+		AudioManager.AMBEDevice.FindandOpen(cfgdata.iBaudRate, Encoding::dstar);
+	if (AudioManager.Init(&cfg, [this](bool is_rx) { is_receiving = is_rx; }))
+		return true;
+
+	// the control socket
+	ctlfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (ctlfd < 0) {
+		perror("control socket");
+		return true;
+	}
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, ControlPath(), sizeof(addr.sun_path) - 1);
+	unlink(ControlPath());	// left over from a previous run
+	if (bind(ctlfd, (struct sockaddr *)&addr, sizeof(addr)) || listen(ctlfd, 4)) {
+		fprintf(stderr, "Could not open the control socket %s: %s\n", ControlPath(), strerror(errno));
+		close(ctlfd);
+		ctlfd = -1;
+		return true;
+	}
+
+	aprs.Init();
+	if (cfgdata.bCaptureEnable)
+		CCapture::Open(CapturePath(), 1024UL * 1024UL * cfgdata.iCaptureMB);
+	if (cfgdata.bRouteEnable)
+		StartGate();
+	if (cfgdata.bLinkEnable)
+		StartLink();
+	if (cfgdata.bStatusEnable)
+		status.Start(cfgdata.usStatusPort, cfgdata.sStation, cfgdata.cModule, &linkstate);
+	cfg_subscription = CConfigure::Subscribe(CFG_STATION | CFG_NETWORK | CFG_USER | CFG_LOCATION | CFG_LINK | CFG_ROUTE | CFG_STATUS | CFG_CAPTURE, [this](const CFGDATA &old, const CFGDATA &now) { ConfigChanged(old, now); });
+
+	printf("qdvd is running for %s module %c, control socket is %s\n", cfgdata.sStation.c_str(), cfgdata.cModule, ControlPath());
+	return false;
+}
+
+void CDaemon::DrainLog()
+{
+	// systemd-journald understands the <level> prefixes
+	static const char *prefix[] = { "<7>", "<6>", "<4>", "<3>" };
+	CLogRing::Drain([](ELogLevel l, const char *line) {
+		fputs(prefix[int(l)], stdout);
+		fputs(line, stdout);
+	}, LOG_RING_SIZE);
+	unsigned dropped = CLogRing::Dropped();
+	if (dropped)
+		printf("<4>%u log messages were dropped\n", dropped);
+	fflush(stdout);
+}
+
+void CDaemon::Run()
+{
+	time_t lastcheck = time(nullptr);
+	bool quit = false;
+	while (! quit) {
+		struct pollfd pfd[2] = { { sigfd, POLLIN, 0 }, { ctlfd, POLLIN, 0 } };
+		if (0 > poll(pfd, 2, LOG_DRAIN_MS) && EINTR != errno) {
+			perror("qdvd poll");
+			break;
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			struct signalfd_siginfo info;
+			if (sizeof(info) == read(sigfd, &info, sizeof(info))) {
+				if (SIGHUP == info.ssi_signo) {
+					Reload();
+				} else {
+					printf("Caught signal %u, shutting down\n", info.ssi_signo);
+					quit = true;
+				}
+			}
+		}
+
+		if (pfd[1].revents & POLLIN) {
+			int fd = accept4(ctlfd, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd >= 0) {
+				// a command is one short line, so a slow client can't hold up the loop for long
+				struct timeval tv = { 0, 500000 };
+				setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+				char buf[CONTROL_LINE];
+				ssize_t len = recv(fd, buf, CONTROL_LINE - 1, 0);
+				if (len > 0) {
+					buf[len] = '\0';
+					std::string reply(Command(buf, quit));
+					send(fd, reply.c_str(), reply.size(), MSG_NOSIGNAL);
+				}
+				close(fd);
+			}
+		}
+
+		DrainLog();
+
+		time_t now = time(nullptr);
+		if (now - lastcheck >= HOSTFILE_CHECK) {
+			lastcheck = now;
+			if (hostfile.Changed()) {
+				hostfile.Load(qnDB);
+				status.SetGateways(qnDB.Count("GATEWAYS"));
+			}
+			StoreDPlus();
+		}
+	}
+	if (is_transmitting)
+		AudioManager.KeyOff();
+}
+
+std::string CDaemon::Status()
+{
+	std::ostringstream ss;
+	ss << "station " << cfgdata.sStation << " module " << cfgdata.cModule << '\n';
+	// a thread that failed to initialize has already returned
+	const bool gate = pGate && std::future_status::timeout == futGate.wait_for(std::chrono::seconds(0));
+	const bool link = pLink && std::future_status::timeout == futLink.wait_for(std::chrono::seconds(0));
+	ss << "gateway " << (gate ? "running" : "stopped") << ", link " << (link ? "running" : "stopped") << '\n';
+	const std::vector<SLINKEVENT> links(linkstate.Linked());
+	for (const auto &ev : links)
+		ss << "linked to " << ev.callsign << " since " << ev.time << '\n';
+	if (links.empty())
+		ss << "not linked\n";
+	ss << (is_receiving ? "receiving" : (is_transmitting ? "transmitting" : (is_echoing ? "recording echo" : "idle"))) << '\n';
+	ss << "gateways " << qnDB.Count("GATEWAYS") << '\n';
+	if (gate) {
+		SCACHESTATS cs;
+		pGate->GetCacheStats(cs);
+		ss << "route cache " << cs.users << " users, " << cs.rptrs << " repeaters, " << cs.gates << " gateways, " << cs.names << " nicks, ";
+		ss << cs.bytes / 1024 << " of " << cs.limit / 1024 << " KB, " << cs.total / 1024 << " KB in all, " << cs.evicted << " dropped\n";
+	}
+	if (CCapture::IsOpen())
+		ss << "capturing to " << CapturePath() << '\n';
+	return ss.str();
+}
+
+std::string CDaemon::Command(const std::string &line, bool &quit)
+{
+	std::istringstream in(line);
+	std::string cmd, arg;
+	in >> cmd;
+	std::getline(in, arg);
+	for (auto &c : cmd)
+		c = tolower(c);
+	// the argument is a callsign, so trim it and make it upper case
+	const auto first = arg.find_first_not_of(" \t");
+	arg = (std::string::npos == first) ? "" : arg.substr(first, arg.find_last_not_of(" \t\r\n") + 1 - first);
+	for (auto &c : arg)
+		c = toupper(c);
+
+	if (0 == cmd.compare("status")) {
+		return Status();
+
+	} else if (0 == cmd.compare("stats")) {
+		return CPipelineStats::JSON() + '\n';
+
+	} else if (0 == cmd.compare("link")) {
+		if (nullptr == pLink)
+			return "error: the link is not running\n";
+		// the module is always in the last position
+		if (arg.size() < 2 || arg.size() > 8 || ! isalpha(arg.back()))
+			return "error: usage is link REFLECTOR, for example link XRF757A\n";
+		std::string target(arg.substr(0, arg.size() - 1));
+		while (target.size() && ' ' == target.back())
+			target.pop_back();
+		target.resize(7, ' ');
+		target.push_back(arg.back());
+		if (! qnDB.FindGW(target.c_str()))
+			return "error: " + target.substr(0, 6) + " is not in the gateway list\n";
+		printf("Linking to %s.\n", target.c_str());
+		AudioManager.Link("LINK" + target);
+		return "ok\n";
+
+	} else if (0 == cmd.compare("unlink")) {
+		if (nullptr == pLink)
+			return "error: the link is not running\n";
+		AudioManager.Link("LINK");
+		return "ok\n";
+
+	} else if (0 == cmd.compare("ptt")) {
+		// ptt [URCALL] keys up, ptt off keys down
+		if (0 == arg.compare("OFF")) {
+			if (! is_transmitting)
+				return "error: not transmitting\n";
+			AudioManager.KeyOff();
+			is_transmitting = false;
+			return "ok\n";
+		}
+		if (is_receiving || is_transmitting || is_echoing)
+			return "error: busy\n";
+		const std::string urcall(arg.empty() ? "CQCQCQ" : arg);
+		const bool is_cqcqcq = (0 == urcall.compare(0, 6, "CQCQCQ"));
+		if (is_cqcqcq && cfgdata.bLinkEnable)
+			AudioManager.RecordMicThread(E_PTT_Type::link, "CQCQCQ");
+		else if (! is_cqcqcq && cfgdata.bRouteEnable)
+			AudioManager.RecordMicThread(E_PTT_Type::gateway, urcall);
+		else
+			return "error: " + std::string(is_cqcqcq ? "linking" : "routing") + " is not enabled\n";
+		is_transmitting = true;
+		if (cfgdata.bAPRSEnable)
+			aprs.UpdateUser();
+		return "ok\n";
+
+	} else if (0 == cmd.compare("quickkey")) {
+		if (is_receiving || is_transmitting || is_echoing)
+			return "error: busy\n";
+		AudioManager.QuickKey(arg.empty() ? "CQCQCQ" : arg.c_str());
+		return "ok\n";
+
+	} else if (0 == cmd.compare("echo")) {
+		// echo on records the mic, echo off plays it back
+		if (0 == arg.compare("OFF")) {
+			if (! is_echoing)
+				return "error: not recording\n";
+			AudioManager.PlayAMBEDataThread();
+			is_echoing = false;
+			return "ok\n";
+		}
+		if (is_receiving || is_transmitting || is_echoing)
+			return "error: busy\n";
+		AudioManager.RecordMicThread(E_PTT_Type::echo, "CQCQCQ  ");
+		is_echoing = true;
+		return "ok\n";
+
+	} else if (0 == cmd.compare("capture")) {
+		// capture on starts a new capture file, capture off closes it
+		if (0 == arg.compare("OFF")) {
+			CCapture::Close();
+			return "ok\n";
+		}
+		if (CCapture::Open(CapturePath(), 1024UL * 1024UL * cfgdata.iCaptureMB))
+			return "error: could not open " + CapturePath() + "\n";
+		return "capturing to " + CapturePath() + "\n";
+
+	} else if (0 == cmd.compare("reload")) {
+		Reload();
+		return "ok\n";
+
+	} else if (0 == cmd.compare("quit")) {
+		quit = true;
+		return "ok\n";
+	}
+
+	return "commands: status, stats, link REFLECTOR, unlink, ptt [URCALL], ptt off, quickkey [URCALL], echo, echo off, capture, capture off, reload, quit\n";
+}
+
+static int SendCommand(const std::string &command)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror("socket");
+		return 1;
+	}
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, ControlPath(), sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		fprintf(stderr, "Could not connect to %s: %s\n", ControlPath(), strerror(errno));
+		close(fd);
+		return 1;
+	}
+	send(fd, command.c_str(), command.size(), MSG_NOSIGNAL);
+	shutdown(fd, SHUT_WR);
+	char buf[1024];
+	ssize_t len;
+	int rval = 0;
+	while ((len = recv(fd, buf, sizeof(buf), 0)) > 0) {
+		if (0 == strncmp(buf, "error:", 6))
+			rval = 1;
+		fwrite(buf, 1, len, stdout);
+	}
+	close(fd);
+	return rval;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1) {
+		if (strcmp(argv[1], "-c") || argc < 3) {
+			fprintf(stderr, "usage: %s [-c command]\n", argv[0]);
+			fprintf(stderr, "  without -c the daemon is started, otherwise the command is sent to the running daemon\n");
+			fprintf(stderr, "  the commands are status, stats, link REFLECTOR, unlink, ptt [URCALL], ptt off,\n");
+			fprintf(stderr, "  quickkey [URCALL], echo, echo off, capture, capture off, reload and quit\n");
+			fprintf(stderr, "  reload (or SIGHUP) re-reads qdv.cfg and gwys.txt\n");
+			return 1;
+		}
+		std::string command(argv[2]);
+		for (int i=3; i<argc; i++)
+			command.append(" ").append(argv[i]);
+		return SendCommand(command + '\n');
+	}
+
+	CDaemon daemon;
+	if (daemon.Init())
+		return 1;
+	daemon.Run();
+	return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// print the QSO journal, as text or as JSON lines, and optionally keep following it
+
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <csignal>
+#include <string>
+
+#include "Journal.h"
+
+#ifndef CFG_DIR
+#define CFG_DIR "/tmp/"
+#endif
+
+static volatile sig_atomic_t keep_running = 1;
+
+static void SigHandler(int)
+{
+	keep_running = 0;
+}
+
+static void Print(const SJOURNAL &rec, bool json)
+{
+	const bool islink = (rec.event >= EJournalEvent::linked);
+	if (json) {
+		printf("%s\n", JournalJSON(rec).c_str());
+		return;
+	}
+
+	const time_t t = rec.time / 1000;
+	struct tm tm;
+	localtime_r(&t, &tm);
+	char when[32];
+	strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+	printf("%s.%03d %-12s %c ", when, int(rec.time % 1000), JournalEventName(rec.event), rec.module ? rec.module : ' ');
+	if (islink) {
+		printf("%s\n", JournalField(rec.urcall, 8).c_str());
+		return;
+	}
+	printf("id=%04x my=%s/%s ur=%s r1=%s r2=%s", ntohs(rec.streamid), JournalField(rec.mycall, 8).c_str(), JournalField(rec.sfx, 4).c_str(), JournalField(rec.urcall, 8).c_str(), JournalField(rec.rpt1, 8).c_str(), JournalField(rec.rpt2, 8).c_str());
+	if (EJournalEvent::rx_end==rec.event || EJournalEvent::tx_end==rec.event) {
+		printf(" %u.%02us frames=%u silent=%u lost=%u", rec.duration / 1000, (rec.duration % 1000) / 10, rec.frames, rec.silent, rec.lost);
+		if (rec.frames)
+			printf(" BER=%.2f%%", 100.0 * rec.bit_errors / (24.0 * rec.frames));	// only the first Golay word is checked
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	bool follow = false, json = false;
+	unsigned long last = 0;
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "fjn:"))) {
+		switch (opt) {
+			case 'f':
+				follow = true;
+				break;
+			case 'j':
+				json = true;
+				break;
+			case 'n':
+				last = strtoul(optarg, nullptr, 10);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-f] [-j] [-n count] [journal]\n", argv[0]);
+				fprintf(stderr, "  -f keep printing new records as they are added\n");
+				fprintf(stderr, "  -j print JSON, one object per line\n");
+				fprintf(stderr, "  -n only print the last count records\n");
+				return EXIT_FAILURE;
+		}
+	}
+	std::string path(CFG_DIR "qso.jnl");
+	if (optind < argc)
+		path.assign(argv[optind]);
+
+	CJournalReader reader;
+	if (reader.Open(path.c_str()))
+		return EXIT_FAILURE;
+
+	if (last)
+		reader.SeekBack(last);
+
+	signal(SIGINT, SigHandler);
+	signal(SIGTERM, SigHandler);
+	SJOURNAL rec;
+	while (keep_running) {
+		while (! reader.Read(rec))
+			Print(rec, json);
+		if (! follow)
+			break;
+		fflush(stdout);
+		usleep(250000);
+	}
+	if (reader.Missed())
+		fprintf(stderr, "%llu records were overwritten before they could be read\n", (unsigned long long)reader.Missed());
+	return EXIT_SUCCESS;
+}
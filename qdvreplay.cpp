@@ -0,0 +1,262 @@
+/*
+ *   Copyright (C) 2020 by Thomas Early N7TAE
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+// print a packet capture, or send it back to the gateway and link ports at its original pace or faster
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+#include "Capture.h"
+
+#ifndef CFG_DIR
+#define CFG_DIR "/tmp/"
+#endif
+
+static volatile sig_atomic_t keep_running = 1;
+
+static void SigHandler(int)
+{
+	keep_running = 0;
+}
+
+static const char *TypeName(ECapture type)
+{
+	switch (type) {
+		case ECapture::g2:  return "g2";
+		case ECapture::xrf: return "xrf";
+		case ECapture::ref: return "ref";
+		case ECapture::dcs: return "dcs";
+		default:            return "?";
+	}
+}
+
+// the port each kind of datagram was received on, and the one its sender uses
+static unsigned short TypePort(ECapture type)
+{
+	switch (type) {
+		case ECapture::g2:  return 40000U;
+		case ECapture::xrf: return 30001U;
+		case ECapture::ref: return 20001U;
+		default:            return 30051U;
+	}
+}
+
+// where the stream id is in each kind of voice datagram, or -1 if it's not a voice datagram
+static int StreamIDOffset(const SCAPTUREDATA &rec)
+{
+	const size_t len = rec.data.size();
+	const unsigned char *d = rec.data.data();
+	switch (rec.type) {
+		case ECapture::g2:
+		case ECapture::xrf:
+			return ((56==len || 27==len) && 0==memcmp(d, "DSVT", 4)) ? 12 : -1;
+		case ECapture::ref:
+			return ((58==len || 29==len) && 0==memcmp(d+2, "DSVT", 4)) ? 14 : -1;
+		case ECapture::dcs:
+			return (len>=100 && 0==memcmp(d, "0001", 4)) ? 43 : -1;
+		default:
+			return -1;
+	}
+}
+
+static void Print(const SCAPTUREDATA &rec)
+{
+	const time_t t = rec.time / 1000000;
+	struct tm tm;
+	localtime_r(&t, &tm);
+	char when[32];
+	strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+	char addr[INET6_ADDRSTRLEN] = "?";
+	inet_ntop(rec.peer.family, rec.peer.addr, addr, sizeof(addr));
+	printf("%s.%06d %-3s %s:%u %u bytes", when, int(rec.time % 1000000), TypeName(rec.type), addr, ntohs(rec.peer.port), unsigned(rec.data.size()));
+	const int sid = StreamIDOffset(rec);
+	if (sid >= 0) {
+		const unsigned char *d = rec.data.data();
+		printf(" id=%02x%02x", d[sid], d[sid+1]);
+		if (ECapture::dcs == rec.type)
+			printf(" seq=%02x", d[45]);
+		else if (rec.data.size() < 56)
+			printf(" seq=%02x", d[sid+2]);
+		else
+			printf(" header");
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	bool dump = false;
+	double speed = 1.0;
+	unsigned loops = 1U, copies = 1U;
+	std::string target("127.0.0.1"), bindaddr, types("g2,xrf,ref,dcs");
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "dx:l:c:t:b:p:"))) {
+		switch (opt) {
+			case 'd':
+				dump = true;
+				break;
+			case 'x':
+				speed = atof(optarg);
+				break;
+			case 'l':
+				loops = unsigned(strtoul(optarg, nullptr, 10));
+				break;
+			case 'c':
+				copies = unsigned(strtoul(optarg, nullptr, 10));
+				break;
+			case 't':
+				target.assign(optarg);
+				break;
+			case 'b':
+				bindaddr.assign(optarg);
+				break;
+			case 'p':
+				types.assign(optarg);
+				break;
+			default:
+				copies = 0U;
+				break;
+		}
+	}
+	if (speed < 0.0 || 0U == loops || 0U == copies || copies > 1000U) {
+		fprintf(stderr, "usage: %s [-d] [-x speed] [-l loops] [-c copies] [-t target] [-b address] [-p types] [capture]\n", argv[0]);
+		fprintf(stderr, "  -d print the capture instead of sending it\n");
+		fprintf(stderr, "  -x 1 is the original pace, the default, 2 is twice as fast and 0 is as fast as possible\n");
+		fprintf(stderr, "  -l send the whole capture this many times\n");
+		fprintf(stderr, "  -c send this many copies of every stream at once, each with its own stream id\n");
+		fprintf(stderr, "  -t where qdv is running, default 127.0.0.1\n");
+		fprintf(stderr, "  -b send from this address and the port for each protocol, so the link will accept it\n");
+		fprintf(stderr, "  -p only send some of g2, xrf, ref and dcs, default is all of them\n");
+		return EXIT_FAILURE;
+	}
+	std::string path(CFG_DIR "qdv.cap");
+	if (optind < argc)
+		path.assign(argv[optind]);
+
+	CCaptureReader reader;
+	if (reader.Open(path.c_str()))
+		return EXIT_FAILURE;
+
+	// read all of it first, so the disk doesn't disturb the timing
+	std::vector<SCAPTUREDATA> records;
+	SCAPTUREDATA rec;
+	while (reader.Next(rec)) {
+		if (dump)
+			Print(rec);
+		else if (std::string::npos != types.find(TypeName(rec.type)))
+			records.push_back(rec);
+	}
+	if (dump)
+		return EXIT_SUCCESS;
+	if (records.empty()) {
+		fprintf(stderr, "There is nothing to send in %s\n", path.c_str());
+		return EXIT_FAILURE;
+	}
+
+	// one socket for each protocol, so the source port matches what the peer would use
+	const int family = (std::string::npos == target.find(':')) ? AF_INET : AF_INET6;
+	int sock[4];
+	CSockAddress dest[4];
+	for (int i=0; i<4; i++) {
+		const ECapture type = ECapture(int(ECapture::g2) + i);
+		sock[i] = socket(family, SOCK_DGRAM, 0);
+		if (sock[i] < 0) {
+			perror("socket");
+			return EXIT_FAILURE;
+		}
+		if (bindaddr.size()) {
+			CSockAddress from(family, TypePort(type), bindaddr.c_str());
+			if (bind(sock[i], from.GetCPointer(), from.GetSize())) {
+				fprintf(stderr, "Can't bind to [%s]:%u: %s\n", bindaddr.c_str(), TypePort(type), strerror(errno));
+				return EXIT_FAILURE;
+			}
+		}
+		dest[i].Initialize(family, TypePort(type), target.c_str());
+	}
+
+	signal(SIGINT, SigHandler);
+	signal(SIGTERM, SigHandler);
+	const auto start = std::chrono::steady_clock::now();
+	const int64_t first = records.front().time;
+	const int64_t length = records.back().time - first + 20000;	// the next loop starts one frame later
+	unsigned long sent = 0, failed = 0;
+	int64_t maxlate = 0;
+	for (unsigned loop=0; keep_running && loop<loops; loop++) {
+		for (auto &r : records) {
+			if (! keep_running)
+				break;
+			if (speed > 0.0) {
+				const auto when = start + std::chrono::microseconds(int64_t((loop * length + r.time - first) / speed));
+				const auto now = std::chrono::steady_clock::now();
+				if (when > now)
+					std::this_thread::sleep_until(when);
+				else {
+					const int64_t late = std::chrono::duration_cast<std::chrono::microseconds>(now - when).count();
+					if (late > maxlate)
+						maxlate = late;
+				}
+			}
+			const int i = int(r.type) - int(ECapture::g2);
+			const int sid = StreamIDOffset(r);
+			for (unsigned c=0; c<copies; c++) {
+				if (c && sid < 0)
+					break;	// only the voice datagrams are copied
+				unsigned char *id = r.data.data() + sid;
+				if (c) {
+					// a different stream id for each copy
+					unsigned short s = (id[0] | (id[1] << 8)) + 1;
+					id[0] = s & 0xffU;
+					id[1] = (s >> 8) & 0xffU;
+				}
+				if (0 > sendto(sock[i], r.data.data(), r.data.size(), 0, dest[i].GetCPointer(), dest[i].GetSize()))
+					failed++;
+				else
+					sent++;
+			}
+			if (copies > 1U && sid >= 0) {
+				// put the original stream id back for the next loop
+				unsigned char *id = r.data.data() + sid;
+				unsigned short s = (id[0] | (id[1] << 8)) - (copies - 1U);
+				id[0] = s & 0xffU;
+				id[1] = (s >> 8) & 0xffU;
+			}
+		}
+	}
+	const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (int i=0; i<4; i++)
+		close(sock[i]);
+	printf("sent %lu datagrams in %.3f s, %.0f per second", sent, elapsed, elapsed > 0.0 ? sent / elapsed : 0.0);
+	if (speed > 0.0)
+		printf(", at most %lld us behind schedule", (long long)maxlate);
+	if (failed)
+		printf(", %lu could not be sent", failed);
+	printf("\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}